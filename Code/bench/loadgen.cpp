@@ -0,0 +1,412 @@
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ByteBuffer.h"
+#include "HTTPServer.h"
+#include "LogLinearHistogram.h"
+#include "Logger.h"
+#include "TCPSocket.h"
+#include "Util.h"
+
+// Sends the request shapes from "Deliverable 1/API Examples" to a running evaluation server, over
+// kept-alive connections (one per thread), and reports throughput and latency per call.
+//
+// Closed loop (the default) sends each request as soon as the last response arrives, which finds
+// the most the server can take. Open loop (--rate) sends on a fixed schedule whether or not the
+// server keeps up, and measures latency from when each request was due rather than when it went
+// out, so a stalled server can't hide its queueing from the percentiles.
+
+using Clock = std::chrono::steady_clock;
+
+enum Operation { AUTOFILL, QUERY_ID, REPORT_SEARCH, REPORT_METRICS, NUM_OPERATIONS };
+
+static constexpr std::array<const char*, NUM_OPERATIONS> OPERATION_NAMES = {
+    "autofill", "query_id", "report_search", "report_metrics"};
+
+// Default values for arguments
+static constexpr const char*  DEFAULT_HOST        = "127.0.0.1";
+static constexpr uint16_t     DEFAULT_PORT        = 8080;
+static constexpr unsigned int DEFAULT_CONNECTIONS = 4;
+static constexpr unsigned int DEFAULT_DURATION_S  = 10;
+static constexpr unsigned int DEFAULT_WARMUP_S    = 1;
+// Mostly reads, about what the UI sends per search
+static constexpr std::array<unsigned int, NUM_OPERATIONS> DEFAULT_MIX = {4, 2, 2, 1};
+
+static constexpr unsigned int RESPONSE_TIMEOUT_MS = 5000;
+// Query IDs a connection holds on to for ReportSearchResults, any more are thrown away
+static constexpr std::size_t  MAX_QUERY_IDS       = 1024;
+
+static constexpr double NS_PER_MS = 1e6;
+
+struct LoadConfig {
+  std::string                              host        = DEFAULT_HOST;
+  uint16_t                                 port        = DEFAULT_PORT;
+  unsigned int                             connections = DEFAULT_CONNECTIONS;
+  std::chrono::seconds                     duration{DEFAULT_DURATION_S};
+  std::chrono::seconds                     warmup{DEFAULT_WARMUP_S};
+  // Requests per second over every connection, 0 for a closed loop
+  double                                   rate = 0;
+  std::array<unsigned int, NUM_OPERATIONS> mix  = DEFAULT_MIX;
+  // Where to write the JSON report, "-" for stdout
+  std::string                              json_path;
+};
+
+// What one connection saw after the warmup. Only written by its own thread.
+struct ConnectionResult {
+  std::array<LogLinearHistogram, NUM_OPERATIONS> latency_ns;
+  std::array<uint64_t, NUM_OPERATIONS>           requests{};
+  // No response at all, or anything but a 2xx
+  std::array<uint64_t, NUM_OPERATIONS>           errors{};
+  uint64_t                                       reconnects = 0;
+};
+
+// A kept-alive connection, reopened whenever the server closes it
+class Connection {
+ public:
+  Connection(std::string ip, uint16_t port)
+      : m_ip(std::move(ip))
+      , m_port(port) {}
+
+  bool open() {
+    m_socket = TCPSocket();
+    m_buffer = ByteBuffer();
+    m_open   = m_socket.create() && m_socket.setTimeout<SO_RCVTIMEO>(RESPONSE_TIMEOUT_MS)
+           && m_socket.connect(m_ip.c_str(), m_port);
+    return m_open;
+  }
+
+  // Sends the serialized request and waits for its response, reopening the connection first if
+  // it was closed. Returns nullopt (and drops the connection) if no response came back.
+  std::optional<HTTPResponse> exchange(const std::string& request, uint64_t& reconnects) {
+    if (!m_open) {
+      ++reconnects;
+      if (!open()) { return std::nullopt; }
+    }
+    std::optional<HTTPResponse> response;
+    if (m_socket.send(request)) { response = HTTPWorker::parseResponse(m_socket, m_buffer); }
+    if (!response.has_value() || response->headers["connection"] == "close") {
+      m_socket.close();
+      m_open = false;
+    }
+    return response;
+  }
+
+ private:
+  std::string m_ip;
+  uint16_t    m_port;
+  TCPSocket   m_socket;
+  ByteBuffer  m_buffer;
+  bool        m_open = false;
+};
+
+// The requests which are the same every time, serialized once
+static std::array<std::string, NUM_OPERATIONS> fixedRequests() {
+  std::array<std::string, NUM_OPERATIONS> requests;
+
+  HTTPRequest autofill(HTTPRequest::GET, "/v0/GetAutofill");
+  autofill.headers["Num-Suggestions"] = "3";
+  autofill.headers["Partial-Query"]   = "how do i";
+  requests[AUTOFILL]                  = to_string(autofill);
+
+  requests[QUERY_ID] = to_string(HTTPRequest(HTTPRequest::GET, "/v0/GetQueryID"));
+
+  const nlohmann::json reported = {
+      {"metrics", {{{"label", "Query Time"}, {"value", 1464}}}}
+  };
+  HTTPRequest metrics(HTTPRequest::POST, "/v0/ReportMetrics", reported);
+  metrics.headers["Component"] = "querying";
+  requests[REPORT_METRICS]     = to_string(metrics);
+  return requests;
+}
+
+static std::string searchResultsRequest(uint64_t query_id) {
+  const nlohmann::json body = {
+      {       "query_ID",                                                  query_id},
+      {      "raw_query",                                          "RPI Professors"},
+      {        "results", {"link1.com", "link2.com", "magical.awesome.link.com", "link3.com"}},
+      {        "clicked",                                                         2},
+      {"query_timestamp",                                 "2022-09-27 18:00:00.000"}
+  };
+  return to_string(HTTPRequest(HTTPRequest::POST, "/v0/ReportSearchResults", body));
+}
+
+// One connection's worth of load, run on its own thread until `end`
+static void runConnection(const LoadConfig& config, const std::string& ip, unsigned int index,
+                          Clock::time_point start, ConnectionResult& result) {
+  const std::array<std::string, NUM_OPERATIONS> fixed = fixedRequests();
+  Connection                                    connection(ip, config.port);
+  std::mt19937_64                               random(index);
+  std::discrete_distribution<std::size_t>       pick(config.mix.begin(), config.mix.end());
+  // ReportSearchResults reports IDs handed out to this connection, like the UI does
+  std::vector<uint64_t>                         query_ids;
+
+  const Clock::time_point measure_from = start + config.warmup;
+  const Clock::time_point end          = measure_from + config.duration;
+  // Each connection sends its share of the rate, offset so they don't all send at once
+  const bool              open_loop    = config.rate > 0;
+  const Clock::duration   interval =
+      open_loop ? std::chrono::duration_cast<Clock::duration>(
+                      std::chrono::duration<double>(config.connections / config.rate))
+                : Clock::duration::zero();
+  Clock::time_point       due = start + interval * index / config.connections;
+
+  while (true) {
+    if (open_loop) {
+      std::this_thread::sleep_until(due);
+    } else {
+      due = Clock::now();
+    }
+    if (due >= end) { break; }
+    const Clock::time_point sent = due;
+    due += interval;
+
+    auto operation = static_cast<Operation>(pick(random));
+    // Without an ID to report, get one first
+    if (operation == REPORT_SEARCH && query_ids.empty()) { operation = QUERY_ID; }
+    std::string searched;
+    if (operation == REPORT_SEARCH) {
+      searched = searchResultsRequest(query_ids.back());
+      query_ids.pop_back();
+    }
+    std::optional<HTTPResponse> response = connection.exchange(
+        operation == REPORT_SEARCH ? searched : fixed[operation], result.reconnects);
+    const Clock::time_point done = Clock::now();
+
+    const bool ok = response.has_value() && response->code / 100 == 2;    // NOLINT(*-magic-numbers)
+    if (ok && operation == QUERY_ID && query_ids.size() < MAX_QUERY_IDS) {
+      const nlohmann::json body = nlohmann::json::parse(response->body, nullptr, false);
+      if (body.contains("query_ID") && body["query_ID"].is_number_unsigned()) {
+        query_ids.push_back(body["query_ID"].get<uint64_t>());
+      }
+    }
+    if (sent < measure_from) { continue; }
+    ++result.requests[operation];
+    if (!ok) { ++result.errors[operation]; }
+    result.latency_ns[operation].record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(done - sent).count()));
+  }
+}
+
+// Latencies in milliseconds, null if nothing was recorded
+static nlohmann::json latencyJSON(const HistogramSummary& latency) {
+  auto ms = [&](double q) -> nlohmann::json {
+    const std::optional<double> ns = latency.quantile(q);
+    return ns.has_value() ? nlohmann::json(*ns / NS_PER_MS) : nlohmann::json(nullptr);
+  };
+  const nlohmann::json mean =
+      latency.count() == 0 ? nlohmann::json(nullptr) : nlohmann::json(latency.mean() / NS_PER_MS);
+  return {
+      { "mean",      mean},
+      {  "p50",   ms(0.5)},
+      {  "p99",  ms(0.99)},
+      {"p99.9", ms(0.999)},
+      {  "max",     ms(1)},
+  };
+}
+
+struct Totals {
+  uint64_t         requests = 0;
+  uint64_t         errors   = 0;
+  HistogramSummary latency_ns;
+};
+
+static void printRow(std::ostream& out, std::string_view name, const Totals& totals,
+                     double seconds) {
+  auto ms = [&](double q) {
+    const std::optional<double> ns = totals.latency_ns.quantile(q);
+    return ns.has_value() ? *ns / NS_PER_MS : 0;
+  };
+  out << std::left << std::setw(16) << name << std::right << std::setw(10) << totals.requests
+      << std::setw(8) << totals.errors << std::fixed << std::setprecision(1) << std::setw(11)
+      << static_cast<double>(totals.requests) / seconds << std::setprecision(3) << std::setw(11)
+      << ms(0.5) << std::setw(11) << ms(0.99) << std::setw(11) << ms(0.999) << std::setw(11)
+      << ms(1) << '\n';
+}
+
+// Throws for anything that isn't "<operation>=<weight>,..."
+static std::array<unsigned int, NUM_OPERATIONS> parseMix(std::string_view arg) {
+  std::array<unsigned int, NUM_OPERATIONS> mix{};
+  while (!arg.empty()) {
+    const std::string_view entry = arg.substr(0, arg.find(','));
+    arg.remove_prefix(std::min(arg.size(), entry.size() + 1));
+    const std::size_t equals = entry.find('=');
+    std::size_t       operation = 0;
+    while (operation < NUM_OPERATIONS && entry.substr(0, equals) != OPERATION_NAMES[operation]) {
+      ++operation;
+    }
+    if (equals == std::string_view::npos || operation == NUM_OPERATIONS) {
+      throw std::invalid_argument("Bad mix entry (" + std::string(entry)
+                                  + "), expected <operation>=<weight>");
+    }
+    mix[operation] = static_cast<unsigned int>(std::stoul(std::string(entry.substr(equals + 1))));
+  }
+  for (const unsigned int weight : mix) {
+    if (weight > 0) { return mix; }
+  }
+  throw std::invalid_argument("Mix has no operations with a positive weight");
+}
+
+// Clang tidy hates getopt so it is a bit messy here
+// NOLINTBEGIN
+#include <getopt.h>
+
+// Command line option info
+constexpr const char*   short_options  = ":H:p:c:d:w:r:m:j:";
+constexpr struct option long_options[] = {
+    {       "host", required_argument, 0, 'H'},
+    {       "port", required_argument, 0, 'p'},
+    {"connections", required_argument, 0, 'c'},
+    {   "duration", required_argument, 0, 'd'},
+    {     "warmup", required_argument, 0, 'w'},
+    {       "rate", required_argument, 0, 'r'},
+    {        "mix", required_argument, 0, 'm'},
+    {       "json", required_argument, 0, 'j'},
+    {            0,                 0, 0,   0}
+};
+
+// Extern variable declarations
+extern char* optarg;
+extern int   optopt;
+// NOLINTEND
+
+int main(int argc, char* argv[]) {
+  // Only failures, parse errors from a struggling server would drown out the report
+  Logger::addConsole(ERROR);
+
+  LoadConfig config;
+  int        option = -1;
+  try {
+    // NOLINTNEXTLINE
+    while ((option = getopt_long(argc, argv, short_options,
+                                 static_cast<const struct option*>(long_options), nullptr))
+           != -1) {
+      switch (option) {
+        case 'H': config.host = optarg; continue;
+        case 'p': config.port = static_cast<uint16_t>(parsePositive(optarg, "port")); continue;
+        case 'c': config.connections = parsePositive(optarg, "connection count"); continue;
+        case 'd':
+          config.duration = std::chrono::seconds(parsePositive(optarg, "duration"));
+          continue;
+        case 'w': config.warmup = std::chrono::seconds(std::stoul(optarg)); continue;
+        case 'r': config.rate = std::stod(optarg); continue;
+        case 'm': config.mix = parseMix(optarg); continue;
+        case 'j': config.json_path = optarg; continue;
+        case '?':
+          LOG(CRITICAL) << "Command line option: " << static_cast<char>(optopt) << " is invalid";
+          return EXIT_FAILURE;
+        case ':':
+          LOG(CRITICAL) << "Command line option " << static_cast<char>(optopt)
+                        << " missing required argument";
+          return EXIT_FAILURE;
+        default: LOG(CRITICAL) << "Unexpected option value " << option; return EXIT_FAILURE;
+      }
+    }
+  } catch (const std::exception& e) {
+    LOG(CRITICAL) << "Caught exception while handling command line arguments: " << e.what();
+    return EXIT_FAILURE;
+  }
+
+  // Looked up once, every connection goes to the same address
+  const std::string ip = TCPSocket::getIP(config.host, config.port);
+  if (ip.empty() || !Connection(ip, config.port).open()) {
+    LOG(CRITICAL) << "Unable to connect to " << config.host << ":" << config.port;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<ConnectionResult> results(config.connections);
+  const Clock::time_point       start = Clock::now();
+  {
+    std::vector<std::jthread> threads;
+    for (unsigned int i = 0; i < config.connections; ++i) {
+      threads.emplace_back(runConnection, std::cref(config), std::cref(ip), i, start,
+                           std::ref(results[i]));
+    }
+  }
+
+  std::array<Totals, NUM_OPERATIONS> operations;
+  Totals                             total;
+  uint64_t                           reconnects = 0;
+  for (const ConnectionResult& result : results) {
+    for (std::size_t op = 0; op < NUM_OPERATIONS; ++op) {
+      operations[op].requests += result.requests[op];
+      operations[op].errors   += result.errors[op];
+      operations[op].latency_ns.merge(result.latency_ns[op]);
+      total.requests += result.requests[op];
+      total.errors   += result.errors[op];
+      total.latency_ns.merge(result.latency_ns[op]);
+    }
+    reconnects += result.reconnects;
+  }
+  const double seconds = std::chrono::duration<double>(config.duration).count();
+  // GetQueryID is sent in place of ReportSearchResults when needed, even if it is not in the mix
+  auto sent = [&](std::size_t op) { return config.mix[op] > 0 || operations[op].requests > 0; };
+
+  std::cout << "Target      " << config.host << ":" << config.port << ", " << config.connections
+            << " connections, ";
+  if (config.rate > 0) {
+    std::cout << "open loop at " << config.rate << " req/s\n";
+  } else {
+    std::cout << "closed loop\n";
+  }
+  std::cout << "Measured    " << config.duration.count() << " s after " << config.warmup.count()
+            << " s of warmup, " << reconnects << " reconnects\n\n";
+  std::cout << std::left << std::setw(16) << "operation" << std::right << std::setw(10)
+            << "requests" << std::setw(8) << "errors" << std::setw(11) << "req/s" << std::setw(11)
+            << "p50 ms" << std::setw(11) << "p99 ms" << std::setw(11) << "p99.9 ms"
+            << std::setw(11) << "max ms" << '\n';
+  for (std::size_t op = 0; op < NUM_OPERATIONS; ++op) {
+    if (sent(op)) { printRow(std::cout, OPERATION_NAMES[op], operations[op], seconds); }
+  }
+  printRow(std::cout, "total", total, seconds);
+
+  if (!config.json_path.empty()) {
+    auto json = [&](const Totals& totals) {
+      return nlohmann::json{
+          {  "requests",                                totals.requests},
+          {    "errors",                                  totals.errors},
+          {"throughput", static_cast<double>(totals.requests) / seconds},
+          {"latency_ms",                 latencyJSON(totals.latency_ns)},
+      };
+    };
+    nlohmann::json report = {
+        {       "host",                                               config.host},
+        {       "port",                                               config.port},
+        {"connections",                                        config.connections},
+        {       "rate", config.rate > 0 ? nlohmann::json(config.rate) : nullptr},
+        { "duration_s",                                   config.duration.count()},
+        {   "warmup_s",                                     config.warmup.count()},
+        { "reconnects",                                                reconnects},
+        {      "total",                                               json(total)},
+    };
+    for (std::size_t op = 0; op < NUM_OPERATIONS; ++op) {
+      if (sent(op)) { report["operations"][OPERATION_NAMES[op]] = json(operations[op]); }
+    }
+    if (config.json_path == "-") {
+      std::cout << report.dump(2) << '\n';
+    } else {
+      std::ofstream file(config.json_path);
+      file << report.dump(2) << '\n';
+      if (!file) {
+        LOG(CRITICAL) << "Unable to write the report to " << config.json_path;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  return total.requests > 0 && total.errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,176 @@
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "ByteBuffer.h"
+#include "HTTPParser.h"
+#include "HTTPServer.h"
+#include "Logger.h"
+#include "TCPSocket.h"
+#include "TimeUtil.h"
+
+// Hot paths of the server, measured one at a time. Run through `make microbench` to get the
+// results as JSON, so two builds can be compared with Google Benchmark's tools/compare.py.
+
+// The socket benchmarks talk to themselves over loopback on this port
+static constexpr uint16_t BENCH_PORT = 8091;
+
+// A connected pair of sockets, the server's end first
+static std::pair<TCPSocket, TCPSocket> connectedPair() {
+  TCPSocket listener;
+  TCPSocket client;
+  if (!listener.create() || !listener.bind(BENCH_PORT) || !listener.listen(1) || !client.create()
+      || !client.connect("127.0.0.1", BENCH_PORT)) {
+    return {};
+  }
+  std::optional<TCPSocket> server = listener.accept();
+  if (!server.has_value()) { return {}; }
+  return {std::move(server.value()), std::move(client)};
+}
+
+// What the UI sends most, and the largest body it sends
+static std::string exampleRequest(bool post) {
+  if (!post) {
+    HTTPRequest request(HTTPRequest::GET, "/v0/GetAutofill");
+    request.headers["Num-Suggestions"] = "3";
+    request.headers["Partial-Query"]   = "how do i";
+    return to_string(request);
+  }
+  const nlohmann::json body = {
+      {       "query_ID",                                                     42},
+      {      "raw_query",                                       "RPI Professors"},
+      {        "results", {"link1.com", "link2.com", "magical.awesome.link.com"}},
+      {        "clicked",                                                      2},
+      {"query_timestamp",                              "2022-09-27 18:00:00.000"}
+  };
+  return to_string(HTTPRequest(HTTPRequest::POST, "/v0/ReportSearchResults", body));
+}
+
+static nlohmann::json exampleBody() {
+  return {
+      {"suggestions", {"how do i pass data structures", "how do i get out of arch", "how do i rpi"}}
+  };
+}
+
+// Reading a request off of a socket, as workers do for blocking connections
+static void BM_ParseRequest(benchmark::State& state) {
+  std::pair<TCPSocket, TCPSocket> sockets = connectedPair();
+  const std::string               request = exampleRequest(state.range(0) != 0);
+  for (auto _ : state) {
+    sockets.second.send(request);
+    std::optional<HTTPRequest> parsed = HTTPWorker::parseRequest(sockets.first);
+    if (!parsed.has_value()) {
+      state.SkipWithError("Request was not parsed");
+      break;
+    }
+    benchmark::DoNotOptimize(parsed);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * request.size()));
+}
+BENCHMARK(BM_ParseRequest)->ArgName("post")->Arg(0)->Arg(1);
+
+// The parser alone, on a request which is already in memory
+static void BM_HTTPParser(benchmark::State& state) {
+  const std::string request = exampleRequest(state.range(0) != 0);
+  ByteBuffer        buffer;
+  for (auto _ : state) {
+    buffer.append(request);
+    HTTPParser parser(HTTPParser::REQUEST);
+    if (parser.parse(buffer) != HTTPParser::COMPLETE) {
+      state.SkipWithError("Request was not parsed");
+      break;
+    }
+    benchmark::DoNotOptimize(parser.request(buffer));
+    buffer.consume(parser.length());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * request.size()));
+}
+BENCHMARK(BM_HTTPParser)->ArgName("post")->Arg(0)->Arg(1);
+
+static void BM_ResponseFromJSON(benchmark::State& state) {
+  const nlohmann::json body = exampleBody();
+  for (auto _ : state) {
+    HTTPResponse response(200, "OK", body);
+    benchmark::DoNotOptimize(response);
+  }
+}
+BENCHMARK(BM_ResponseFromJSON);
+
+static void BM_ResponseToString(benchmark::State& state) {
+  const HTTPResponse response(200, "OK", exampleBody());
+  for (auto _ : state) { benchmark::DoNotOptimize(to_string(response)); }
+}
+BENCHMARK(BM_ResponseToString);
+
+// At a level the logs write, so the message is formatted and queued for the background thread
+static void BM_LogEnabled(benchmark::State& state) {
+  uint64_t count = 0;
+  for (auto _ : state) { LOG(INFO) << "Benchmark message " << ++count << " of many"; }
+}
+BENCHMARK(BM_LogEnabled);
+
+// Below every log's level, so nothing should be formatted at all
+static void BM_LogDisabled(benchmark::State& state) {
+  uint64_t count = 0;
+  for (auto _ : state) { LOG(DEBUG) << "Benchmark message " << ++count << " of many"; }
+  benchmark::DoNotOptimize(count);
+}
+BENCHMARK(BM_LogDisabled);
+
+// Lines of about the length of request lines and headers
+static std::string exampleText() {
+  std::string text;
+  for (int i = 0; i < 64; ++i) {    // NOLINT(*-magic-numbers)
+    text += "Partial-Query: how do i get to the union from the dcc " + std::to_string(i) + "\r\n";
+  }
+  return text;
+}
+
+// Over text which has already been read, the stream never touches its socket
+static void BM_SocketStreamNextWord(benchmark::State& state) {
+  const TCPSocket   unused;
+  const std::string text = exampleText();
+  for (auto _ : state) {
+    SocketStream stream(unused, text, true);
+    while (stream.hasNext()) { benchmark::DoNotOptimize(stream.nextWord()); }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK(BM_SocketStreamNextWord);
+
+static void BM_SocketStreamNextLine(benchmark::State& state) {
+  const TCPSocket   unused;
+  const std::string text = exampleText();
+  for (auto _ : state) {
+    SocketStream stream(unused, text, true);
+    while (stream.hasNext()) { benchmark::DoNotOptimize(stream.nextLine()); }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK(BM_SocketStreamNextLine);
+
+// Stamped on every log message
+static void BM_CurrentTime(benchmark::State& state) {
+  for (auto _ : state) { benchmark::DoNotOptimize(current_time()); }
+}
+BENCHMARK(BM_CurrentTime);
+
+int main(int argc, char* argv[]) {
+  // Logged the way the server logs, to a file at INFO through the background thread
+  Logger::addFile("log/microbench.log", INFO);
+  Logger::startAsync();
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) { return EXIT_FAILURE; }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  Logger::stopAsync();
+  return EXIT_SUCCESS;
+}
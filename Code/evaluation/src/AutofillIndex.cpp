@@ -0,0 +1,197 @@
+#include "AutofillIndex.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Util.h"
+
+struct AutofillIndex::Node {
+  std::string        label;    // Edge from the parent, only empty at the root
+  const std::string* query = nullptr;    // Set if a query ends here
+  uint64_t           count = 0;
+
+  std::vector<const Node*> children;    // Sorted by the first byte of their label
+  std::vector<Completion>  top;         // Best completions in this subtree, best first
+};
+
+// Retired nodes are only freed once this many have built up, so the reader slots aren't scanned
+// on every write
+static constexpr std::size_t RECLAIM_THRESHOLD = 256;
+
+// The child whose label starts with `c`, or where it would go
+template <typename Children>
+static auto findChild(Children& children, char c) {
+  return std::lower_bound(
+      children.begin(), children.end(), c,
+      [](const auto& node, char first) { return node->label.front() < first; });
+}
+
+static bool better(const std::string* lhs_query, uint64_t lhs_count, const std::string* rhs_query,
+                   uint64_t rhs_count) {
+  if (lhs_count != rhs_count) { return lhs_count > rhs_count; }
+  return *lhs_query < *rhs_query;
+}
+
+AutofillIndex::AutofillIndex() : m_root(new Node()) {}
+
+AutofillIndex::~AutofillIndex() {
+  // Every node is either retired or reachable from the root, never both
+  for (const Retired& retired : m_retired) { delete retired.node; }
+  std::vector<const Node*> stack = {m_root.load()};
+  while (!stack.empty()) {
+    const Node* node = stack.back();
+    stack.pop_back();
+    stack.insert(stack.end(), node->children.begin(), node->children.end());
+    delete node;
+  }
+}
+
+void AutofillIndex::add(std::string_view query, uint64_t count) {
+  std::string display = collapseWhitespace(query, true);
+  if (display.empty() || count == 0) { return; }
+  const std::string key = toLower(display);
+
+  const std::lock_guard<std::mutex> lock(m_write_mutex);
+
+  // Copy every node down the path the key takes, splitting the edge it leaves the trie on. The
+  // copies aren't visible to readers until the new root is published.
+  const Node*              old_root = m_root.load();
+  std::vector<const Node*> replaced = {old_root};
+  Node*                    root     = new Node(*old_root);
+  std::vector<Node*>       path     = {root};
+  Node*                    node     = root;
+  std::size_t              pos      = 0;
+  while (pos < key.size()) {
+    auto it = findChild(node->children, key[pos]);
+    if (it == node->children.end() || (*it)->label.front() != key[pos]) {
+      Node* leaf  = new Node();
+      leaf->label = key.substr(pos);
+      node->children.insert(it, leaf);
+      node = leaf;
+      path.push_back(node);
+      break;
+    }
+
+    const Node*        child  = *it;
+    const std::string& label  = child->label;
+    const std::size_t  max    = std::min(label.size(), key.size() - pos);
+    std::size_t        common = 0;
+    while (common < max && label[common] == key[pos + common]) { ++common; }
+    Node* copy = new Node(*child);
+    if (common < label.size()) {
+      copy->label.erase(0, common);
+      Node* middle     = new Node();
+      middle->label    = label.substr(0, common);
+      middle->top      = child->top;
+      middle->children = {copy};
+      copy             = middle;
+    }
+    replaced.push_back(child);
+    *it  = copy;
+    node = copy;
+    path.push_back(node);
+    pos += common;
+  }
+
+  if (node->query == nullptr) {
+    node->query = &m_queries.emplace_back(std::move(display));
+    m_size.fetch_add(1, std::memory_order_relaxed);
+  }
+  node->count += count;
+  for (Node* ancestor : path) { promote(ancestor->top, {node->query, node->count}); }
+
+  // Readers that announce an epoch after the bump are sure to load the new root
+  m_root.store(root);
+  const uint64_t epoch = m_epoch.fetch_add(1);
+  for (const Node* old : replaced) { m_retired.push_back({old, epoch}); }
+  if (m_retired.size() >= RECLAIM_THRESHOLD) { reclaim(); }
+}
+
+std::vector<std::string> AutofillIndex::suggest(std::string_view prefix, std::size_t limit) const {
+  const std::string key = toLower(collapseWhitespace(prefix, false));
+
+  const std::size_t slot = enter();
+  const Node*       node = m_root.load();
+  std::size_t       pos  = 0;
+  while (node != nullptr && pos < key.size()) {
+    auto it = findChild(node->children, key[pos]);
+    if (it == node->children.end() || (*it)->label.front() != key[pos]) {
+      node = nullptr;
+      break;
+    }
+    node = *it;
+    // The prefix may end partway along the edge, the child's completions are still the answer
+    const std::size_t length = std::min(node->label.size(), key.size() - pos);
+    if (node->label.compare(0, length, key, pos, length) != 0) { node = nullptr; }
+    pos += length;
+  }
+
+  std::vector<std::string> suggestions;
+  if (node != nullptr) {
+    const std::size_t count = std::min({limit, node->top.size(), MAX_SUGGESTIONS});
+    suggestions.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) { suggestions.push_back(*node->top[i].query); }
+  }
+  leave(slot);
+  return suggestions;
+}
+
+std::size_t AutofillIndex::enter() const {
+  // Threads keep going back to the same slot, so they rarely have to look for a free one
+  thread_local std::size_t hint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+  for (std::size_t i = hint;; ++i) {
+    std::atomic<uint64_t>& slot = m_readers[i % MAX_READERS].epoch;
+    uint64_t               free = 0;
+    if (slot.load(std::memory_order_relaxed) == 0 && slot.compare_exchange_strong(free, m_epoch)) {
+      hint = i % MAX_READERS;
+      return hint;
+    }
+    // Every slot is taken, give the readers holding them a chance to finish
+    if ((i + 1 - hint) % MAX_READERS == 0) { std::this_thread::yield(); }
+  }
+}
+
+void AutofillIndex::leave(std::size_t slot) const { m_readers[slot].epoch.store(0); }
+
+void AutofillIndex::reclaim() {
+  uint64_t oldest = m_epoch.load();
+  for (const ReaderSlot& reader : m_readers) {
+    const uint64_t epoch = reader.epoch.load();
+    if (epoch != 0) { oldest = std::min(oldest, epoch); }
+  }
+  // A node retired in epoch E is safe once every reader announced after E
+  auto safe = std::partition(m_retired.begin(), m_retired.end(),
+                             [&](const Retired& retired) { return retired.epoch >= oldest; });
+  for (auto it = safe; it != m_retired.end(); ++it) { delete it->node; }
+  m_retired.erase(safe, m_retired.end());
+}
+
+// Counts only ever go up, so a query can only join a node's top list when its own count changes,
+// which always passes through here
+void AutofillIndex::promote(std::vector<Completion>& top, Completion completion) {
+  auto it = std::find_if(top.begin(), top.end(), [&](const Completion& entry) {
+    return entry.query == completion.query;
+  });
+  if (it != top.end()) {
+    it->count = completion.count;
+  } else if (top.size() < MAX_SUGGESTIONS) {
+    it = top.insert(top.end(), completion);
+  } else if (better(completion.query, completion.count, top.back().query, top.back().count)) {
+    it  = top.end() - 1;
+    *it = completion;
+  } else {
+    return;
+  }
+  for (; it != top.begin() && better(it->query, it->count, (it - 1)->query, (it - 1)->count);
+       --it) {
+    std::iter_swap(it, it - 1);
+  }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Suggests completions for a partially typed query, from the queries that have been reported.
+// Queries are kept in a radix trie where every node caches the most frequent completions below
+// it, so a lookup only walks the prefix and never the subtree under it.
+//
+// Published nodes are never changed. A writer copies the path it updates and swaps in the new
+// root, so readers always see a complete snapshot without taking a lock. Replaced nodes are freed
+// once every reader that could have seen them has left (epoch based reclamation).
+//
+// Matching ignores case and repeated whitespace, suggestions are given as first reported.
+class AutofillIndex {
+ public:
+  // Completions cached by each node, so also the most that can be suggested at once
+  static constexpr std::size_t MAX_SUGGESTIONS = 10;
+  // Readers inside `suggest` at once, any past this wait (yielding) until one leaves
+  static constexpr std::size_t MAX_READERS = 64;
+
+  AutofillIndex();
+  ~AutofillIndex();
+
+  // DO NOT allow copy or move, readers may be holding on to the nodes
+  AutofillIndex(const AutofillIndex&)            = delete;
+  AutofillIndex& operator=(const AutofillIndex&) = delete;
+  AutofillIndex(AutofillIndex&&)                 = delete;
+  AutofillIndex& operator=(AutofillIndex&&)      = delete;
+
+  // Counts `count` more searches for `query`. Writers take turns, readers are never held up.
+  void add(std::string_view query, uint64_t count = 1);
+
+  // Up to `limit` completions of `prefix`, most frequent first
+  std::vector<std::string> suggest(std::string_view prefix, std::size_t limit) const;
+
+  // Number of distinct queries
+  std::size_t size() const { return m_size.load(std::memory_order_relaxed); }
+
+ private:
+  struct Completion {
+    const std::string* query;
+    uint64_t           count;
+  };
+  struct Node;
+  struct Retired {
+    const Node* node;
+    uint64_t    epoch;    // Readers announced at or before this may still see the node
+  };
+  // Padded so readers in different slots don't share a cache line
+  struct alignas(64) ReaderSlot {    // NOLINT(*-magic-numbers)
+    std::atomic<uint64_t> epoch = 0;    // 0 while free
+  };
+
+  // Claims a slot announcing the current epoch, it must be given back with `leave`
+  std::size_t enter() const;
+  void        leave(std::size_t slot) const;
+  // Frees the retired nodes no reader can still be looking at
+  void        reclaim();
+
+  static void promote(std::vector<Completion>& top, Completion completion);
+
+  std::atomic<const Node*>                    m_root;
+  std::atomic<uint64_t>                       m_epoch = 1;
+  mutable std::array<ReaderSlot, MAX_READERS> m_readers;
+  std::atomic<std::size_t>                    m_size = 0;
+
+  // Only touched by the writer holding `m_write_mutex`
+  std::mutex           m_write_mutex;
+  std::vector<Retired> m_retired;
+  // Queries as they will be suggested, a deque so the nodes' pointers survive growth
+  std::deque<std::string> m_queries;
+};
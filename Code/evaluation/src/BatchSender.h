@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "Logger.h"
+
+// Gathers updates into a pending batch, which a background thread sends once per window. Callers
+// never wait on the receiver, and a batch that fails to send is merged into the next one.
+// `Batch` must be default constructible, swappable, and have `empty()` and `size()`.
+template <class Batch> class BatchSender {
+ public:
+  // Returns false if the batch was not delivered and should be sent again
+  using Sender = std::function<bool(const Batch&)>;
+  // Folds a batch that failed to send into the one gathered meanwhile
+  using Merger = std::function<void(Batch& pending, Batch&& failed)>;
+
+  BatchSender(unsigned int window_ms, Sender sender, Merger merger);
+  ~BatchSender() { stop(); }
+
+  // DO NOT allow copy or move, the sending thread holds a pointer to this
+  BatchSender(const BatchSender&)            = delete;
+  BatchSender& operator=(const BatchSender&) = delete;
+  BatchSender(BatchSender&&)                 = delete;
+  BatchSender& operator=(BatchSender&&)      = delete;
+
+  void start();
+  // Makes a last attempt at sending whatever is pending, then joins the sending thread
+  void stop();
+
+  // Calls `add` on the pending batch (under the lock) and returns what it does. Returns false
+  // without calling it if the sender is not running.
+  template <class Add> bool update(Add&& add);
+
+ private:
+  void sendLoop();
+
+  unsigned int m_window_ms;
+  Sender       m_sender;
+  Merger       m_merger;
+
+  std::mutex              m_mutex;
+  std::condition_variable m_stop_cv;
+  Batch                   m_pending;
+  // Also set until the sender is started
+  bool                    m_stopping = true;
+
+  std::thread m_thread;
+};
+
+template <class Batch>
+BatchSender<Batch>::BatchSender(unsigned int window_ms, Sender sender, Merger merger)
+    : m_window_ms(window_ms)
+    , m_sender(std::move(sender))
+    , m_merger(std::move(merger)) {}
+
+template <class Batch> void BatchSender<Batch>::start() {
+  const std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_stopping) {
+    LOG(WARN) << "Batch sender is already running";
+    return;
+  }
+  m_stopping = false;
+  m_thread   = std::thread(&BatchSender::sendLoop, this);
+}
+
+template <class Batch> void BatchSender<Batch>::stop() {
+  {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_stop_cv.notify_all();
+  if (m_thread.joinable()) { m_thread.join(); }
+}
+
+template <class Batch> template <class Add> bool BatchSender<Batch>::update(Add&& add) {
+  const std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_stopping) { return false; }
+  return std::forward<Add>(add)(m_pending);
+}
+
+template <class Batch> void BatchSender<Batch>::sendLoop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  bool                         stopping = false;
+  while (!stopping) {
+    stopping = m_stop_cv.wait_for(lock, std::chrono::milliseconds(m_window_ms),
+                                  [this] { return m_stopping; });
+    if (m_pending.empty()) { continue; }
+
+    // Updates keep going into a fresh batch while this one is out
+    Batch batch;
+    std::swap(batch, m_pending);
+    lock.unlock();
+    const bool sent = m_sender(batch);
+    lock.lock();
+    if (!sent && stopping) {
+      LOG(ERROR) << "Dropping a batch of " << batch.size() << " unsent updates at shutdown";
+    } else if (!sent) {
+      m_merger(m_pending, std::move(batch));
+    }
+  }
+}
@@ -0,0 +1,44 @@
+#include "ByteBuffer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string_view>
+
+ByteBuffer::ByteBuffer(std::size_t capacity)
+    // NOLINTNEXTLINE(*-avoid-c-arrays): Want uninitialized storage
+    : m_data(std::make_unique_for_overwrite<char[]>(capacity))
+    , m_capacity(capacity) {}
+
+std::span<char> ByteBuffer::prepare(std::size_t min_size) {
+  if (m_capacity - m_end >= min_size) { return {m_data.get() + m_end, m_capacity - m_end}; }
+
+  const std::size_t unread = size();
+  if (m_capacity - unread >= min_size) {
+    // Enough room once consumed bytes are reclaimed
+    std::memmove(m_data.get(), data(), unread);
+  } else {
+    const std::size_t new_capacity = std::max(m_capacity * 2, unread + min_size);
+    // NOLINTNEXTLINE(*-avoid-c-arrays): Want uninitialized storage
+    auto new_data = std::make_unique_for_overwrite<char[]>(new_capacity);
+    std::memcpy(new_data.get(), data(), unread);
+    m_data     = std::move(new_data);
+    m_capacity = new_capacity;
+  }
+  m_start = 0;
+  m_end   = unread;
+  return {m_data.get() + m_end, m_capacity - m_end};
+}
+
+void ByteBuffer::append(std::string_view bytes) {
+  std::span<char> space = prepare(bytes.size());
+  std::ranges::copy(bytes, space.begin());
+  commit(bytes.size());
+}
+
+void ByteBuffer::consume(std::size_t n) {
+  m_start += std::min(n, size());
+  if (m_start == m_end) { clear(); }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string_view>
+
+// Contiguous byte buffer which is read from the front and written to the back. Consumed space is
+// reclaimed by sliding the unread bytes down, so a buffer can be reused for a whole connection
+// without reallocating once it has grown to fit the largest message.
+class ByteBuffer {
+ public:
+  static constexpr std::size_t DEFAULT_CAPACITY = 4096;
+
+  explicit ByteBuffer(std::size_t capacity = DEFAULT_CAPACITY);
+
+  ByteBuffer(ByteBuffer&&) noexcept            = default;
+  ByteBuffer& operator=(ByteBuffer&&) noexcept = default;
+
+  // DO NOT allow copies, they are never needed on purpose
+  ByteBuffer(const ByteBuffer&)            = delete;
+  ByteBuffer& operator=(const ByteBuffer&) = delete;
+
+  // Unread bytes. Pointers into these are invalidated by `prepare` and `consume`.
+  char*            data() { return m_data.get() + m_start; }
+  const char*      data() const { return m_data.get() + m_start; }
+  std::size_t      size() const { return m_end - m_start; }
+  bool             empty() const { return m_start == m_end; }
+  std::string_view view() const { return {data(), size()}; }
+
+  std::size_t capacity() const { return m_capacity; }
+
+  // Returns at least `min_size` bytes of writable space after the unread bytes
+  std::span<char> prepare(std::size_t min_size);
+  // Marks `n` bytes of the space from `prepare` as written
+  void commit(std::size_t n) { m_end += n; }
+
+  void append(std::string_view bytes);
+
+  // Drops `n` bytes from the front
+  void consume(std::size_t n);
+  void clear() { m_start = m_end = 0; }
+
+ private:
+  std::unique_ptr<char[]> m_data;    // NOLINT(*-avoid-c-arrays): Want uninitialized storage
+  std::size_t             m_capacity;
+  std::size_t             m_start = 0;
+  std::size_t             m_end   = 0;
+};
@@ -0,0 +1,128 @@
+#include "HTTPClient.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include "Logger.h"
+
+HTTPClient::HTTPClient(std::string host, uint16_t port, HTTPClientConfig config)
+    : m_host(std::move(host))
+    , m_port(port)
+    , m_config(config) {}
+
+HTTPClient::Result HTTPClient::send(HTTPRequest request) {
+  request.headers["Host"]      = m_host + ":" + std::to_string(m_port);
+  const std::string serialized = to_string(request);
+
+  Result       result;
+  unsigned int backoff_ms = m_config.initial_backoff_ms;
+  for (unsigned int attempt = 1;; ++attempt) {
+    result = sendOnce(serialized);
+    if (result.response.has_value() && result.response->code < 500) { return result; }
+    if (!result.response.has_value() && result.sent) {
+      LOG(ERROR) << "No response from " << m_host << ":" << m_port
+                 << " to a request it may have received, not retrying";
+      return result;
+    }
+    if (attempt >= m_config.max_attempts) { break; }
+    LOG(WARN) << "Request to " << m_host << ":" << m_port << " failed (attempt " << attempt
+              << "), retrying in " << backoff_ms << "ms";
+    std::this_thread::sleep_for(std::chrono::milliseconds(backoff_ms));
+    backoff_ms = std::min(backoff_ms * 2, m_config.max_backoff_ms);
+  }
+  LOG(ERROR) << "Giving up on request to " << m_host << ":" << m_port << " after "
+             << m_config.max_attempts << " attempts";
+  return result;
+}
+
+HTTPClient::Result HTTPClient::sendOnce(const std::string& request) {
+  std::optional<Connection> connection;
+  {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_idle.empty()) {
+      connection = std::move(m_idle.back());
+      m_idle.pop_back();
+    }
+  }
+  const bool pooled = connection.has_value();
+  if (!pooled) { connection = connect(); }
+  if (!connection.has_value()) { return {}; }
+
+  auto exchange = [&]() -> Result {
+    // A request is only handled once all of it arrives, so a failed send is safe to repeat
+    if (!connection->socket.send(std::string_view(request))) { return {}; }
+    return {.response = HTTPWorker::parseResponse(connection->socket, connection->buffer),
+            .sent     = true};
+  };
+  Result result = exchange();
+  // Closed by the host while it sat in the pool, before any of a response came back. Anything
+  // else (a timeout in particular) means the host may be working on the request.
+  const bool stale = pooled && !result.response.has_value()
+                  && (!result.sent
+                      || (connection->buffer.size() == 0 && connection->socket.peerClosed()));
+  if (stale) {
+    LOG(DEBUG) << "Pooled connection to " << m_host << " went stale, reconnecting";
+    connection = connect();
+    if (!connection.has_value()) { return {}; }
+    result = exchange();
+  }
+  if (!result.response.has_value()) { return result; }
+  const HTTPResponse& response = result.response.value();
+
+  // Anything left in the buffer would be mistaken for the next response
+  const auto close_header = response.headers.find("connection");
+  const bool keep_alive =
+      response.version == "HTTP/1.1" && connection->buffer.size() == 0
+      && (close_header == response.headers.end() || close_header->second != "close");
+  if (keep_alive) {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_idle.size() < m_config.max_idle) { m_idle.push_back(std::move(connection.value())); }
+  }
+  return result;
+}
+
+std::optional<HTTPClient::Connection> HTTPClient::connect() {
+  const std::optional<std::string> ip = resolve();
+  if (!ip.has_value()) { return std::nullopt; }
+
+  Connection connection{.socket = TCPSocket(), .buffer = ByteBuffer()};
+  if (!connection.socket.create()
+      || !connection.socket.setTimeout<SO_SNDTIMEO>(m_config.timeout_ms)
+      || !connection.socket.setTimeout<SO_RCVTIMEO>(m_config.timeout_ms)
+      || !connection.socket.connect(ip->c_str(), m_port)) {
+    LOG(WARN) << "Unable to connect to " << m_host << " (" << *ip << ":" << m_port << ")";
+    // The host may have moved, look it up again next time
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    m_ip.clear();
+    return std::nullopt;
+  }
+  return connection;
+}
+
+std::optional<std::string> HTTPClient::resolve() {
+  const auto now = std::chrono::steady_clock::now();
+  {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_ip.empty() && now - m_resolved_at < std::chrono::milliseconds(m_config.dns_ttl_ms)) {
+      return m_ip;
+    }
+  }
+
+  // Looked up without the lock, so pooled connections can still be handed out meanwhile. The
+  // address comes back padded with NULs.
+  const std::string ip(TCPSocket::getIP(m_host, m_port).c_str());
+  if (ip.empty()) {
+    LOG(ERROR) << "Unable to look up " << m_host;
+    return std::nullopt;
+  }
+  const std::lock_guard<std::mutex> lock(m_mutex);
+  m_ip          = ip;
+  m_resolved_at = now;
+  return m_ip;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "ByteBuffer.h"
+#include "HTTPServer.h"
+#include "TCPSocket.h"
+
+struct HTTPClientConfig {
+  // Applies to connecting, sending, and waiting on each response
+  unsigned int timeout_ms = 2000;
+  // Attempts made per request, each failure waits twice as long as the last (up to the max)
+  unsigned int max_attempts       = 4;
+  unsigned int initial_backoff_ms = 100;
+  unsigned int max_backoff_ms     = 2000;
+  // How long a looked up address is used before looking it up again
+  unsigned int dns_ttl_ms = 60 * 1000;
+  // Kept-alive connections held on to between requests
+  std::size_t max_idle = 4;
+};
+
+// Sends requests to a single host over a pool of kept-alive connections. The address is looked
+// up once and cached, so most requests go straight out on a connection that is already open.
+// Safe to share between threads, each request has a connection to itself.
+class HTTPClient {
+ public:
+  HTTPClient(std::string host, uint16_t port, HTTPClientConfig config = {});
+
+  // DO NOT allow copy or move, the pool is shared by every sender
+  HTTPClient(const HTTPClient&)            = delete;
+  HTTPClient& operator=(const HTTPClient&) = delete;
+  HTTPClient(HTTPClient&&)                 = delete;
+  HTTPClient& operator=(HTTPClient&&)      = delete;
+
+  struct Result {
+    // The last response, or nullopt if none ever came
+    std::optional<HTTPResponse> response;
+    // All of the request went out, so the host may have handled it even without a response
+    bool                        sent = false;
+
+    // Whether the request is done with: the host accepted it, or may have acted on it without
+    // answering, in which case sending it again could apply it twice
+    bool delivered() const {
+      return response.has_value() ? response->code / 100 == 2 : sent;
+    }
+  };
+
+  // Sends `request` (filling in the Host header), retrying with back-off while the host can't be
+  // reached or answers with a 5xx. A request which went out in full but got no response is not
+  // sent again, the host may have acted on it already.
+  Result send(HTTPRequest request);
+
+  const std::string& host() const { return m_host; }
+  uint16_t           port() const { return m_port; }
+
+ private:
+  struct Connection {
+    TCPSocket  socket;
+    ByteBuffer buffer;    // Kept with the socket, a response could arrive in pieces
+  };
+
+  // A single attempt. A pooled connection the host has since closed doesn't count as a failure,
+  // the request is tried again on a new one.
+  Result                      sendOnce(const std::string& request);
+  std::optional<Connection>   connect();
+  // The host's address, from the cache while it is fresh
+  std::optional<std::string>  resolve();
+
+  std::string      m_host;
+  uint16_t         m_port;
+  HTTPClientConfig m_config;
+
+  std::mutex                            m_mutex;
+  std::vector<Connection>               m_idle;
+  std::string                           m_ip;
+  std::chrono::steady_clock::time_point m_resolved_at;
+};
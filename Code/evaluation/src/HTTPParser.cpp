@@ -0,0 +1,315 @@
+#include "HTTPParser.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <system_error>
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+#include "ByteBuffer.h"
+#include "Logger.h"
+
+static constexpr std::array<std::string_view, 9> KNOWN_METHODS = {
+    "GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"};
+
+// Index of the first `c` at or after `pos`, or npos. Compares 16 bytes at a time when SSE2 is
+// available, which is where most of the time goes for long header lines and bodies.
+static std::size_t findByte(std::string_view str, std::size_t pos, char c) {
+#ifdef __SSE2__
+  const __m128i needle = _mm_set1_epi8(c);
+  for (; pos + sizeof(__m128i) <= str.size(); pos += sizeof(__m128i)) {
+    // NOLINTNEXTLINE(*-reinterpret-cast): Unaligned load is what the intrinsic is for
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + pos));
+    const int     mask  = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+    if (mask != 0) { return pos + std::countr_zero(static_cast<unsigned int>(mask)); }
+  }
+#endif
+  for (; pos < str.size(); ++pos) {
+    if (str[pos] == c) { return pos; }
+  }
+  return std::string_view::npos;
+}
+
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+  return std::ranges::equal(a, b,
+                            [](char x, char y) { return std::tolower(x) == std::tolower(y); });
+}
+
+static std::string_view trim(std::string_view str) {
+  while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) { str.remove_prefix(1); }
+  while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) { str.remove_suffix(1); }
+  return str;
+}
+
+// Parses a whole string of digits in the given base
+static std::optional<std::size_t> parseNumber(std::string_view str, int base) {
+  std::size_t value = 0;
+  const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value, base);
+  if (str.empty() || ec != std::errc() || ptr != str.data() + str.size()) { return std::nullopt; }
+  return value;
+}
+
+bool HTTPHeaderList::push_back(HTTPHeader header) {
+  if (m_size == MAX_HEADERS) { return false; }
+  m_headers.at(m_size++) = header;
+  return true;
+}
+
+std::optional<std::string_view> HTTPHeaderList::get(std::string_view name) const {
+  for (const HTTPHeader& header : *this) {
+    if (equalsIgnoreCase(header.name, name)) { return header.value; }
+  }
+  return std::nullopt;
+}
+
+HTTPParser::Result HTTPParser::parse(ByteBuffer& buffer) {
+  while (true) {
+    const std::string_view data = buffer.view();
+    switch (m_state) {
+      case START_LINE: {
+        const std::optional<std::string_view> line = nextLine(data);
+        if (!line.has_value()) {
+          // The method is the first thing to arrive, so junk can be turned away right away
+          if (m_type == REQUEST) {
+            const std::string_view method = data.substr(0, data.find(' '));
+            const bool             prefix = method.size() == data.size();
+            if (!std::ranges::any_of(KNOWN_METHODS, [&](std::string_view known) {
+                  return prefix ? known.starts_with(method) : known == method;
+                })) {
+              return fail(BAD_START_LINE);
+            }
+          }
+          return data.size() > MAX_HEADER_SIZE ? fail(HEADERS_TOO_LARGE) : INCOMPLETE;
+        }
+        if (!parseStartLine(data, line.value())) { return fail(BAD_START_LINE); }
+        m_state = HEADERS;
+        break;
+      }
+      case HEADERS: {
+        const std::optional<std::string_view> line = nextLine(data);
+        if (!line.has_value() || m_pos > MAX_HEADER_SIZE) {
+          return data.size() > MAX_HEADER_SIZE ? fail(HEADERS_TOO_LARGE) : INCOMPLETE;
+        }
+        if (line->empty()) {
+          m_body_start = m_pos;
+          if (!startBody()) { return ERROR; }
+          break;
+        }
+        const Error error = parseHeader(data, line.value());
+        if (error != NONE) { return fail(error); }
+        break;
+      }
+      case BODY: {
+        m_body_length = std::min(data.size() - m_body_start, m_remaining);
+        if (m_body_length < m_remaining) { return INCOMPLETE; }
+        m_pos   = m_body_start + m_body_length;
+        m_state = DONE;
+        break;
+      }
+      case CHUNK_SIZE: {
+        const std::optional<std::string_view> line = nextLine(data);
+        if (!line.has_value()) {
+          return data.size() - m_pos > MAX_HEADER_SIZE ? fail(BAD_CHUNK) : INCOMPLETE;
+        }
+        // Chunk extensions are allowed, but not used
+        const std::optional<std::size_t> size =
+            parseNumber(trim(line->substr(0, line->find(';'))), 16);
+        if (!size.has_value()) { return fail(BAD_CHUNK); }
+        if (size.value() > MAX_BODY_SIZE - m_body_length) { return fail(BODY_TOO_LARGE); }
+        m_remaining = size.value();
+        m_state     = m_remaining == 0 ? TRAILERS : CHUNK_DATA;
+        break;
+      }
+      case CHUNK_DATA: {
+        // Slide the data down against the rest of the body, so it ends up in one piece
+        const std::size_t n = std::min(data.size() - m_pos, m_remaining);
+        std::memmove(buffer.data() + m_body_start + m_body_length, buffer.data() + m_pos, n);
+        m_body_length += n;
+        m_pos         += n;
+        m_remaining   -= n;
+        if (m_remaining > 0) { return INCOMPLETE; }
+        m_state = CHUNK_DATA_END;
+        break;
+      }
+      case CHUNK_DATA_END: {
+        // Chunk data is followed by CRLF
+        const std::optional<std::string_view> line = nextLine(data);
+        if (!line.has_value()) { return data.size() - m_pos > 1 ? fail(BAD_CHUNK) : INCOMPLETE; }
+        if (!line->empty()) { return fail(BAD_CHUNK); }
+        m_state = CHUNK_SIZE;
+        break;
+      }
+      case TRAILERS: {
+        // Trailers are not used, the section is ended by an empty line
+        const std::optional<std::string_view> line = nextLine(data);
+        if (!line.has_value()) {
+          return data.size() - m_pos > MAX_HEADER_SIZE ? fail(HEADERS_TOO_LARGE) : INCOMPLETE;
+        }
+        if (line->empty()) { m_state = DONE; }
+        break;
+      }
+      case UNTIL_CLOSE: m_body_length = data.size() - m_body_start; return INCOMPLETE;
+      case DONE:        return COMPLETE;
+      case FAILED:      return ERROR;
+    }
+  }
+}
+
+HTTPParser::Result HTTPParser::finish(ByteBuffer& buffer) {
+  const Result result = parse(buffer);
+  if (m_state != UNTIL_CLOSE) { return result; }
+  m_body_length = buffer.size() - m_body_start;
+  m_pos         = buffer.size();
+  m_state       = DONE;
+  return COMPLETE;
+}
+
+HTTPRequestView HTTPParser::request(const ByteBuffer& buffer) const {
+  const std::string_view data = buffer.view();
+  const auto view = [&](const Span& span) { return data.substr(span.first, span.second); };
+
+  HTTPRequestView request;
+  request.method  = view(m_start_line[0]);
+  request.target  = view(m_start_line[1]);
+  request.version = view(m_start_line[2]);
+  for (const auto& [name, value] : std::span(m_headers.data(), m_num_headers)) {
+    request.headers.push_back({view(name), view(value)});
+  }
+  request.body = data.substr(m_body_start, m_body_length);
+  return request;
+}
+
+HTTPResponseView HTTPParser::response(const ByteBuffer& buffer) const {
+  const std::string_view data = buffer.view();
+  const auto view = [&](const Span& span) { return data.substr(span.first, span.second); };
+
+  HTTPResponseView response;
+  response.version = view(m_start_line[0]);
+  response.code    = m_code;
+  response.status  = view(m_start_line[2]);
+  for (const auto& [name, value] : std::span(m_headers.data(), m_num_headers)) {
+    response.headers.push_back({view(name), view(value)});
+  }
+  response.body = data.substr(m_body_start, m_body_length);
+  return response;
+}
+
+std::optional<std::string_view> HTTPParser::nextLine(std::string_view buffer) {
+  const std::size_t end = findByte(buffer, m_pos + m_scan, '\n');
+  if (end == std::string_view::npos) {
+    m_scan = buffer.size() - m_pos;
+    return std::nullopt;
+  }
+  std::string_view line = buffer.substr(m_pos, end - m_pos);
+  if (!line.empty() && line.back() == '\r') { line.remove_suffix(1); }
+  m_pos  = end + 1;
+  m_scan = 0;
+  return line;
+}
+
+bool HTTPParser::parseStartLine(std::string_view buffer, std::string_view line) {
+  const auto span = [&](std::string_view part) {
+    return Span(part.data() - buffer.data(), part.size());
+  };
+  line = trim(line);
+
+  // Both start lines are three parts separated by single spaces, only the reason phrase may
+  // contain spaces itself (or be empty)
+  const std::size_t first = findByte(line, 0, ' ');
+  if (first == std::string_view::npos) { return false; }
+  const std::size_t second = findByte(line, first + 1, ' ');
+  if (second == std::string_view::npos && m_type == REQUEST) { return false; }
+  const std::string_view a = line.substr(0, first);
+  const std::string_view b = line.substr(first + 1, second - first - 1);
+  const std::string_view c =
+      second == std::string_view::npos ? line.substr(line.size()) : line.substr(second + 1);
+
+  if (m_type == REQUEST) {
+    if (std::ranges::find(KNOWN_METHODS, a) == KNOWN_METHODS.end()) {
+      LOG(WARN) << "Unrecognized HTTP method: " << a;
+      return false;
+    }
+    if (b.empty() || !c.starts_with("HTTP/") || c.find(' ') != std::string_view::npos) {
+      return false;
+    }
+  } else {
+    const std::optional<std::size_t> code = parseNumber(b, 10);
+    if (!a.starts_with("HTTP/") || b.size() != 3 || !code.has_value()) { return false; }
+    m_code = code.value();
+  }
+  m_start_line = {span(a), span(b), span(c)};
+  LOG(TRACE) << "START LINE: " << a << " " << b << " " << c;
+  return true;
+}
+
+HTTPParser::Error HTTPParser::parseHeader(std::string_view buffer, std::string_view line) {
+  const std::size_t delim_pos = findByte(line, 0, ':');
+  if (delim_pos == std::string_view::npos) { return BAD_HEADER; }
+  const std::string_view name  = line.substr(0, delim_pos);
+  const std::string_view value = trim(line.substr(delim_pos + 1));
+  if (name.empty() || name.find_first_of(" \t") != std::string_view::npos) { return BAD_HEADER; }
+  if (m_num_headers == m_headers.size()) { return TOO_MANY_HEADERS; }
+
+  m_headers.at(m_num_headers++) = {Span(name.data() - buffer.data(), name.size()),
+                                   Span(value.data() - buffer.data(), value.size())};
+  LOG(TRACE) << "HEADER: " << name << " - VALUE: " << value;
+
+  if (equalsIgnoreCase(name, "content-length")) {
+    const std::optional<std::size_t> length = parseNumber(value, 10);
+    if (!length.has_value()
+        || (m_content_length.has_value() && m_content_length.value() != length.value())) {
+      m_header_error = BAD_CONTENT_LENGTH;
+    } else if (length.value() > MAX_BODY_SIZE) {
+      m_header_error = BODY_TOO_LARGE;
+    }
+    m_content_length = length;
+  } else if (equalsIgnoreCase(name, "transfer-encoding")) {
+    // Chunked is always the last coding applied
+    constexpr std::string_view CHUNKED = "chunked";
+    m_transfer_encoding = true;
+    m_chunked           = value.size() >= CHUNKED.size()
+              && equalsIgnoreCase(value.substr(value.size() - CHUNKED.size()), CHUNKED);
+  }
+  return NONE;
+}
+
+bool HTTPParser::startBody() {
+  if (m_header_error != NONE) {
+    fail(m_header_error);
+    return false;
+  }
+  if (m_type == RESPONSE && (m_code / 100 == 1 || m_code == 204 || m_code == 304)) {
+    m_state = DONE;
+  } else if (m_transfer_encoding) {
+    // Requests must be chunked to have a known length, and can't also claim a Content-Length
+    if (m_type == REQUEST && (!m_chunked || m_content_length.has_value())) {
+      fail(BAD_HEADER);
+      return false;
+    }
+    m_state = m_chunked ? CHUNK_SIZE : UNTIL_CLOSE;
+  } else if (m_content_length.has_value()) {
+    m_remaining = m_content_length.value();
+    m_state     = BODY;
+  } else {
+    // Requests without a length have no body, responses run until the connection closes
+    m_state = m_type == REQUEST ? DONE : UNTIL_CLOSE;
+  }
+  return true;
+}
+
+HTTPParser::Result HTTPParser::fail(Error error) {
+  LOG(WARN) << "Failed to parse HTTP message (error " << error << ")";
+  m_state = FAILED;
+  m_error = error;
+  return ERROR;
+}
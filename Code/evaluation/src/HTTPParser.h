@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "ByteBuffer.h"
+
+struct HTTPHeader {
+  std::string_view name;
+  std::string_view value;
+};
+
+// Headers in the order they arrived. Stored inline so parsing a request never allocates.
+class HTTPHeaderList {
+ public:
+  static constexpr std::size_t MAX_HEADERS = 32;
+
+  // Returns false if the list is already full
+  bool push_back(HTTPHeader header);
+
+  // Value of the first header with this name (compared case-insensitively)
+  std::optional<std::string_view> get(std::string_view name) const;
+  bool contains(std::string_view name) const { return get(name).has_value(); }
+
+  const HTTPHeader* begin() const { return m_headers.data(); }
+  const HTTPHeader* end() const { return m_headers.data() + m_size; }
+  std::size_t       size() const { return m_size; }
+  bool              empty() const { return m_size == 0; }
+
+ private:
+  std::array<HTTPHeader, MAX_HEADERS> m_headers{};
+  std::size_t                         m_size = 0;
+};
+
+// Everything in these views points into the buffer the message was parsed from, so they are only
+// valid until that buffer is changed
+struct HTTPRequestView {
+  std::string_view method;
+  std::string_view target;
+  std::string_view version;
+  HTTPHeaderList   headers;
+  std::string_view body;
+};
+
+struct HTTPResponseView {
+  std::string_view version;
+  unsigned int     code = 0;
+  std::string_view status;
+  HTTPHeaderList   headers;
+  std::string_view body;
+};
+
+// Incremental parser for a single HTTP/1.x message at the front of a buffer. Call `parse` each
+// time more bytes arrive, it picks up where it left off. Once complete, `length` bytes belong to
+// the message, and `reset` readies the parser for the next one (after they are consumed).
+class HTTPParser {
+ public:
+  enum Type { REQUEST, RESPONSE };
+  enum Result { INCOMPLETE, COMPLETE, ERROR };
+  enum Error {
+    NONE,
+    BAD_START_LINE,
+    BAD_HEADER,
+    TOO_MANY_HEADERS,
+    HEADERS_TOO_LARGE,
+    BAD_CONTENT_LENGTH,
+    BODY_TOO_LARGE,
+    BAD_CHUNK,
+  };
+
+  static constexpr std::size_t MAX_HEADER_SIZE = 64 * 1024;
+  static constexpr std::size_t MAX_BODY_SIZE   = 64 * 1024 * 1024;
+
+  explicit HTTPParser(Type type = REQUEST)
+      : m_type(type) {}
+
+  // Between calls, bytes may only be appended to the buffer. Chunked bodies are decoded in place,
+  // which rewrites the part of the buffer the message has taken up.
+  Result parse(ByteBuffer& buffer);
+  // Called once the peer stops sending. Completes responses whose body runs until the close.
+  Result finish(ByteBuffer& buffer);
+
+  // Available once the headers are complete (even if the body is not)
+  HTTPRequestView  request(const ByteBuffer& buffer) const;
+  HTTPResponseView response(const ByteBuffer& buffer) const;
+
+  bool        headersComplete() const { return m_body_start != 0; }
+  Error       error() const { return m_error; }
+  // Bytes taken up by the message, including framing
+  std::size_t length() const { return m_pos; }
+  // Body bytes received so far (after chunked decoding)
+  std::size_t bodyReceived() const { return m_body_length; }
+
+  void reset() { *this = HTTPParser(m_type); }
+
+ private:
+  enum State {
+    START_LINE,
+    HEADERS,
+    BODY,
+    CHUNK_SIZE,
+    CHUNK_DATA,
+    CHUNK_DATA_END,
+    TRAILERS,
+    UNTIL_CLOSE,
+    DONE,
+    FAILED,
+  };
+
+  // Offset and length into the buffer, views are only made once the caller asks for them
+  using Span = std::pair<std::size_t, std::size_t>;
+
+  // Finds the next line starting at `m_pos`, without its line ending
+  std::optional<std::string_view> nextLine(std::string_view buffer);
+
+  bool   parseStartLine(std::string_view buffer, std::string_view line);
+  Error  parseHeader(std::string_view buffer, std::string_view line);
+  // Decides how the body is framed once the empty line after the headers is found
+  bool   startBody();
+  Result fail(Error error);
+
+  Type  m_type;
+  State m_state = START_LINE;
+  Error m_error = NONE;
+
+  std::size_t m_pos  = 0;    // Start of the first byte not parsed yet
+  std::size_t m_scan = 0;    // Bytes after `m_pos` already known to not end a line
+
+  std::array<Span, 3>                                            m_start_line{};
+  unsigned int                                                   m_code = 0;
+  std::array<std::pair<Span, Span>, HTTPHeaderList::MAX_HEADERS> m_headers{};
+  std::size_t                                                    m_num_headers = 0;
+
+  // Framing headers. Problems with them are only reported once all of the headers are in.
+  std::optional<std::size_t> m_content_length;
+  bool                       m_transfer_encoding = false;
+  bool                       m_chunked           = false;
+  Error                      m_header_error      = NONE;
+
+  std::size_t m_body_start  = 0;
+  std::size_t m_body_length = 0;
+  std::size_t m_remaining   = 0;    // Bytes left in the body or current chunk
+};
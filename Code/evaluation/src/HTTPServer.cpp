@@ -1,25 +1,92 @@
 #include "HTTPServer.h"
 
 #include <asm-generic/socket.h>
-#include <poll.h>
-#include <sys/poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <array>
 #include <cctype>
 #include <cerrno>
+#include <charconv>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <exception>
+#include <functional>
+#include <limits>
 #include <nlohmann/json.hpp>
 #include <optional>
+#include <span>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <utility>
+#include <vector>
 
+#include "ByteBuffer.h"
+#include "HTTPParser.h"
+#include "LinkAnalysisForwarder.h"
 #include "Logger.h"
+#include "MetricsStore.h"
+#include "QuantileSketch.h"
+#include "QueryIDAllocator.h"
+#include "RankingFeed.h"
+#include "RequestBodies.h"
+#include "SearchHistoryStore.h"
+#include "ServerStats.h"
 #include "TCPSocket.h"
 #include "Util.h"
+#include "WorkerPool.h"
+
+// Rejected clients should not be able to hold up the accept loop
+static constexpr unsigned int REJECT_SEND_TIMEOUT_MS = 100;
+
+static constexpr std::size_t MAX_EPOLL_EVENTS = 64;
+// Most read from one client per wakeup, so a client sending nonstop can't hold up the reactor.
+// Epoll is level-triggered, anything left over wakes it up again.
+static constexpr std::size_t READ_BUDGET = 64 * 1024;
+
+static constexpr unsigned int MIN_SWEEP_INTERVAL_MS = 10;
+static constexpr unsigned int MAX_SWEEP_INTERVAL_MS = 1000;
+
+// Only used for workers reading straight off of a blocking socket
+static constexpr unsigned int REQUEST_TIMEOUT_MS = 5000;
+
+static uint64_t elapsedNs(std::chrono::steady_clock::time_point from,
+                          std::chrono::steady_clock::time_point to) {
+  const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+  return static_cast<uint64_t>(std::max<int64_t>(0, ns));
+}
+
+// `lower` must already be lowercase
+static bool equalsLower(std::string_view str, std::string_view lower) {
+  return std::ranges::equal(str, lower, [](char a, char b) { return std::tolower(a) == b; });
+}
+
+// Leaves `value` alone if the header is missing
+static bool parseTimeHeader(const HTTPRequestView& request, std::string_view name,
+                            int64_t& value) {
+  const std::optional<std::string_view> header = request.headers.get(name);
+  return !header.has_value()
+      || std::from_chars(header->data(), header->data() + header->size(), value).ec == std::errc();
+}
+
+// The indent asked for by an `indent=<n>` parameter of the Accept header, if there is one
+static std::optional<int> acceptIndent(const HTTPRequestView& request) {
+  const std::string_view accept    = request.headers.get("accept").value_or("");
+  const std::size_t      parameter = accept.find("indent=");
+  if (parameter == std::string_view::npos) { return std::nullopt; }
+  const std::string_view value = accept.substr(parameter + std::string_view("indent=").size());
+  int                    indent = 0;
+  if (std::from_chars(value.data(), value.data() + value.size(), indent).ec != std::errc()) {
+    return std::nullopt;
+  }
+  return std::clamp(indent, 0, HTTPWorker::MAX_JSON_INDENT);
+}
 
 HTTPRequest::HTTPRequest(Method method_, std::string_view resource_, const nlohmann::json& body_)
     : method(method_)
@@ -37,6 +104,16 @@ HTTPRequest::HTTPRequest(Method method_, std::string_view resource_)
     , resource(resource_)
     , version("HTTP/1.1") {}
 
+HTTPRequest::HTTPRequest(const HTTPRequestView& view)
+    : method(stringToMethod(view.method))
+    , resource(view.target)
+    , version(view.version)
+    , body(view.body) {
+  for (const HTTPHeader& header : view.headers) {
+    headers[toLower(header.name)] = header.value;
+  }
+}
+
 std::string to_string(const HTTPRequest& request) {
   std::ostringstream ss;
   ss << HTTPRequest::methodToString(request.method) << " " << request.resource << " "
@@ -49,20 +126,33 @@ std::string to_string(const HTTPRequest& request) {
 HTTPResponse::HTTPResponse(unsigned int code_, std::string_view status_)
     : version("HTTP/1.1")
     , code(code_)
-    , status(status_) {}
+    , status(status_)
+    , headers({
+          {"Content-Length", "0"}
+}) {}
 
 HTTPResponse::HTTPResponse(unsigned int code_, std::string_view status_,
-                           const nlohmann::json& body_)
+                           const nlohmann::json& body_, int indent)
     : version("HTTP/1.1")
     , code(code_)
     , status(status_) {
-  body    = body_.dump(2);
+  body    = body_.dump(indent);
   headers = {
       {  "Content-Type",            "application/json"},
       {"Content-Length", std::to_string(body.length())}
   };
 }
 
+HTTPResponse::HTTPResponse(const HTTPResponseView& view)
+    : version(view.version)
+    , code(view.code)
+    , status(view.status)
+    , body(view.body) {
+  for (const HTTPHeader& header : view.headers) {
+    headers[toLower(header.name)] = header.value;
+  }
+}
+
 HTTPResponse HTTPResponse::makeErrorResponse(unsigned int code_, std::string_view status_,
                                              std::string_view msg) {
   const nlohmann::json resp_body = {
@@ -72,12 +162,166 @@ HTTPResponse HTTPResponse::makeErrorResponse(unsigned int code_, std::string_vie
   return {code_, status_, resp_body};
 }
 
+// Errors with nothing request specific in them, serialized once at startup rather than on every
+// response
+static const HTTPResponse PARSE_ERROR =
+    HTTPResponse::makeErrorResponse(400, "Bad Request", "Error parsing request.");
+static const HTTPResponse BODY_TOO_LARGE =
+    HTTPResponse::makeErrorResponse(413, "Content Too Large", "Request body is too large.");
+static const HTTPResponse HEADERS_TOO_LARGE = HTTPResponse::makeErrorResponse(
+    431, "Request Header Fields Too Large", "Request headers are too large.");
+static const HTTPResponse VERSION_NOT_SUPPORTED =
+    HTTPResponse::makeErrorResponse(505, "HTTP Version Not Supported", "HTTP/1.1 Must be Used.");
+static const HTTPResponse LENGTH_REQUIRED = HTTPResponse::makeErrorResponse(
+    411, "Length Required", "Content-Length header must be specified when sending a request body");
+static const HTTPResponse NOT_FOUND =
+    HTTPResponse::makeErrorResponse(404, "Not Found", "Resource (API function) not found");
+static const HTTPResponse BAD_BODY =
+    HTTPResponse::makeErrorResponse(400, "Bad Request", "Improper format of request body.");
+static const HTTPResponse BAD_CONTENT_TYPE = HTTPResponse::makeErrorResponse(
+    400, "Bad Request", "Missing / Incorrect `Content-Type` header (expected `application/json`)");
+static const HTTPResponse MISSING_PARTIAL_QUERY =
+    HTTPResponse::makeErrorResponse(400, "Bad Request", "Missing `Partial-Query` header");
+static const HTTPResponse BAD_NUM_SUGGESTIONS =
+    HTTPResponse::makeErrorResponse(400, "Bad Request", "Invalid `Num-Suggestions` header");
+static const HTTPResponse BAD_QUERY_ID =
+    HTTPResponse::makeErrorResponse(400, "Bad Request", "Missing / Invalid `Query-ID` header");
+static const HTTPResponse BAD_AFTER_ID =
+    HTTPResponse::makeErrorResponse(400, "Bad Request", "Invalid `After-ID` header");
+static const HTTPResponse MISSING_COMPONENT =
+    HTTPResponse::makeErrorResponse(400, "Bad Request", "Missing `Component` header");
+static const HTTPResponse MISSING_METRIC =
+    HTTPResponse::makeErrorResponse(400, "Bad Request", "Missing `Component` / `Label` header");
+static const HTTPResponse BAD_RESOLUTION = HTTPResponse::makeErrorResponse(
+    400, "Bad Request", "Invalid `Resolution` header (expected minute / hour)");
+static const HTTPResponse BAD_TIME_RANGE =
+    HTTPResponse::makeErrorResponse(400, "Bad Request", "Invalid `From` / `To` header");
+static const HTTPResponse BAD_QUANTILES = HTTPResponse::makeErrorResponse(
+    400, "Bad Request", "Invalid `Quantiles` header (expected numbers from 0 to 1)");
+static const HTTPResponse CHUNKED_BODY_INCOMPLETE =
+    HTTPResponse::makeErrorResponse(400, "Bad Request", "Chunked body ended before its last chunk");
+static const HTTPResponse NO_QUERY_ID = HTTPResponse::makeErrorResponse(
+    503, "Service Unavailable", "Unable to reserve a query ID, try again later");
+static const HTTPResponse NO_SEARCH_STORAGE = HTTPResponse::makeErrorResponse(
+    503, "Service Unavailable", "Unable to store search results, try again later");
+static const HTTPResponse NO_SEARCH_HISTORY =
+    HTTPResponse::makeErrorResponse(503, "Service Unavailable", "Search history is not available");
+static const HTTPResponse NO_METRICS =
+    HTTPResponse::makeErrorResponse(503, "Service Unavailable", "Metrics are not available");
+static const HTTPResponse METRICS_FULL = HTTPResponse::makeErrorResponse(
+    507, "Insufficient Storage", "Too many metric series, or a value too large to keep");
+static const HTTPResponse NO_SERVER_STATS =
+    HTTPResponse::makeErrorResponse(503, "Service Unavailable", "Server stats are not being kept");
+static const HTTPResponse NO_PROMETHEUS =
+    HTTPResponse::makeErrorResponse(503, "Service Unavailable", "Metrics are not being exported");
+// Rejected before a worker ever sees the connection, so the close is announced here
+static const HTTPResponse OVERLOADED = [] {
+  HTTPResponse response = HTTPResponse::makeErrorResponse(503, "Service Unavailable",
+                                                          "Server is overloaded, try again later");
+  response.headers["Connection"] = "close";
+  return response;
+}();
+
+// Status lines and header lines that go out on almost every response, so they are never built
+struct CachedStatusLine {
+  unsigned int     code;
+  std::string_view status;
+  std::string_view line;
+};
+static constexpr std::array<CachedStatusLine, 10> STATUS_LINES = {
+    {
+     {200, "OK", "HTTP/1.1 200 OK\r\n"},
+     {400, "Bad Request", "HTTP/1.1 400 Bad Request\r\n"},
+     {404, "Not Found", "HTTP/1.1 404 Not Found\r\n"},
+     {405, "Method Not Allowed", "HTTP/1.1 405 Method Not Allowed\r\n"},
+     {411, "Length Required", "HTTP/1.1 411 Length Required\r\n"},
+     {413, "Content Too Large", "HTTP/1.1 413 Content Too Large\r\n"},
+     {431, "Request Header Fields Too Large", "HTTP/1.1 431 Request Header Fields Too Large\r\n"},
+     {500, "Internal Server Error", "HTTP/1.1 500 Internal Server Error\r\n"},
+     {503, "Service Unavailable", "HTTP/1.1 503 Service Unavailable\r\n"},
+     {505, "HTTP Version Not Supported", "HTTP/1.1 505 HTTP Version Not Supported\r\n"},
+     }
+};
+
+struct CachedHeaderLine {
+  std::string_view name;
+  std::string_view value;
+  std::string_view line;
+};
+static constexpr std::array<CachedHeaderLine, 3> HEADER_LINES = {
+    {
+     {"Content-Type", "application/json", "Content-Type: application/json\r\n"},
+     {"Content-Length", "0", "Content-Length: 0\r\n"},
+     {"Connection", "close", "Connection: close\r\n"},
+     }
+};
+
+// A serialized response as a list of pieces, either cached lines or views into the response itself
+// (which must outlive this). Lets the response be sent without ever being copied into one string.
+class ResponseParts {
+ public:
+  explicit ResponseParts(const HTTPResponse& response) {
+    m_parts.reserve(response.headers.size() * 4 + 3);
+
+    const auto* status = std::ranges::find_if(STATUS_LINES, [&](const CachedStatusLine& cached) {
+      return cached.code == response.code && cached.status == response.status;
+    });
+    if (response.version == "HTTP/1.1" && status != STATUS_LINES.end()) {
+      add(status->line);
+    } else {
+      m_status_line = response.version + " " + std::to_string(response.code) + " "
+                    + response.status + "\r\n";
+      add(m_status_line);
+    }
+
+    for (const auto& [name, value] : response.headers) {
+      const auto* header = std::ranges::find_if(HEADER_LINES, [&](const CachedHeaderLine& cached) {
+        return cached.name == name && cached.value == value;
+      });
+      if (header != HEADER_LINES.end()) {
+        add(header->line);
+        continue;
+      }
+      add(name);
+      add(": ");
+      add(value);
+      add("\r\n");
+    }
+    add("\r\n");
+    if (!response.body.empty()) { add(response.body); }
+  }
+
+  std::span<iovec> iovecs() { return m_parts; }
+
+  std::size_t size() const {
+    std::size_t total = 0;
+    for (const iovec& part : m_parts) { total += part.iov_len; }
+    return total;
+  }
+
+ private:
+  void add(std::string_view part) {
+    // NOLINTNEXTLINE(*-const-cast): iovec is shared with readv, sending never writes through it
+    m_parts.push_back({.iov_base = const_cast<char*>(part.data()), .iov_len = part.size()});
+  }
+
+  std::string        m_status_line;    // Only used for status lines that are not cached
+  std::vector<iovec> m_parts;
+};
+
 std::string to_string(const HTTPResponse& response) {
-  std::ostringstream ss;
-  ss << response.version << " " << response.code << " " << response.status << "\r\n";
-  for (const auto& [header, value] : response.headers) { ss << header << ": " << value << "\r\n"; }
-  ss << "\r\n" << response.body;
-  return ss.str();
+  ResponseParts parts(response);
+  std::string   str;
+  str.reserve(parts.size());
+  for (const iovec& part : parts.iovecs()) {
+    str.append(static_cast<const char*>(part.iov_base), part.iov_len);
+  }
+  return str;
+}
+
+bool sendResponse(const TCPSocket& sock, const HTTPResponse& response) {
+  ResponseParts parts(response);
+  return sock.sendv(parts.iovecs());
 }
 
 bool HTTPServer::init() {
@@ -106,233 +350,955 @@ bool HTTPServer::run(int shutdown_fd) {
     return EXIT_FAILURE;
   }
 
-  // Accept clients while checking for shutdown
-  std::array<pollfd, 2> poll_fds{};
-  poll_fds[0] = {.fd = shutdown_fd, .events = POLLIN, .revents = 0};
-  poll_fds[1] = {.fd = m_listener_socket.fd(), .events = POLLIN, .revents = 0};
-  while (true) {
-    LOG(INFO) << "Blocking on poll...";
-    const int poll_res = poll(poll_fds.data(), poll_fds.size(), -1);
-    // Poll had an error
-    if (poll_res == -1) {
-      LOG(CRITICAL) << "Poll failed: " << my_strerror(errno);
+  m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epoll_fd == -1) {
+    LOG(CRITICAL) << "Unable to create epoll instance: " << my_strerror(errno);
+    return false;
+  }
+  m_wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (m_wakeup_fd == -1) {
+    LOG(CRITICAL) << "Unable to create wakeup eventfd: " << my_strerror(errno);
+    ::close(m_epoll_fd);
+    return false;
+  }
+
+  for (const int fd : {shutdown_fd, m_listener_socket.fd(), m_wakeup_fd}) {
+    epoll_event event{.events = EPOLLIN, .data{.fd = fd}};
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+      LOG(CRITICAL) << "Unable to add fd " << fd << " to epoll: " << my_strerror(errno);
+      ::close(m_wakeup_fd);
+      ::close(m_epoll_fd);
       return false;
     }
-    if (poll_res == 0) {
-      LOG(DEBUG) << "Poll timed out. Polling agian...";
-      continue;
-    }
-    if ((static_cast<uint8_t>(poll_fds[0].revents) & static_cast<uint8_t>(POLLIN)) != 0) {
-      LOG(INFO) << "Poll received shutdown input";
+  }
+
+  // Complete requests are handed off to the worker threads
+  WorkerPool<HTTPConnection> workers(
+      m_config.num_threads, m_config.queue_size, [this](HTTPConnection&& conn) {
+        m_started.add();
+        HTTPWorker worker(std::move(conn), m_services, m_config.json_indent);
+        if (worker.run()) { returnClient(worker.release()); }
+      });
+
+  // Idle connections are checked for at least this often
+  const auto sweep_interval = std::chrono::milliseconds(
+      std::clamp(m_config.idle_timeout_ms, MIN_SWEEP_INTERVAL_MS, MAX_SWEEP_INTERVAL_MS));
+  auto last_sweep = std::chrono::steady_clock::now();
+
+  // Watch the listener and all clients while checking for shutdown
+  std::array<epoll_event, MAX_EPOLL_EVENTS> events{};
+  bool                                      shutdown = false;
+  while (!shutdown) {
+    LOG(DEBUG) << "Blocking on epoll...";
+    const int num_events = epoll_wait(m_epoll_fd, events.data(), events.size(),
+                                      static_cast<int>(sweep_interval.count()));
+    if (num_events == -1) {
+      if (errno == EINTR) { continue; }
+      LOG(CRITICAL) << "Epoll failed: " << my_strerror(errno);
       break;
     }
-    if ((static_cast<uint8_t>(poll_fds[1].revents) & static_cast<uint8_t>(POLLIN)) == 0) {
-      LOG(WARN) << "Poll received non-POLLIN event. This is unexpected but shouldn't be an issue";
-      poll_fds[0].revents = 0;
-      poll_fds[1].revents = 0;
-      continue;
+    for (const epoll_event& event : std::span(events.data(), num_events)) {
+      const int fd = event.data.fd;
+      if (fd == shutdown_fd) {
+        LOG(INFO) << "Epoll received shutdown input";
+        shutdown = true;
+        break;
+      }
+      if (fd == m_listener_socket.fd()) {
+        LOG(INFO) << "Epoll received listener input, accepting client connection";
+        acceptClient();
+        continue;
+      }
+      if (fd == m_wakeup_fd) {
+        rewatchReturnedClients();
+        continue;
+      }
+      if ((event.events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0) { readClient(fd, workers); }
     }
-    LOG(INFO) << "Poll received listener input, accepting client connection";
-    std::optional<TCPSocket> client_socket = m_listener_socket.accept();
-    if (!client_socket.has_value()) {
-      LOG(WARN) << "Accept did not receive a client connection";
-      continue;
+    if (std::chrono::steady_clock::now() - last_sweep >= sweep_interval) {
+      closeIdleClients();
+      last_sweep = std::chrono::steady_clock::now();
     }
+  }
 
-    // TODO: Make this multithreaded
-    HTTPWorker worker(std::move(client_socket.value()));
-    worker.run();
+  // Queued requests still get handled, but every connection is closed afterwards
+  workers.stop();
+  m_connections.clear();
+  {
+    const std::lock_guard<std::mutex> lock(m_returned_mutex);
+    m_returned.clear();
   }
-  return true;
+  ::close(m_wakeup_fd);
+  m_wakeup_fd = -1;
+  ::close(m_epoll_fd);
+  m_epoll_fd = -1;
+  return shutdown;
 }
 
-void HTTPWorker::run() {
-  m_socket.setTimeout<SO_RCVTIMEO>(10);
-  std::optional<HTTPRequest> request_opt = HTTPWorker::parseRequest(m_socket);
-
-  if (!request_opt.has_value()) {
-    m_socket.send(HTTPResponse::makeErrorResponse(400, "Bad Request", "Error parsing request."));
+void HTTPServer::acceptClient() {
+  std::optional<TCPSocket> client_socket = m_listener_socket.accept();
+  if (!client_socket.has_value()) {
+    LOG(WARN) << "Accept did not receive a client connection";
+    return;
+  }
+  if (!client_socket->setNonBlocking(true)) {
+    LOG(WARN) << "Dropping client (fd: " << client_socket->fd()
+              << "), unable to make it non-blocking";
     return;
   }
+  // A client which stops reading its responses for as long as it may sit idle is dropped, rather
+  // than holding a worker forever
+  if (!client_socket->setTimeout<SO_SNDTIMEO>(m_config.idle_timeout_ms)) {
+    LOG(WARN) << "Dropping client (fd: " << client_socket->fd() << "), unable to set send timeout";
+    return;
+  }
+  watchClient(HTTPConnection{.socket        = std::move(client_socket.value()),
+                             .buffer        = ByteBuffer(),
+                             .parser        = HTTPParser(),
+                             .requests_left = m_config.max_requests,
+                             .peer_closed   = false,
+                             .last_active   = std::chrono::steady_clock::now(),
+                             .parse_ns      = 0,
+                             .counted       = OpenConnection(m_services.stats)});
+}
+
+bool HTTPServer::watchClient(HTTPConnection&& connection) {
+  const int   fd = connection.socket.fd();
+  epoll_event event{.events = EPOLLIN | EPOLLRDHUP, .data{.fd = fd}};
+  if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+    LOG(WARN) << "Dropping client (fd: " << fd << "), unable to add to epoll: "
+              << my_strerror(errno);
+    return false;
+  }
+  m_connections.insert_or_assign(fd, std::move(connection));
+  return true;
+}
 
-  HTTPRequest& request = request_opt.value();
-  if (request.version != "HTTP/1.1") {
-    m_socket.send(HTTPResponse::makeErrorResponse(505, "HTTP Version Not Supported",
-                                                  "HTTP/1.1 Must be Used."));
+void HTTPServer::readClient(int fd, WorkerPool<HTTPConnection>& workers) {
+  auto it = m_connections.find(fd);
+  if (it == m_connections.end()) {
+    LOG(WARN) << "Epoll event on unknown fd " << fd;
     return;
   }
+  HTTPConnection& conn = it->second;
 
-  if (!request.body.empty()) {
-    if (!request.headers.contains("content-length")) {
-      m_socket.send(HTTPResponse::makeErrorResponse(
-          411, "Length Required",
-          "Content-Length header must be specified when sending a request body"));
+  // Read up to the budget, parsing as we go so an oversized request is caught by the parser's
+  // limits before much more of it is buffered
+  auto parse = [&conn] {
+    const auto               parse_start = std::chrono::steady_clock::now();
+    const HTTPParser::Result result      = conn.parser.parse(conn.buffer);
+    conn.parse_ns += elapsedNs(parse_start, std::chrono::steady_clock::now());
+    return result;
+  };
+  ssize_t            n      = 0;
+  std::size_t        read   = 0;
+  HTTPParser::Result result = HTTPParser::INCOMPLETE;
+  while (read < READ_BUDGET && (n = conn.socket.recv(conn.buffer)) > 0) {
+    read += static_cast<std::size_t>(n);
+    if ((result = parse()) != HTTPParser::INCOMPLETE) { break; }
+  }
+  conn.peer_closed = n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+  conn.last_active = std::chrono::steady_clock::now();
+  if (read == 0) { result = parse(); }
+  if (result == HTTPParser::INCOMPLETE) {
+    if (!conn.peer_closed) { return; }
+    // A client which stopped sending partway through a body can still be told what went wrong
+    if (!conn.parser.headersComplete()) {
+      LOG(DEBUG) << "Client (fd: " << fd << ") closed connection";
+      closeClient(fd);
       return;
     }
+  }
 
-    unsigned int content_length = 0;
-    try {
-      content_length = std::stoul(request.headers["content-length"]);
-    } catch (const std::exception& e) {
-      m_socket.send(HTTPResponse::makeErrorResponse(
-          400, "Bad Request",
-          "Specified content length (" + request.headers["content-length"] + ") is invalid"));
-      return;
+  // Full request received, the worker owns the connection until it gives it back
+  if (epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == -1) {
+    LOG(WARN) << "Unable to remove fd " << fd << " from epoll: " << my_strerror(errno);
+  }
+  HTTPConnection job = std::move(conn);
+  m_connections.erase(it);
+  if (workers.submit(std::move(job))) {
+    m_submitted.add();
+  } else {
+    // Reject rather than let the queue grow without bound
+    LOG(WARN) << "Rejecting client (fd: " << fd << "), server is overloaded";
+    job.socket.setTimeout<SO_SNDTIMEO>(REJECT_SEND_TIMEOUT_MS);
+    const auto send_start = std::chrono::steady_clock::now();
+    sendResponse(job.socket, OVERLOADED);
+    if (m_services.stats != nullptr) {
+      m_services.stats->record(
+          HTTPWorker::routeIndex(nullptr),
+          {.first_byte_ns = elapsedNs(job.last_active, send_start),
+           .parse_ns      = job.parse_ns,
+           .handler_ns    = 0,
+           .send_ns       = elapsedNs(send_start, std::chrono::steady_clock::now()),
+           .status        = OVERLOADED.code,
+           .bytes_in      = job.buffer.size(),
+           .bytes_out     = to_string(OVERLOADED).size()});
     }
+  }
+}
 
-    if (content_length != request.body.length()) {
-      m_socket.send(HTTPResponse::makeErrorResponse(
-          400, "Bad Request",
-          "Provided content length " + request.headers["content-length"]
-              + " does not match actual content length " + std::to_string(request.body.length())));
-      return;
+void HTTPServer::closeClient(int fd) {
+  if (epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == -1) {
+    LOG(WARN) << "Unable to remove fd " << fd << " from epoll: " << my_strerror(errno);
+  }
+  m_connections.erase(fd);
+}
+
+void HTTPServer::returnClient(HTTPConnection&& connection) {
+  {
+    const std::lock_guard<std::mutex> lock(m_returned_mutex);
+    m_returned.push_back(std::move(connection));
+  }
+  const uint64_t one = 1;
+  if (write(m_wakeup_fd, &one, sizeof(one)) == -1) {
+    LOG(WARN) << "Unable to signal returned connection: " << my_strerror(errno);
+  }
+}
+
+void HTTPServer::rewatchReturnedClients() {
+  uint64_t count = 0;
+  if (read(m_wakeup_fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+    LOG(WARN) << "Unable to read wakeup eventfd: " << my_strerror(errno);
+  }
+  std::vector<HTTPConnection> returned;
+  {
+    const std::lock_guard<std::mutex> lock(m_returned_mutex);
+    returned.swap(m_returned);
+  }
+  for (HTTPConnection& conn : returned) {
+    conn.last_active = std::chrono::steady_clock::now();
+    watchClient(std::move(conn));
+  }
+}
+
+void HTTPServer::closeIdleClients() {
+  const auto now     = std::chrono::steady_clock::now();
+  const auto timeout = std::chrono::milliseconds(m_config.idle_timeout_ms);
+  for (auto it = m_connections.begin(); it != m_connections.end();) {
+    if (now - it->second.last_active < timeout) {
+      ++it;
+      continue;
+    }
+    LOG(DEBUG) << "Closing idle client (fd: " << it->first << ")";
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, it->first, nullptr) == -1) {
+      LOG(WARN) << "Unable to remove fd " << it->first << " from epoll: " << my_strerror(errno);
     }
+    it = m_connections.erase(it);
   }
+}
+
+bool HTTPWorker::run() {
+  HTTPParser& parser = m_connection.parser;
+  while (m_connection.requests_left > 0 && !m_close) {
+    const auto         parse_start = std::chrono::steady_clock::now();
+    HTTPParser::Result result      = parser.parse(m_connection.buffer);
+    m_connection.parse_ns += elapsedNs(parse_start, std::chrono::steady_clock::now());
+    if (result == HTTPParser::INCOMPLETE) {
+      if (m_connection.peer_closed) {
+        // Whatever is left is all the client is going to send
+        if (!parser.headersComplete()) { return false; }
+        result = parser.finish(m_connection.buffer);
+      } else if (m_connection.socket.nonBlocking()) {
+        return true;    // Wait for the rest in the reactor
+      } else {
+        // Requests are framed by their headers, this only guards against clients that stall
+        m_connection.socket.setTimeout<SO_RCVTIMEO>(REQUEST_TIMEOUT_MS);
+        m_connection.peer_closed = m_connection.socket.recv(m_connection.buffer) <= 0;
+        m_connection.last_active = std::chrono::steady_clock::now();
+        continue;
+      }
+    }
+
+    m_connection.requests_left--;
+    if (m_connection.requests_left == 0 || m_connection.peer_closed) { m_close = true; }
+    const auto handle_start = std::chrono::steady_clock::now();
+    handle(result);
+    if (m_services.stats != nullptr) {
+      const uint64_t handle_ns = elapsedNs(handle_start, std::chrono::steady_clock::now());
+      m_timing.parse_ns        = m_connection.parse_ns;
+      m_timing.handler_ns      = handle_ns - std::min(handle_ns, m_timing.send_ns);
+      m_timing.bytes_in        = parser.length();
+      m_services.stats->record(routeIndex(m_route), m_timing);
+    }
+    m_route               = nullptr;
+    m_timing              = {};
+    m_connection.parse_ns = 0;
 
-  (this->*HTTPWorker::handlerMapper(request.resource))(request);
+    // Pipelined requests stay in the buffer for the next time around
+    m_connection.buffer.consume(parser.length());
+    parser.reset();
+  }
+  return false;
 }
 
-std::optional<HTTPRequest> HTTPWorker::parseRequest(TCPSocket& sock) {
-  LOG(DEBUG) << "Parsing HTTP Response on sock " << sock.fd();
-  SocketStream ss(sock);
-
-  HTTPRequest request;
-  request.method   = HTTPRequest::stringToMethod(ss.nextWord());
-  request.resource = ss.nextWord();
-  request.version  = ss.nextWord();
-  if (ss.passedBuffer().find('\n') != std::string::npos || request.resource.empty()
-      || request.version.empty()) {
-    LOG(WARN) << "First line is not complete (" << ss.passedBuffer() << ")";
-    return std::nullopt;
+bool HTTPWorker::respond(const HTTPResponse& response) const {
+  if (m_timing.status == 0) { m_timing.status = response.code; }
+  // Only copied in the rare case it has to be changed
+  if (m_close && !response.headers.contains("Connection")) {
+    HTTPResponse closing           = response;
+    closing.headers["Connection"] = "close";
+    ResponseParts parts(closing);
+    return send(parts.iovecs());
   }
-  LOG(TRACE) << "METHOD: " << request.method << " RESOURCE: " << request.resource
-             << " VERSION: " << request.version;
-  std::string line = ss.nextLine();
-  for (const char c : line) {
-    if (isspace(c) == 0) {
-      LOG(WARN) << "Extra chars at end of first line: " << line;
-      return std::nullopt;
+  ResponseParts parts(response);
+  return send(parts.iovecs());
+}
+
+bool HTTPWorker::send(std::span<iovec> parts) const {
+  const auto start = std::chrono::steady_clock::now();
+  if (m_timing.bytes_out == 0) {
+    m_timing.first_byte_ns = elapsedNs(m_connection.last_active, start);
+  }
+  const bool sent = m_connection.socket.sendv(parts);
+  m_timing.send_ns += elapsedNs(start, std::chrono::steady_clock::now());
+  // Partway through a response, nothing more can be sent on this connection
+  if (!sent) { m_close = true; }
+  for (const iovec& part : parts) { m_timing.bytes_out += part.iov_len; }
+  return sent;
+}
+
+bool HTTPWorker::respondChunked(HTTPResponse                                   head,
+                                const std::function<bool(std::string& chunk)>& next) const {
+  head.headers.erase("Content-Length");
+  head.headers["Transfer-Encoding"] = "chunked";
+  head.body.clear();
+  if (!respond(std::move(head))) { return false; }
+
+  std::string chunk;
+  std::string size_line;
+  while (true) {
+    chunk.clear();
+    if (!next(chunk)) {
+      LOG(ERROR) << "Abandoning chunked response partway through";
+      m_close = true;
+      return false;
+    }
+    // The chunk with no data is the end of the body
+    const bool                                last = chunk.empty();
+    std::array<char, sizeof(std::size_t) * 2> hex{};
+    size_line.assign(hex.data(), std::to_chars(hex.begin(), hex.end(), chunk.size(), 16).ptr);
+    size_line.append("\r\n");
+    chunk.append("\r\n");
+    std::array<iovec, 2> parts = {
+        {{.iov_base = size_line.data(), .iov_len = size_line.size()},
+         {.iov_base = chunk.data(), .iov_len = chunk.size()}}
+    };
+    if (!send(parts)) {
+      m_close = true;
+      return false;
     }
+    if (last) { return true; }
   }
-  if (request.method == HTTPRequest::UNKNOWN) {
-    LOG(WARN) << "Unrecognized HTTP method";
-    return std::nullopt;
+}
+
+void HTTPWorker::handle(HTTPParser::Result result) {
+  const HTTPParser&     parser  = m_connection.parser;
+  const HTTPRequestView request = parser.request(m_connection.buffer);
+  const std::string     content_length(request.headers.get("content-length").value_or(""));
+
+  // After a bad request, there is no telling where the next one would start
+  if (result == HTTPParser::ERROR) {
+    m_close = true;
+    switch (parser.error()) {
+      case HTTPParser::BAD_CONTENT_LENGTH:
+        respond(HTTPResponse::makeErrorResponse(
+            400, "Bad Request",
+            "Specified content length (" + content_length + ") is invalid"));
+        return;
+      case HTTPParser::BODY_TOO_LARGE:
+        respond(BODY_TOO_LARGE);
+        return;
+      case HTTPParser::TOO_MANY_HEADERS:
+      case HTTPParser::HEADERS_TOO_LARGE:
+        respond(HEADERS_TOO_LARGE);
+        return;
+      default:
+        respond(PARSE_ERROR);
+        return;
+    }
   }
-  while (ss.hasNext() && !(line = ss.nextLine()).empty()) {
-    const std::size_t delim_pos = line.find(':');
-    if (delim_pos == std::string::npos) { break; }
 
-    std::string header = line.substr(0, delim_pos);
-    for (char& c : header) { c = static_cast<char>(std::tolower(c)); }
-    std::size_t val_start = delim_pos + 1;
-    while (isspace(line[val_start]) != 0) { val_start++; }
-    request.headers[header] = line.substr(val_start);
-    LOG(TRACE) << "HEADER: " << header << " - VALUE: " << request.headers[header];
+  // Only happens if the client stopped sending partway through the body
+  if (result == HTTPParser::INCOMPLETE) {
+    m_close = true;
+    // A request body is only ever framed by chunks or by Content-Length
+    if (request.headers.contains("transfer-encoding")) {
+      respond(CHUNKED_BODY_INCOMPLETE);
+      return;
+    }
+    respond(HTTPResponse::makeErrorResponse(
+        400, "Bad Request",
+        "Provided content length " + content_length + " does not match actual content length "
+            + std::to_string(parser.bodyReceived())));
+    return;
   }
-  if (ss.hasNext()) {
-    request.body = ss.remaining();
-    LOG(TRACE) << "BODY:\n" << request.body;
+
+  if (request.version != "HTTP/1.1") {
+    m_close = true;
+    respond(VERSION_NOT_SUPPORTED);
+    return;
+  }
+
+  const std::optional<std::string_view> connection = request.headers.get("connection");
+  if (connection.has_value() && equalsLower(connection.value(), "close")) { m_close = true; }
+
+  if (!request.headers.contains("content-length") && !request.headers.contains("transfer-encoding")
+      && (request.method == "POST" || request.method == "PUT" || request.method == "PATCH")) {
+    // Without either header there is no way to tell where the body ends
+    m_close = true;
+    respond(LENGTH_REQUIRED);
+    return;
+  }
+
+  const Route* route = findRoute(request.target);
+  if (route == nullptr) {
+    notFound(request);
+    return;
+  }
+  m_route = route;
+  if ((route->methods & methodBit(HTTPRequest::stringToMethod(request.method))) == 0) {
+    methodNotAllowed(*route);
+    return;
+  }
+  m_indent = acceptIndent(request).value_or(m_json_indent);
+  (this->*route->handler)(request);
+}
+
+std::optional<HTTPRequest> HTTPWorker::parseRequest(TCPSocket& sock) {
+  LOG(DEBUG) << "Parsing HTTP Request on sock " << sock.fd();
+  ByteBuffer buffer;
+  HTTPParser parser(HTTPParser::REQUEST);
+  HTTPParser::Result result = HTTPParser::INCOMPLETE;
+  while ((result = parser.parse(buffer)) == HTTPParser::INCOMPLETE) {
+    if (sock.recv(buffer) <= 0) {
+      LOG(WARN) << "Connection ended before the request was complete";
+      return std::nullopt;
+    }
   }
-  return request;
+  if (result == HTTPParser::ERROR) { return std::nullopt; }
+  return HTTPRequest(parser.request(buffer));
 }
 
 std::optional<HTTPResponse> HTTPWorker::parseResponse(TCPSocket& sock) {
+  ByteBuffer buffer;
+  return parseResponse(sock, buffer);
+}
+
+std::optional<HTTPResponse> HTTPWorker::parseResponse(TCPSocket& sock, ByteBuffer& buffer) {
   LOG(DEBUG) << "Parsing HTTP Response on sock " << sock.fd();
-  SocketStream ss(sock);
-
-  HTTPResponse response;
-  response.version = ss.nextWord();
-  try {
-    response.code = std::stoul(ss.nextWord());
-  } catch (const std::exception& e) {
-    LOG(TRACE) << "Invalid response code provided";
-    return std::nullopt;
+  HTTPParser parser(HTTPParser::RESPONSE);
+  HTTPParser::Result result = HTTPParser::INCOMPLETE;
+  while ((result = parser.parse(buffer)) == HTTPParser::INCOMPLETE) {
+    if (sock.recv(buffer) <= 0) {
+      // Responses without a length run until the connection closes
+      result = parser.finish(buffer);
+      break;
+    }
   }
-  response.status = ss.nextLine(true);
-  if (ss.passedBuffer().find('\n') != ss.passedBuffer().length() - 1 || response.version.empty()
-      || response.code == 0 || response.status.empty()) {
-    LOG(TRACE) << "First line is not complete (" << ss.passedBuffer() << ")";
+  if (result != HTTPParser::COMPLETE) {
+    LOG(WARN) << "Failed to parse HTTP response";
     return std::nullopt;
   }
-  LOG(TRACE) << "VERSION: " << response.version << " CODE: " << response.code
-             << " STATUS: " << response.status;
-  std::string line;
-  while (ss.hasNext() && !(line = ss.nextLine()).empty()) {
-    const std::size_t delim_pos = line.find(':');
-    if (delim_pos == std::string::npos) { break; }
+  HTTPResponse response(parser.response(buffer));
+  buffer.consume(parser.length());
+  return response;
+}
 
-    std::string header = line.substr(0, delim_pos);
-    for (char& c : header) { c = static_cast<char>(std::tolower(c)); }
-    std::size_t val_start = delim_pos + 1;
-    while (isspace(line[val_start]) != 0) { val_start++; }
-    response.headers[header] = line.substr(val_start);
-    LOG(TRACE) << "HEADER: " << header << " - VALUE: " << response.headers[header];
+void HTTPWorker::v0getAutofill(const HTTPRequestView& request) const {
+  const std::optional<std::string_view> partial_query = request.headers.get("partial-query");
+  if (!partial_query.has_value()) {
+    respond(MISSING_PARTIAL_QUERY);
+    return;
   }
-  if (ss.hasNext()) {
-    response.body = ss.remaining();
-    LOG(TRACE) << "BODY:\n" << response.body;
+  std::size_t                           num_suggestions = DEFAULT_SUGGESTIONS;
+  const std::optional<std::string_view> num_header      = request.headers.get("num-suggestions");
+  if (num_header.has_value()
+      && std::from_chars(num_header->data(), num_header->data() + num_header->size(),
+                         num_suggestions)
+                 .ec
+             != std::errc()) {
+    respond(BAD_NUM_SUGGESTIONS);
+    return;
   }
-  return response;
+
+  // With nothing indexed there is simply nothing to suggest
+  std::vector<std::string> suggestions;
+  if (m_services.autofill != nullptr) {
+    suggestions = m_services.autofill->suggest(*partial_query, num_suggestions);
+  }
+  respond(HTTPResponse{200, "OK", {{"suggestions", suggestions}}, m_indent});
 }
 
-void HTTPWorker::v0reportSearchResults(const HTTPRequest& request) const {
-  if (request.method != HTTPRequest::POST) {
-    m_socket.send(
-        HTTPResponse::makeErrorResponse(405, "Method Not Allowed", "Use POST for this API call"));
+void HTTPWorker::v0getQueryID(const HTTPRequestView& /* request */) const {
+  // Without a durable allocator, IDs are only unique until the server restarts
+  static QueryIDAllocator fallback;
+  QueryIDAllocator& query_ids = m_services.query_ids != nullptr ? *m_services.query_ids : fallback;
+  const std::optional<uint64_t> id = query_ids.next();
+  if (!id.has_value()) {
+    respond(NO_QUERY_ID);
     return;
   }
+  respond(HTTPResponse{200, "OK", {{"query_ID", id.value()}}, m_indent});
+}
 
-  if (!request.headers.contains("content-type")
-      || request.headers.at("content-type") != "application/json") {
-    m_socket.send(HTTPResponse::makeErrorResponse(
-        400, "Bad Request",
-        "Missing / Incorrect `Content-Type` header (expected `application/json`)"));
+void HTTPWorker::v0reportSearchResults(const HTTPRequestView& request) const {
+  if (request.headers.get("content-type") != "application/json") {
+    respond(BAD_CONTENT_TYPE);
     return;
   }
 
-  std::string clicked_link;
-  try {
-    nlohmann::json     body    = nlohmann::json::parse(request.body);
-    auto               results = body.at("results");
-    const unsigned int clicked = body.at("clicked");
-    clicked_link               = results.at(clicked);
-  } catch (const std::exception& e) {
-    LOG(ERROR) << "Exception in json parsing: " << e.what();
-    m_socket.send(
-        HTTPResponse::makeErrorResponse(400, "Bad Request", "Improper format of request body."));
+  std::optional<SearchRecord> parsed = parseSearchResults(request.body);
+  if (!parsed.has_value()) {
+    LOG(ERROR) << "Unable to read ReportSearchResults body";
+    respond(BAD_BODY);
     return;
   }
+  SearchRecord&     record       = parsed.value();
+  const std::string clicked_link = record.results[record.clicked];
 
-  // Respond before continuing to propagate data
-  if (!m_socket.send(HTTPResponse(200, "OK"))) { LOG(ERROR) << "Failed to send response"; }
-#ifndef UNITTEST    // Can't forward to link analysis in unit test, finding fix for this
-  if (!clicked_link.empty()) {
-    constexpr const char* LINK_ANALYSIS_DOMAIN = "lspt-link-analysis.cs.rpi.edu";
-    constexpr uint16_t    LINK_ANALYSIS_PORT   = 1234;
+  // Worked out before the record is handed over to the store
+  std::optional<RankingInteraction> interaction;
+  if (m_services.ranking != nullptr) { interaction = RankingInteraction::fromSearch(record); }
 
-    const std::string link_analysis_ip = TCPSocket::getIP(LINK_ANALYSIS_DOMAIN, LINK_ANALYSIS_PORT);
+  // Only queued here, the store writes it out in the background
+  const std::string raw_query = record.raw_query;
+  if (m_services.search_history != nullptr
+      && !m_services.search_history->enqueue(std::move(record))) {
+    respond(NO_SEARCH_STORAGE);
+    return;
+  }
+  // Suggested from the next keystroke on, rather than after a restart
+  if (m_services.autofill != nullptr) { m_services.autofill->add(raw_query); }
 
-    TCPSocket link_analysis_sock;
+  if (!respond(HTTPResponse(200, "OK"))) { LOG(ERROR) << "Failed to send response"; }
+  // Only counted here, the forwarder sends the clicks to Link Analysis in the background
+  if (m_services.link_analysis != nullptr && !clicked_link.empty()) {
+    m_services.link_analysis->recordClick(clicked_link);
+  }
+  if (interaction.has_value()) { m_services.ranking->record(std::move(interaction.value())); }
+}
 
-    if (!link_analysis_sock.create()) {
-      LOG(ERROR) << "Failed to create socket to forward to Link Analysis";
+void HTTPWorker::v0getQueryData(const HTTPRequestView& request) const {
+  std::vector<uint64_t> query_ids;
+  if (request.method == "POST") {
+    // A list of IDs, or an inclusive range of them
+    bool too_many = false;
+    try {
+      const nlohmann::json body = nlohmann::json::parse(request.body);
+      if (body.contains("query_IDs")) {
+        query_ids = body.at("query_IDs").get<std::vector<uint64_t>>();
+        too_many  = query_ids.size() > MAX_QUERY_IDS;
+      } else {
+        const auto first = body.at("first_query_ID").get<uint64_t>();
+        const auto last  = body.at("last_query_ID").get<uint64_t>();
+        too_many         = first <= last && last - first >= MAX_QUERY_IDS;
+        // Counted from `first`, as `last` may be the largest ID there is
+        for (uint64_t i = 0; first <= last && !too_many && i <= last - first; ++i) {
+          query_ids.push_back(first + i);
+        }
+      }
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Exception in json parsing: " << e.what();
+      respond(BAD_BODY);
+      return;
+    }
+    if (too_many) {
+      respond(HTTPResponse::makeErrorResponse(
+          400, "Bad Request",
+          "Too many query IDs, at most " + std::to_string(MAX_QUERY_IDS) + " per request"));
       return;
     }
-    if (!link_analysis_sock.connect(link_analysis_ip.c_str(), LINK_ANALYSIS_PORT)) {
-      LOG(ERROR) << "Failed to connect to Link Analysis";
+  } else {
+    const std::optional<std::string_view> id_header = request.headers.get("query-id");
+    uint64_t                              query_id  = 0;
+    if (!id_header.has_value()
+        || std::from_chars(id_header->data(), id_header->data() + id_header->size(), query_id).ec
+               != std::errc()) {
+      respond(BAD_QUERY_ID);
       return;
     }
+    query_ids.push_back(query_id);
+  }
+  if (m_services.search_history == nullptr) {
+    respond(NO_SEARCH_HISTORY);
+    return;
+  }
 
-    const nlohmann::json body = {
-        {"list_of_clicked_links", {clicked_link}},
-        {          "click_count",            {1}}
-    };
-    HTTPRequest request(HTTPRequest::POST, "/evaluation/update_metadata", body);
-    request.headers["Host"] = "lspt-link-analysis.cs.rpi.edu:1234";
+  // Unknown IDs are left out of the list
+  nlohmann::json queries = nlohmann::json::array();
+  for (const SearchRecord& record : m_services.search_history->find(query_ids)) {
+    queries.push_back({
+        {"query_ID", record.query_id},
+        { "results",  record.results},
+        { "clicked",  record.clicked}
+    });
+  }
+  respond(HTTPResponse{200, "OK", {{"queries", queries}}, m_indent});
+}
 
-    if (!link_analysis_sock.send(request)) {
-      LOG(ERROR) << "Failed to send search results to Link Analysis";
+void HTTPWorker::v0exportSearchHistory(const HTTPRequestView& request) const {
+  uint64_t                              after_id  = 0;
+  const std::optional<std::string_view> id_header = request.headers.get("after-id");
+  if (id_header.has_value()
+      && std::from_chars(id_header->data(), id_header->data() + id_header->size(), after_id).ec
+             != std::errc()) {
+    respond(BAD_AFTER_ID);
+    return;
+  }
+  if (m_services.search_history == nullptr) {
+    respond(NO_SEARCH_HISTORY);
+    return;
+  }
+
+  // One line of JSON per query, a page of the store at a time
+  HTTPResponse head(200, "OK");
+  head.headers["Content-Type"] = "application/x-ndjson";
+  respondChunked(std::move(head), [&](std::string& chunk) {
+    const std::optional<std::vector<SearchRecord>> page =
+        m_services.search_history->findAfter(after_id, EXPORT_PAGE_SIZE);
+    if (!page.has_value()) { return false; }
+    for (const SearchRecord& record : *page) {
+      const nlohmann::json line = {
+          {       "query_ID",        record.query_id},
+          {      "raw_query",       record.raw_query},
+          {        "results",         record.results},
+          {        "clicked",         record.clicked},
+          {"query_timestamp", record.query_timestamp}
+      };
+      chunk += line.dump();
+      chunk += '\n';
     }
+    if (!page->empty()) { after_id = page->back().query_id; }
+    return true;
+  });
+}
+
+void HTTPWorker::v0reportMetrics(const HTTPRequestView& request) const {
+  const std::optional<std::string_view> component = request.headers.get("component");
+  if (!component.has_value() || component->empty()) {
+    respond(MISSING_COMPONENT);
+    return;
   }
-#endif
+
+  // Checked in full before anything is stored, so a bad batch can simply be resent once fixed
+  const int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+  const std::optional<std::vector<ReportedMetric>> metrics =
+      parseMetricsReport(request.body, now_ms);
+  if (!metrics.has_value()) {
+    LOG(ERROR) << "Unable to read ReportMetrics body";
+    respond(BAD_BODY);
+    return;
+  }
+
+  bool stored = true;
+  if (m_services.metrics != nullptr) {
+    for (const ReportedMetric& metric : *metrics) {
+      stored = m_services.metrics->record(*component, metric.label, metric.timestamp_ms,
+                                          metric.value)
+            && stored;
+    }
+  }
+  respond(stored ? HTTPResponse{200, "OK"} : METRICS_FULL);
+}
+
+void HTTPWorker::v0getMetrics(const HTTPRequestView& request) const {
+  const std::optional<std::string_view> component = request.headers.get("component");
+  const std::optional<std::string_view> label     = request.headers.get("label");
+  if (!component.has_value() || !label.has_value()) {
+    respond(MISSING_METRIC);
+    return;
+  }
+  const std::string_view resolution_name = request.headers.get("resolution").value_or("minute");
+  if (!equalsLower(resolution_name, "minute") && !equalsLower(resolution_name, "hour")) {
+    respond(BAD_RESOLUTION);
+    return;
+  }
+  const MetricsStore::Resolution resolution =
+      equalsLower(resolution_name, "hour") ? MetricsStore::HOUR : MetricsStore::MINUTE;
+  int64_t from_ms = std::numeric_limits<int64_t>::min();
+  int64_t to_ms   = std::numeric_limits<int64_t>::max();
+  if (!parseTimeHeader(request, "from", from_ms) || !parseTimeHeader(request, "to", to_ms)) {
+    respond(BAD_TIME_RANGE);
+    return;
+  }
+  if (m_services.metrics == nullptr) {
+    respond(NO_METRICS);
+    return;
+  }
+
+  nlohmann::json rollups = nlohmann::json::array();
+  for (const MetricRollup& rollup :
+       m_services.metrics->rollups(*component, *label, resolution, from_ms, to_ms)) {
+    rollups.push_back({
+        {"start", rollup.start_ms},
+        {"count",    rollup.count},
+        {  "sum",      rollup.sum},
+        {  "min",      rollup.min},
+        {  "max",      rollup.max}
+    });
+  }
+  nlohmann::json events = nlohmann::json::array();
+  for (const MetricEvent& event : m_services.metrics->events(*component, *label, from_ms, to_ms)) {
+    events.push_back({
+        {"timestamp",                        event.timestamp_ms},
+        {    "value", nlohmann::json::parse(event.value)}
+    });
+  }
+  respond(HTTPResponse{200, "OK", {{"rollups", rollups}, {"events", events}}, m_indent});
+}
+
+void HTTPWorker::v0getQuantiles(const HTTPRequestView& request) const {
+  const std::optional<std::string_view> component = request.headers.get("component");
+  const std::optional<std::string_view> label     = request.headers.get("label");
+  if (!component.has_value() || !label.has_value()) {
+    respond(MISSING_METRIC);
+    return;
+  }
+  int64_t from_ms = std::numeric_limits<int64_t>::min();
+  int64_t to_ms   = std::numeric_limits<int64_t>::max();
+  if (!parseTimeHeader(request, "from", from_ms) || !parseTimeHeader(request, "to", to_ms)) {
+    respond(BAD_TIME_RANGE);
+    return;
+  }
+  // Each quantile keeps the spelling it was asked for, which is also its key in the response
+  std::vector<std::pair<std::string_view, double>> quantiles;
+  for (std::string_view rest = request.headers.get("quantiles").value_or(DEFAULT_QUANTILES);
+       !rest.empty();) {
+    std::string_view name = rest.substr(0, rest.find(','));
+    rest.remove_prefix(std::min(rest.size(), name.size() + 1));
+    while (!name.empty() && name.front() == ' ') { name.remove_prefix(1); }
+    while (!name.empty() && name.back() == ' ') { name.remove_suffix(1); }
+    double q = 0;
+    if (std::from_chars(name.data(), name.data() + name.size(), q).ec != std::errc() || q < 0
+        || q > 1) {
+      respond(BAD_QUANTILES);
+      return;
+    }
+    quantiles.emplace_back(name, q);
+  }
+  if (m_services.metrics == nullptr) {
+    respond(NO_METRICS);
+    return;
+  }
+
+  const QuantileSketch sketch = m_services.metrics->quantiles(*component, *label, from_ms, to_ms);
+  nlohmann::json       values = nlohmann::json::object();
+  for (const auto& [name, q] : quantiles) {
+    const std::optional<double> value = sketch.quantile(q);
+    values[std::string(name)] = value.has_value() ? nlohmann::json(*value) : nlohmann::json();
+  }
+  const bool empty = sketch.count() == 0;
+  respond(HTTPResponse{
+      200, "OK",
+      {{"count", sketch.count()},
+       {"min", empty ? nlohmann::json() : nlohmann::json(sketch.min())},
+       {"max", empty ? nlohmann::json() : nlohmann::json(sketch.max())},
+       {"quantiles", values}},
+      m_indent
+  });
+}
+
+void HTTPWorker::notFound(const HTTPRequestView& /* request */) const { respond(NOT_FOUND); }
+
+void HTTPWorker::methodNotAllowed(const Route& route) const {
+  std::string allow;
+  for (int method = HTTPRequest::GET; method < HTTPRequest::UNKNOWN; ++method) {
+    if ((route.methods & methodBit(static_cast<HTTPRequest::Method>(method))) == 0) { continue; }
+    if (!allow.empty()) { allow += ", "; }
+    allow += HTTPRequest::methodToString(static_cast<HTTPRequest::Method>(method));
+  }
+  HTTPResponse response = HTTPResponse::makeErrorResponse(405, "Method Not Allowed",
+                                                          "Use " + allow + " for this API call");
+  response.headers["Allow"] = allow;
+  respond(response);
+}
+
+// Every route, sorted by name and then version so a route is found by binary search
+static constexpr uint16_t GET_ONLY  = HTTPWorker::methodBit(HTTPRequest::GET);
+static constexpr uint16_t POST_ONLY = HTTPWorker::methodBit(HTTPRequest::POST);
+static constexpr auto     ROUTES    = std::to_array<HTTPWorker::Route>({
+    {.name = "ExportSearchHistory", .version = 0, .methods = GET_ONLY,
+     .handler = &HTTPWorker::v0exportSearchHistory},
+    {.name = "GetAutofill", .version = 0, .methods = GET_ONLY,
+     .handler = &HTTPWorker::v0getAutofill},
+    {.name = "GetMetrics", .version = 0, .methods = GET_ONLY,
+     .handler = &HTTPWorker::v0getMetrics},
+    {.name = "GetQuantiles", .version = 0, .methods = GET_ONLY,
+     .handler = &HTTPWorker::v0getQuantiles},
+    {.name = "GetQueryData", .version = 0, .methods = GET_ONLY | POST_ONLY,
+     .handler = &HTTPWorker::v0getQueryData},
+    {.name = "GetQueryID", .version = 0, .methods = GET_ONLY,
+     .handler = &HTTPWorker::v0getQueryID},
+    {.name = "ReportMetrics", .version = 0, .methods = POST_ONLY,
+     .handler = &HTTPWorker::v0reportMetrics},
+    {.name = "ReportSearchResults", .version = 0, .methods = POST_ONLY,
+     .handler = &HTTPWorker::v0reportSearchResults},
+    {.name = "ServerStats", .version = 0, .methods = GET_ONLY,
+     .handler = &HTTPWorker::v0getServerStats},
+    {.name = "SubmitFeedback", .version = 0, .methods = POST_ONLY,
+     .handler = &HTTPWorker::v0submitFeedback},
+    {.name = "metrics", .version = HTTPWorker::UNVERSIONED, .methods = GET_ONLY,
+     .handler = &HTTPWorker::prometheusMetrics},
+});
+
+static constexpr auto routeKey(const HTTPWorker::Route& route) {
+  return std::pair(route.name, route.version);
+}
+static_assert(std::ranges::is_sorted(ROUTES, {}, routeKey), "ROUTES must stay sorted");
+static_assert(ROUTES.size() < ServerStats::MAX_ROUTES, "Every route needs its own stats");
+
+// The route with exactly this name and version, if there is one
+static const HTTPWorker::Route* findRouteKey(std::pair<std::string_view, unsigned int> key) {
+  const auto* route = std::ranges::lower_bound(ROUTES, key, {}, routeKey);
+  return (route != ROUTES.end() && routeKey(*route) == key) ? &*route : nullptr;
+}
+
+const HTTPWorker::Route* HTTPWorker::findRoute(std::string_view target) {
+  // "/v<version>/<name>", or "/<name>" for unversioned routes, looked at in place
+  target = target.substr(0, target.find('?'));
+  if (!target.starts_with("/")) { return nullptr; }
+  const std::string_view versioned = target.substr(1);
+  if (versioned.starts_with("v")) {
+    unsigned int version                 = 0;
+    const auto [version_end, version_ec] =
+        std::from_chars(versioned.data() + 1, versioned.data() + versioned.size(), version);
+    const auto name_start = static_cast<std::size_t>(version_end - versioned.data()) + 1;
+    if (version_ec == std::errc() && name_start <= versioned.size()
+        && versioned[name_start - 1] == '/') {
+      return findRouteKey({versioned.substr(name_start), version});
+    }
+  }
+  return findRouteKey({target.substr(1), UNVERSIONED});
+}
+
+std::size_t HTTPWorker::routeIndex(const Route* route) {
+  return route == nullptr ? ROUTES.size() : static_cast<std::size_t>(route - ROUTES.data());
+}
+
+// The path a route (by routeIndex) is served at
+static std::string routeName(std::size_t index) {
+  if (index >= ROUTES.size()) { return "unrouted"; }
+  const HTTPWorker::Route& route = ROUTES[index];
+  if (route.version == HTTPWorker::UNVERSIONED) { return "/" + std::string(route.name); }
+  return "/v" + std::to_string(route.version) + "/" + std::string(route.name);
+}
+
+// Summary of one phase of handling requests, in microseconds
+static nlohmann::json latencyJSON(const HistogramSummary& latency) {
+  static constexpr double NS_PER_US = 1000;
+  nlohmann::json          json      = {{"mean", latency.mean() / NS_PER_US}};
+  for (const auto& [name, q] : {std::pair("p50", 0.5), std::pair("p90", 0.9),
+                                std::pair("p99", 0.99), std::pair("max", 1.0)}) {
+    json[name] = latency.quantile(q).value_or(0) / NS_PER_US;
+  }
+  return json;
+}
+
+void HTTPWorker::v0getServerStats(const HTTPRequestView& /* request */) const {
+  if (m_services.stats == nullptr) {
+    respond(NO_SERVER_STATS);
+    return;
+  }
+  const ServerStats::Summary summary = m_services.stats->summary();
+
+  nlohmann::json status_codes = nlohmann::json::object();
+  for (const auto& [code, count] : summary.status_codes) {
+    status_codes[std::to_string(code)] = count;
+  }
+  // Only routes which have been used, this request is counted once it is done
+  nlohmann::json routes = nlohmann::json::object();
+  for (std::size_t index = 0; index <= ROUTES.size(); ++index) {
+    const ServerStats::RouteSummary& route = summary.routes[index];
+    if (route.requests == 0) { continue; }
+    nlohmann::json latency = nlohmann::json::object();
+    for (std::size_t phase = 0; phase < ServerStats::NUM_PHASES; ++phase) {
+      latency[ServerStats::phaseName(static_cast<ServerStats::Phase>(phase))] =
+          latencyJSON(route.latency[phase]);
+    }
+    routes[routeName(index)] = {
+        {  "requests", route.requests},
+        {"latency_us",        latency}
+    };
+  }
+  respond(HTTPResponse{
+      200, "OK",
+      {{"uptime_ms", std::chrono::duration_cast<std::chrono::milliseconds>(summary.uptime).count()},
+       {"requests", summary.requests},
+       {"bytes_in", summary.bytes_in},
+       {"bytes_out", summary.bytes_out},
+       {"connections",
+        {{"open", summary.connections_opened - summary.connections_closed},
+         {"opened", summary.connections_opened}}},
+       {"status_codes", status_codes},
+       {"routes", routes}},
+      m_indent
+  });
+}
+
+void HTTPWorker::prometheusMetrics(const HTTPRequestView& /* request */) const {
+  if (m_services.prometheus == nullptr) {
+    respond(NO_PROMETHEUS);
+    return;
+  }
+  HTTPResponse response{200, "OK"};
+  response.body                      = m_services.prometheus->scrape();
+  response.headers["Content-Type"]   = PrometheusRegistry::CONTENT_TYPE;
+  response.headers["Content-Length"] = std::to_string(response.body.size());
+  respond(response);
+}
+
+void HTTPServer::registerMetrics(PrometheusRegistry& registry) const {
+  static constexpr double SECONDS_PER_NS = 1e-9;
+  registry.add([this](PrometheusWriter& out) {
+    // A worker may pick up a connection before its submission is counted
+    const uint64_t started   = m_started.value();
+    const uint64_t submitted = m_submitted.value();
+    out.family("evaluation_http_queued_connections",
+               "Connections with a complete request waiting for a worker", PrometheusWriter::GAUGE);
+    out.sample("evaluation_http_queued_connections", {},
+               submitted > started ? submitted - started : uint64_t{0});
+    if (m_services.stats == nullptr) { return; }
+
+    const ServerStats::Summary summary = m_services.stats->summary();
+    out.family("evaluation_http_open_connections", "Client connections open now",
+               PrometheusWriter::GAUGE);
+    out.sample("evaluation_http_open_connections", {},
+               summary.connections_opened - summary.connections_closed);
+    out.family("evaluation_http_connections_total", "Client connections accepted",
+               PrometheusWriter::COUNTER);
+    out.sample("evaluation_http_connections_total", {}, summary.connections_opened);
+    out.family("evaluation_http_received_bytes_total", "Bytes of requests handled",
+               PrometheusWriter::COUNTER);
+    out.sample("evaluation_http_received_bytes_total", {}, summary.bytes_in);
+    out.family("evaluation_http_sent_bytes_total", "Bytes of responses sent",
+               PrometheusWriter::COUNTER);
+    out.sample("evaluation_http_sent_bytes_total", {}, summary.bytes_out);
+
+    out.family("evaluation_http_requests_total", "Requests handled, by route and status code",
+               PrometheusWriter::COUNTER);
+    for (std::size_t index = 0; index <= ROUTES.size(); ++index) {
+      const std::string name = routeName(index);
+      for (const auto& [code, count] : summary.routes[index].status_codes) {
+        out.sample("evaluation_http_requests_total",
+                   {{"route", name}, {"code", std::to_string(code)}}, count);
+      }
+    }
+    out.family("evaluation_http_request_seconds",
+               "Time spent on each phase of handling a request, by route",
+               PrometheusWriter::SUMMARY);
+    for (std::size_t index = 0; index <= ROUTES.size(); ++index) {
+      const ServerStats::RouteSummary& route = summary.routes[index];
+      if (route.requests == 0) { continue; }
+      const std::string name = routeName(index);
+      for (std::size_t phase = 0; phase < ServerStats::NUM_PHASES; ++phase) {
+        out.summary("evaluation_http_request_seconds",
+                    {{"route", name},
+                     {"phase", ServerStats::phaseName(static_cast<ServerStats::Phase>(phase))}},
+                    route.latency[phase], SECONDS_PER_NS);
+      }
+    }
+  });
 }
@@ -1,10 +1,35 @@
 #pragma once
 
+#include <sys/uio.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <optional>
+#include <span>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
+#include "AutofillIndex.h"
+#include "ByteBuffer.h"
+#include "HTTPParser.h"
+#include "MetricsStore.h"
+#include "PrometheusRegistry.h"
+#include "QueryIDAllocator.h"
+#include "SearchHistoryStore.h"
+#include "ServerStats.h"
+#include "ShardedCounter.h"
 #include "TCPSocket.h"
+#include "WorkerPool.h"
+
+// Built on the HTTP types below, so these can only be declared here
+class LinkAnalysisForwarder;
+class RankingFeed;
 
 // TODO: HEADERS SHOULD NOT CHANGE ORDER (unordered_map is a problem here)
 
@@ -46,6 +71,9 @@ struct HTTPRequest {
 
   HTTPRequest(Method method, std::string_view resource);
 
+  // Copies a parsed request, header names are made lowercase
+  explicit HTTPRequest(const HTTPRequestView& view);
+
   Method                                       method;
   std::string                                  resource;
   std::string                                  version;
@@ -56,12 +84,21 @@ struct HTTPRequest {
 std::string to_string(const HTTPRequest& request);
 
 struct HTTPResponse {
+  // nlohmann's indent for JSON without any whitespace
+  static constexpr int COMPACT_JSON = -1;
+
   HTTPResponse() = default;
 
+  // This will add a zero Content-Length header
   HTTPResponse(unsigned int code, std::string_view status);
 
-  // This will add Content-Type and Content-Length headers
-  HTTPResponse(unsigned int code, std::string_view status, const nlohmann::json& body);
+  // This will add Content-Type and Content-Length headers. The body is compact unless given an
+  // `indent` of zero or more.
+  HTTPResponse(unsigned int code, std::string_view status, const nlohmann::json& body,
+               int indent = COMPACT_JSON);
+
+  // Copies a parsed response, header names are made lowercase
+  explicit HTTPResponse(const HTTPResponseView& view);
 
   // Specifically not a constructor to avoid mistakes.
   // This generates a JSON error response with the given status and message
@@ -77,70 +114,207 @@ struct HTTPResponse {
 
 std::string to_string(const HTTPResponse& response);
 
+// Sends the response with one gathered write, straight from its fields and cached common lines
+bool sendResponse(const TCPSocket& sock, const HTTPResponse& response);
+
+// A client connection, along with any bytes read off of it which have not been handled yet
+struct HTTPConnection {
+  TCPSocket  socket;
+  ByteBuffer buffer;
+  // Progress on the request at the front of the buffer, so partial requests aren't parsed twice
+  HTTPParser parser;
+
+  // Requests this connection may still make before it is closed
+  unsigned int requests_left = 0;
+  // Set once the peer has stopped sending, whatever is buffered is the last request
+  bool peer_closed = false;
+
+  std::chrono::steady_clock::time_point last_active = std::chrono::steady_clock::now();
+  // Spent parsing the request at the front of the buffer so far, by the reactor and the worker
+  uint64_t                              parse_ns    = 0;
+
+  OpenConnection counted;
+};
+
+// Long-lived state the handlers work with, owned outside of the server. Anything left unset is
+// treated as unavailable.
+struct HTTPServices {
+  SearchHistoryStore*    search_history = nullptr;
+  QueryIDAllocator*      query_ids      = nullptr;
+  AutofillIndex*         autofill       = nullptr;
+  LinkAnalysisForwarder* link_analysis  = nullptr;
+  RankingFeed*           ranking        = nullptr;
+  MetricsStore*          metrics        = nullptr;
+  ServerStats*           stats          = nullptr;
+  PrometheusRegistry*    prometheus     = nullptr;
+};
+
 class HTTPWorker {
  public:
-  HTTPWorker(TCPSocket&& sock)
-      : m_socket(std::move(sock)) {}
+  static constexpr unsigned int DEFAULT_MAX_REQUESTS = 1000;
+  // Suggestions given when the request doesn't ask for a number
+  static constexpr std::size_t  DEFAULT_SUGGESTIONS  = 3;
+  // Query IDs which can be asked for in one GetQueryData request
+  static constexpr std::size_t  MAX_QUERY_IDS        = 1000;
+  // Records read from the store for each chunk of an export
+  static constexpr std::size_t  EXPORT_PAGE_SIZE     = 1024;
+  // Quantiles given when the request doesn't ask for any
+  static constexpr const char*  DEFAULT_QUANTILES    = "0.5,0.95,0.99";
+  // Largest indent a client can ask for with `Accept: application/json; indent=<n>`
+  static constexpr int          MAX_JSON_INDENT      = 8;
+
+  // Reads requests straight off of a blocking socket
+  // `json_indent` is used for bodies whose request does not ask for an indent itself
+  HTTPWorker(TCPSocket&& sock, HTTPServices services = {},
+             int json_indent = HTTPResponse::COMPACT_JSON)
+      : m_services(services)
+      , m_json_indent(json_indent)
+      , m_connection{.socket        = std::move(sock),
+                     .buffer        = ByteBuffer(),
+                     .parser        = HTTPParser(),
+                     .requests_left = DEFAULT_MAX_REQUESTS,
+                     .peer_closed   = false,
+                     .last_active   = std::chrono::steady_clock::now(),
+                     .parse_ns      = 0,
+                     .counted       = OpenConnection(services.stats)} {}
+
+  HTTPWorker(HTTPConnection&& connection, HTTPServices services = {},
+             int json_indent = HTTPResponse::COMPACT_JSON)
+      : m_services(services)
+      , m_json_indent(json_indent)
+      , m_connection(std::move(connection)) {}
 
-  void run();
+  // Handles every complete request in the connection buffer (reading more first if the socket
+  // is blocking). Returns true if the connection should be kept open for more requests.
+  bool run();
+
+  // Gives the connection back, along with any partial request which was left in the buffer
+  HTTPConnection release() { return std::move(m_connection); }
 
   static std::optional<HTTPRequest>  parseRequest(TCPSocket& sock);
   static std::optional<HTTPResponse> parseResponse(TCPSocket& sock);
+  // Use the same buffer for every response on a connection, so pipelined responses are not lost
+  static std::optional<HTTPResponse> parseResponse(TCPSocket& sock, ByteBuffer& buffer);
 
-  using Handler = void (HTTPWorker::*)(const HTTPRequest& request) const;
-  static Handler handlerMapper(std::string_view resource) {
-    const std::unordered_map<std::string_view, Handler> map = {
-        {        "/v0/GetAutofill",         &HTTPWorker::v0getAutofill},
-        {         "/v0/GetQueryID",          &HTTPWorker::v0getQueryID},
-        {"/v0/ReportSearchResults", &HTTPWorker::v0reportSearchResults},
-        {     "/v0/SubmitFeedback",      &HTTPWorker::v0submitFeedback},
-        {       "/v0/GetQueryData",        &HTTPWorker::v0getQueryData},
-        {      "/v0/ReportMetrics",       &HTTPWorker::v0reportMetrics},
-    };
-    return (map.contains(resource) ? map.at(resource) : &HTTPWorker::notFound);
-  }
+  // Sends the response, telling the client if the connection is about to be closed
+  bool respond(const HTTPResponse& response) const;
+  // Sends `head` with a chunked body, which `next` fills in a chunk at a time (leaving `chunk`
+  // empty once there is no more), so the body is never held all at once. If `next` returns false
+  // the response is abandoned, and the connection closed so the client knows it was cut short.
+  bool respondChunked(HTTPResponse head, const std::function<bool(std::string& chunk)>& next) const;
 
-  void v0getAutofill(const HTTPRequest& /* request */) const {
-    const auto suggestions = {"Why is RPI so cool?", "I love RPI", "Best Food Near RPI"};
-    m_socket.send(HTTPResponse{200, "OK", {{"suggestions", suggestions}}});
-  }
-  void v0getQueryID(const HTTPRequest& /* request */) const {
-    static unsigned int ID = 0;
-    m_socket.send(HTTPResponse{200, "OK", {{"query_ID", ID++}}});
-  }
-  void v0reportSearchResults(const HTTPRequest& request) const;
-  void v0submitFeedback(const HTTPRequest& /* request */) const {
-    m_socket.send(HTTPResponse{200, "OK"});
+  using Handler = void (HTTPWorker::*)(const HTTPRequestView& request) const;
+  // Routes outside of the API (like the Prometheus scrape) are served at /<name>
+  static constexpr unsigned int UNVERSIONED = std::numeric_limits<unsigned int>::max();
+  // An API call, served at /v<version>/<name> to requests using any of `methods`
+  struct Route {
+    std::string_view name;
+    unsigned int     version;
+    uint16_t         methods;    // A bit for each HTTPRequest::Method, see methodBit
+    Handler          handler;
+  };
+  static constexpr uint16_t methodBit(HTTPRequest::Method method) {
+    return static_cast<uint16_t>(1U << method);
   }
-  void v0getQueryData(const HTTPRequest& /* request */) const {
-    m_socket.send(HTTPResponse{200, "OK", {{"queries", nlohmann::json::array()}}});
-  }
-  void v0reportMetrics(const HTTPRequest& /* request */) const {
-    m_socket.send(HTTPResponse{200, "OK"});
-  }
-  void notFound(const HTTPRequest& /* request */) const {
-    m_socket.send(
-        HTTPResponse::makeErrorResponse(404, "Not Found", "Resource (API function) not found"));
+  // The route for a request target (a query string is ignored), nullptr if there is none
+  static const Route* findRoute(std::string_view target);
+  // Numbers the routes for the server stats, requests which were never routed share the number
+  // one past the last route
+  static std::size_t  routeIndex(const Route* route);
+
+  void v0getAutofill(const HTTPRequestView& request) const;
+  void v0getQueryID(const HTTPRequestView& request) const;
+  void v0reportSearchResults(const HTTPRequestView& request) const;
+  void v0submitFeedback(const HTTPRequestView& /* request */) const {
+    respond(HTTPResponse{200, "OK"});
   }
+  void v0getQueryData(const HTTPRequestView& request) const;
+  void v0exportSearchHistory(const HTTPRequestView& request) const;
+  void v0reportMetrics(const HTTPRequestView& request) const;
+  void v0getMetrics(const HTTPRequestView& request) const;
+  void v0getQuantiles(const HTTPRequestView& request) const;
+  void v0getServerStats(const HTTPRequestView& request) const;
+  void prometheusMetrics(const HTTPRequestView& request) const;
+  void notFound(const HTTPRequestView& request) const;
+  // Lists the methods the route does take in an `Allow` header
+  void methodNotAllowed(const Route& route) const;
 
  private:
-  TCPSocket m_socket;
+  // Handles the request the connection's parser just finished (or failed on)
+  void handle(HTTPParser::Result result);
+  // Every byte of a response goes out through here, so it is all counted in the stats
+  bool send(std::span<iovec> parts) const;
+
+  HTTPServices   m_services;
+  int            m_json_indent;
+  // The indent for the request being handled
+  int            m_indent = HTTPResponse::COMPACT_JSON;
+  HTTPConnection m_connection;
+  // Also set by handlers whose response was cut short
+  mutable bool   m_close = false;
+
+  // Stats for the request being handled, recorded once it is done
+  const Route*          m_route = nullptr;
+  mutable RequestTiming m_timing;
+};
+
+struct HTTPServerConfig {
+  unsigned int num_threads     = 4;
+  unsigned int queue_size      = 64;
+  // Also how long a response may wait on a client which is not reading it
+  unsigned int idle_timeout_ms = 5000;
+  unsigned int max_requests    = HTTPWorker::DEFAULT_MAX_REQUESTS;
+  // Pretty prints every JSON body, for debugging
+  int          json_indent     = HTTPResponse::COMPACT_JSON;
 };
 
 class HTTPServer {
  public:
-  HTTPServer(uint16_t listener_port, int backlog_size)
+  HTTPServer(uint16_t listener_port, int backlog_size, HTTPServerConfig config = {},
+             HTTPServices services = {})
       : m_listener_port(listener_port)
-      , m_backlog_size(backlog_size) {}
+      , m_backlog_size(backlog_size)
+      , m_config(config)
+      , m_services(services) {}
   bool init();
   bool run(int shutdown_fd);
 
+  // Request, connection and queue metrics, from the services' stats. The server must outlive
+  // every scrape of the registry.
+  void registerMetrics(PrometheusRegistry& registry) const;
+
  private:
-  uint16_t m_listener_port;
-  int      m_backlog_size;
+  // Accepts a client and starts watching it for input
+  void acceptClient();
+  // Reads what is available from the client, dispatching it once a full request has arrived
+  void readClient(int fd, WorkerPool<HTTPConnection>& workers);
+  void closeClient(int fd);
+  // Starts watching a connection (new or handed back by a worker) for input
+  bool watchClient(HTTPConnection&& connection);
+  // Called by workers once they are done with a connection that should stay open
+  void returnClient(HTTPConnection&& connection);
+  // Picks up the connections given back by `returnClient`
+  void rewatchReturnedClients();
+  // Closes connections that have not sent anything within the idle timeout
+  void closeIdleClients();
+
+  uint16_t         m_listener_port;
+  int              m_backlog_size;
+  HTTPServerConfig m_config;
+  HTTPServices     m_services;
 
   TCPSocket m_listener_socket;
 
-  const std::unordered_map<std::string, std::function<void(const TCPSocket&, const HTTPRequest&)>>
-      m_handlers;
+  // Clients waiting on a request. Only touched by the thread in `run`.
+  int                                     m_epoll_fd = -1;
+  std::unordered_map<int, HTTPConnection> m_connections;
+
+  // Kept-alive connections on their way back from the workers, `m_wakeup_fd` is signalled for each
+  int                         m_wakeup_fd = -1;
+  std::mutex                  m_returned_mutex;
+  std::vector<HTTPConnection> m_returned;
+
+  // Connections handed to the workers, and picked up by them, so far
+  ShardedCounter m_submitted;
+  ShardedCounter m_started;
 };
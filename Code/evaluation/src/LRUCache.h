@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+// Holds up to `capacity` values, evicting the least recently used one to make room. Not thread
+// safe, callers lock around it.
+template <class Key, class Value> class LRUCache {
+ public:
+  explicit LRUCache(std::size_t capacity)
+      : m_capacity(capacity) {}
+
+  // Returns nullptr if `key` is not cached. The pointer is only good until the next insert.
+  const Value* get(const Key& key);
+  // Leaves the value alone (but counts it as used) if `key` is already cached
+  void         insert(const Key& key, Value value);
+  void         erase(const Key& key);
+
+  std::size_t size() const { return m_index.size(); }
+
+ private:
+  using Entries = std::list<std::pair<Key, Value>>;    // Most recently used first
+
+  std::size_t                                         m_capacity;
+  Entries                                             m_entries;
+  std::unordered_map<Key, typename Entries::iterator> m_index;
+};
+
+template <class Key, class Value> const Value* LRUCache<Key, Value>::get(const Key& key) {
+  auto it = m_index.find(key);
+  if (it == m_index.end()) { return nullptr; }
+  // Moved to the front without copying or reallocating the entry
+  m_entries.splice(m_entries.begin(), m_entries, it->second);
+  return &it->second->second;
+}
+
+template <class Key, class Value> void LRUCache<Key, Value>::insert(const Key& key, Value value) {
+  if (m_capacity == 0) { return; }
+  if (auto it = m_index.find(key); it != m_index.end()) {
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return;
+  }
+  if (m_index.size() >= m_capacity) {
+    m_index.erase(m_entries.back().first);
+    m_entries.pop_back();
+  }
+  m_entries.emplace_front(key, std::move(value));
+  m_index.emplace(key, m_entries.begin());
+}
+
+template <class Key, class Value> void LRUCache<Key, Value>::erase(const Key& key) {
+  auto it = m_index.find(key);
+  if (it == m_index.end()) { return; }
+  m_entries.erase(it->second);
+  m_index.erase(it);
+}
@@ -0,0 +1,64 @@
+#include "LinkAnalysisForwarder.h"
+
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "Logger.h"
+
+LinkAnalysisForwarder::LinkAnalysisForwarder(std::string host, uint16_t port,
+                                             LinkAnalysisConfig config)
+    : m_config(config)
+    , m_client(std::move(host), port, config.client)
+    , m_batches(
+          config.window_ms, [this](const Clicks& clicks) { return send(clicks); },
+          [this](Clicks& pending, Clicks&& failed) { merge(pending, std::move(failed)); }) {}
+
+bool LinkAnalysisForwarder::recordClick(std::string_view link) {
+  std::string key(link);
+  return m_batches.update([&](Clicks& pending) {
+    if (pending.size() >= m_config.max_pending && !pending.contains(key)) {
+      LOG(WARN) << "Too many clicks waiting on Link Analysis, dropping click on " << link;
+      return false;
+    }
+    ++pending[std::move(key)];
+    return true;
+  });
+}
+
+bool LinkAnalysisForwarder::send(const Clicks& clicks) {
+  nlohmann::json links  = nlohmann::json::array();
+  nlohmann::json counts = nlohmann::json::array();
+  for (const auto& [link, count] : clicks) {
+    links.push_back(link);
+    counts.push_back(count);
+  }
+  const nlohmann::json body = {
+      {"list_of_clicked_links",  links},
+      {          "click_count", counts}
+  };
+
+  LOG(DEBUG) << "Sending clicks on " << clicks.size() << " links to Link Analysis";
+  const HTTPClient::Result result =
+      m_client.send(HTTPRequest(HTTPRequest::POST, "/evaluation/update_metadata", body));
+  if (!result.delivered()) {
+    LOG(ERROR) << "Link Analysis did not accept clicks on " << clicks.size() << " links";
+    return false;
+  }
+  return true;
+}
+
+// Links already pending add up, new ones are only kept while there is room
+void LinkAnalysisForwarder::merge(Clicks& pending, Clicks&& failed) const {
+  for (auto& [link, count] : failed) {
+    auto it = pending.find(link);
+    if (it != pending.end()) {
+      it->second += count;
+    } else if (pending.size() < m_config.max_pending) {
+      pending.emplace(link, count);
+    }
+  }
+}
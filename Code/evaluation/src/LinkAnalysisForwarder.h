@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "BatchSender.h"
+#include "HTTPClient.h"
+
+struct LinkAnalysisConfig {
+  // Clicks are gathered for this long, then sent together as one update
+  unsigned int window_ms = 1000;
+  // Distinct links held on to while Link Analysis is unreachable, new links past this are dropped
+  std::size_t  max_pending = 64 * 1024;
+
+  HTTPClientConfig client;
+};
+
+// Tells Link Analysis which links were clicked. Clicks are counted per link and sent in one
+// `update_metadata` call per window from a background thread, so reporting a search never waits
+// on Link Analysis, and a click on a popular link costs it one array entry instead of a request.
+class LinkAnalysisForwarder {
+ public:
+  LinkAnalysisForwarder(std::string host, uint16_t port, LinkAnalysisConfig config = {});
+  ~LinkAnalysisForwarder() { stop(); }
+
+  // DO NOT allow copy or move, the sending thread holds a pointer to this
+  LinkAnalysisForwarder(const LinkAnalysisForwarder&)            = delete;
+  LinkAnalysisForwarder& operator=(const LinkAnalysisForwarder&) = delete;
+  LinkAnalysisForwarder(LinkAnalysisForwarder&&)                 = delete;
+  LinkAnalysisForwarder& operator=(LinkAnalysisForwarder&&)      = delete;
+
+  void start() { m_batches.start(); }
+  // Makes a last attempt at sending whatever is pending, then stops the sending thread
+  void stop() { m_batches.stop(); }
+
+  // Returns false if the click was dropped because too many links are already pending
+  bool recordClick(std::string_view link);
+
+ private:
+  using Clicks = std::unordered_map<std::string, unsigned int>;    // Clicks per link
+
+  // Sends `clicks`, returning false if Link Analysis never accepted them
+  bool send(const Clicks& clicks);
+  void merge(Clicks& pending, Clicks&& failed) const;
+
+  LinkAnalysisConfig m_config;
+  HTTPClient         m_client;
+  // Last, so the sending thread stops before the client goes away
+  BatchSender<Clicks> m_batches;
+};
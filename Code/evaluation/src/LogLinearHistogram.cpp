@@ -0,0 +1,64 @@
+#include "LogLinearHistogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "ShardedCounter.h"
+
+void LogLinearHistogram::record(uint64_t value) {
+  addSingleWriter(m_counts[bucketOf(value)]);
+  addSingleWriter(m_sum, value);
+}
+
+std::size_t LogLinearHistogram::bucketOf(uint64_t value) {
+  if (value < SUB_BUCKETS) { return value; }
+  value                     = std::min<uint64_t>(value, (uint64_t{1} << MAX_BITS) - 1);
+  const unsigned int octave = std::bit_width(value) - 1;    // At least SUB_BUCKET_BITS
+  const uint64_t     sub    = (value >> (octave - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+  return ((octave - SUB_BUCKET_BITS + 1) * SUB_BUCKETS) + sub;
+}
+
+uint64_t LogLinearHistogram::lowerBound(std::size_t bucket) {
+  if (bucket < SUB_BUCKETS) { return bucket; }
+  const std::size_t octave = (bucket / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+  return (SUB_BUCKETS + (bucket % SUB_BUCKETS)) << (octave - SUB_BUCKET_BITS);
+}
+
+uint64_t LogLinearHistogram::width(std::size_t bucket) {
+  if (bucket < SUB_BUCKETS) { return 1; }
+  return uint64_t{1} << ((bucket / SUB_BUCKETS) - 1);
+}
+
+void HistogramSummary::merge(const LogLinearHistogram& histogram) {
+  for (std::size_t bucket = 0; bucket < LogLinearHistogram::BUCKETS; ++bucket) {
+    const uint64_t count = histogram.m_counts[bucket].load(std::memory_order_relaxed);
+    m_counts[bucket] += count;
+    m_count          += count;
+  }
+  m_sum += histogram.m_sum.load(std::memory_order_relaxed);
+}
+
+double HistogramSummary::mean() const {
+  return m_count == 0 ? 0 : static_cast<double>(m_sum) / static_cast<double>(m_count);
+}
+
+std::optional<double> HistogramSummary::quantile(double q) const {
+  if (m_count == 0 || !(q >= 0 && q <= 1)) { return std::nullopt; }
+  // The rank of the value asked for, counting from 1
+  const auto rank =
+      std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(m_count))));
+  uint64_t seen = 0;
+  for (std::size_t bucket = 0; bucket < LogLinearHistogram::BUCKETS; ++bucket) {
+    seen += m_counts[bucket];
+    if (seen >= rank) {
+      return static_cast<double>(LogLinearHistogram::lowerBound(bucket))
+           + (static_cast<double>(LogLinearHistogram::width(bucket) - 1) / 2);
+    }
+  }
+  return std::nullopt;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Counts values (like latencies in nanoseconds) in fixed log-linear buckets: each power of two is
+// split into 2^SUB_BUCKET_BITS equal buckets, as in an HDR histogram. Meant to be written by a
+// single thread, which bumps a bucket with a plain load and store rather than a locked
+// instruction, while any other thread may read it at the same time.
+class LogLinearHistogram {
+ public:
+  static constexpr unsigned int SUB_BUCKET_BITS = 3;
+  static constexpr unsigned int SUB_BUCKETS     = 1U << SUB_BUCKET_BITS;
+  // Anything larger (about 68 seconds in nanoseconds) lands in the last bucket
+  static constexpr unsigned int MAX_BITS        = 36;
+  static constexpr std::size_t  BUCKETS         = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  void record(uint64_t value);
+
+  static std::size_t bucketOf(uint64_t value);
+  // Smallest value which lands in the bucket, and the number of values that do
+  static uint64_t    lowerBound(std::size_t bucket);
+  static uint64_t    width(std::size_t bucket);
+
+ private:
+  friend class HistogramSummary;
+
+  std::array<std::atomic<uint64_t>, BUCKETS> m_counts{};
+  std::atomic<uint64_t>                      m_sum{0};
+};
+
+// A histogram merged from any number of LogLinearHistograms, no longer being written to
+class HistogramSummary {
+ public:
+  void merge(const LogLinearHistogram& histogram);
+
+  uint64_t count() const { return m_count; }
+  uint64_t sum() const { return m_sum; }
+  double   mean() const;
+  // Middle of the bucket `q` of the way through the recorded values, nullopt if there are none
+  std::optional<double> quantile(double q) const;
+  // Middle of the highest bucket which was hit
+  std::optional<double> max() const { return quantile(1); }
+
+ private:
+  std::array<uint64_t, LogLinearHistogram::BUCKETS> m_counts{};
+  uint64_t                                          m_count = 0;
+  uint64_t                                          m_sum   = 0;
+};
@@ -1,6 +1,14 @@
 #include "Logger.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
 #include <filesystem>
 #include <iomanip>
 #include <ios>
@@ -9,16 +17,160 @@
 #include <mutex>
 #include <ostream>
 #include <shared_mutex>
+#include <span>
+#include <sstream>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
-#include "TimeUtil.h"
+#include "MPSCRingBuffer.h"
 
 static constexpr unsigned int LEVEL_FMT_WIDTH   = 8;
 static constexpr unsigned int TIME_FMT_WIDTH    = 25;
 static constexpr unsigned int FULL_HEADER_WIDTH = 100;
 
+// Messages handed to the logs at once by the background writer
+static constexpr std::size_t ASYNC_BATCH_SIZE = 256;
+
+// Formatted the same as current_time(), into a buffer that is good until the thread's next call.
+// Only the milliseconds are redone for every message, the rest only changes once a second.
+static std::string_view formatTime(std::chrono::system_clock::time_point time) {
+  static constexpr std::size_t MILLIS_WIDTH = 4;    // ".123"
+  thread_local std::array<char, 32> buffer{};        // NOLINT(*-magic-numbers)
+  thread_local std::time_t          cached_second = -1;
+  thread_local std::size_t          seconds_size  = 0;
+
+  const auto since_epoch = std::chrono::duration_cast<std::chrono::milliseconds>(
+      time.time_since_epoch());
+  const auto second = static_cast<std::time_t>(
+      std::chrono::floor<std::chrono::seconds>(since_epoch).count());
+  if (second != cached_second) {
+    tm time_struct{};
+    localtime_r(&second, &time_struct);
+    seconds_size  = std::strftime(buffer.data(), buffer.size(), "%F %T", &time_struct);
+    cached_second = second;
+  }
+  const auto millis = static_cast<int>((since_epoch - std::chrono::seconds(second)).count());
+  std::snprintf(&buffer.at(seconds_size), MILLIS_WIDTH + 1, ".%03d", millis);
+  return {buffer.data(), seconds_size + MILLIS_WIDTH};
+}
+
+// Hands messages from any thread to one background thread, which writes them to the logs in
+// batches so each log is flushed once per batch rather than once per message
+class Logger::AsyncWriter {
+ public:
+  explicit AsyncWriter(AsyncLogConfig config)
+      : m_config(config)
+      , m_buffer(config.capacity)
+      , m_thread(&AsyncWriter::run, this) {}
+
+  ~AsyncWriter() {
+    {
+      const std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+  }
+
+  // DO NOT allow copy or move, the background thread holds a pointer to this
+  AsyncWriter(const AsyncWriter&)            = delete;
+  AsyncWriter& operator=(const AsyncWriter&) = delete;
+  AsyncWriter(AsyncWriter&&)                 = delete;
+  AsyncWriter& operator=(AsyncWriter&&)      = delete;
+
+  void push(Record&& record) {
+    const bool critical = record.level == CRITICAL;
+    while (!m_buffer.tryPush(std::move(record))) {
+      // CRITICAL messages are never dropped
+      if (m_config.overflow == AsyncLogConfig::DROP && !critical) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        droppedCount().add();
+        return;
+      }
+      m_wake.notify_one();
+      std::this_thread::yield();
+    }
+    if (critical) { flush(); }
+  }
+
+  // Waits for everything pushed before this was called
+  void flush() {
+    // Messages are written in the order they claimed their slots, so once this many are written
+    // so are all of the ones before the call
+    const uint64_t               target = m_buffer.claimed();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_flush_requested = true;
+    m_wake.notify_one();
+    m_written_cv.wait(lock, [&] { return m_written >= target || m_stopping; });
+  }
+
+  std::size_t queued() const {
+    return m_buffer.claimed() - m_popped.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void run() {
+    std::vector<Record> batch;
+    batch.reserve(ASYNC_BATCH_SIZE);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      const bool stopping = m_stopping;
+      m_flush_requested   = false;
+      lock.unlock();
+
+      uint64_t written = 0;
+      Record   record;
+      while (m_buffer.tryPop(record)) {
+        addSingleWriter(m_popped);
+        batch.push_back(std::move(record));
+        if (batch.size() == ASYNC_BATCH_SIZE) { written += writeBatch(batch); }
+      }
+      written += writeBatch(batch);
+      if (const uint64_t dropped = m_dropped.exchange(0, std::memory_order_relaxed); dropped > 0) {
+        std::ostringstream msg;
+        msg << "[" << std::setw(LEVEL_FMT_WIDTH) << toStr(WARN) << "] Dropped " << dropped
+            << " log messages, the background writer fell behind";
+        Workers::log(Record{
+            .level = WARN, .time = std::chrono::system_clock::now(), .msg = msg.str()});
+      }
+
+      lock.lock();
+      m_written += written;
+      m_written_cv.notify_all();
+      if (stopping) { return; }
+      if (!m_flush_requested) {
+        m_wake.wait_for(lock, std::chrono::milliseconds(m_config.flush_interval_ms),
+                        [&] { return m_stopping || m_flush_requested; });
+      }
+    }
+  }
+
+  static uint64_t writeBatch(std::vector<Record>& batch) {
+    const uint64_t size = batch.size();
+    if (size > 0) { Workers::log(batch); }
+    batch.clear();
+    return size;
+  }
+
+  AsyncLogConfig         m_config;
+  MPSCRingBuffer<Record> m_buffer;
+  std::atomic<uint64_t>  m_dropped = 0;    // Since the last warning about it
+  // Only written by the background thread
+  std::atomic<uint64_t>  m_popped  = 0;
+
+  std::mutex              m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_written_cv;
+  uint64_t                m_written         = 0;
+  bool                    m_flush_requested = false;
+  bool                    m_stopping        = false;
+
+  std::thread m_thread;
+};
+
 Logger::Logger(LogLevel level, const std::filesystem::path& path, int line,
                std::string_view function)
     : m_level(level) {
@@ -29,7 +181,42 @@ Logger::Logger(LogLevel level, const std::filesystem::path& path, int line,
 Logger::~Logger() {
   std::string msg_str = m_buffer.str();
   std::erase(msg_str, '\r');
-  Workers::log(m_level, msg_str);
+  Record record{
+      .level = m_level, .time = std::chrono::system_clock::now(), .msg = std::move(msg_str)};
+  if (AsyncWriter* async = asyncWriter().load(std::memory_order_acquire); async != nullptr) {
+    async->push(std::move(record));
+    return;
+  }
+  Workers::log(record);
+}
+
+void Logger::startAsync(AsyncLogConfig config) {
+  stopAsync();
+  // The writer still writes to the logs when it is destroyed at exit
+  Workers::create();
+  ownedAsyncWriter() = std::make_unique<AsyncWriter>(config);
+  asyncWriter().store(ownedAsyncWriter().get(), std::memory_order_release);
+}
+
+void Logger::stopAsync() {
+  asyncWriter().store(nullptr, std::memory_order_release);
+  ownedAsyncWriter().reset();
+}
+
+void Logger::flush() {
+  if (AsyncWriter* async = asyncWriter().load(std::memory_order_acquire); async != nullptr) {
+    async->flush();
+  }
+}
+
+std::size_t Logger::queuedMessages() {
+  const AsyncWriter* async = asyncWriter().load(std::memory_order_acquire);
+  return async != nullptr ? async->queued() : 0;
+}
+
+std::unique_ptr<Logger::AsyncWriter>& Logger::ownedAsyncWriter() {
+  static std::unique_ptr<AsyncWriter> writer;
+  return writer;
 }
 
 void Logger::Workers::addWorker(const std::filesystem::path& path, LogLevel level) {
@@ -39,28 +226,50 @@ void Logger::Workers::addWorker(const std::filesystem::path& path, LogLevel leve
   } else {
     workers().try_emplace(path, std::make_unique<FileWorker>(level, path));
   }
+  updateMaxLevel();
 }
 
 void Logger::Workers::setLevel(const std::filesystem::path& path, LogLevel level) {
   const std::lock_guard<std::shared_mutex> lock(mutex());
   workers().at(path)->setLevel(level);
+  updateMaxLevel();
 }
 
 void Logger::Workers::removeWorker(const std::filesystem::path& path) {
   const std::lock_guard<std::shared_mutex> lock(mutex());
   workers().erase(path);
+  updateMaxLevel();
 }
 
-void Logger::Workers::log(LogLevel level, std::string_view msg) {
+void Logger::Workers::updateMaxLevel() {
+  int max_level = CRITICAL - 1;
+  for (auto& [_, worker] : workers()) { max_level = std::max<int>(max_level, worker->level()); }
+  maxLevel().store(max_level, std::memory_order_relaxed);
+}
+
+void Logger::Workers::log(const Record& record) {
   const std::shared_lock<std::shared_mutex> lock(mutex());
-  for (auto& [_, worker] : workers()) { worker->log(level, msg); }
+  const std::string_view                    time = formatTime(record.time);
+  for (auto& [_, worker] : workers()) {
+    worker->log(record.level, time, record.msg);
+    worker->flush();
+  }
 }
 
-void Logger::Workers::Worker::log(LogLevel level, std::string_view msg) {
+void Logger::Workers::log(std::span<const Record> records) {
+  const std::shared_lock<std::shared_mutex> lock(mutex());
+  for (const Record& record : records) {
+    const std::string_view time = formatTime(record.time);
+    for (auto& [_, worker] : workers()) { worker->log(record.level, time, record.msg); }
+  }
+  for (auto& [_, worker] : workers()) { worker->flush(); }
+}
+
+void Logger::Workers::Worker::log(LogLevel level, std::string_view time, std::string_view msg) {
   const std::lock_guard<std::mutex> lock(m_mutex);
   if (level > m_level) { return; }
   while (msg.back() == '\n') { msg.remove_suffix(1); }
-  logTime();
+  logTime(time);
   stream() << log_color(level);
   std::size_t start = 0;
   while (start < msg.size()) {
@@ -73,21 +282,34 @@ void Logger::Workers::Worker::log(LogLevel level, std::string_view msg) {
   stream() << reset_color() << '\n';
 }
 
+void Logger::Workers::Worker::flush() {
+  const std::lock_guard<std::mutex> lock(m_mutex);
+  stream().flush();
+}
+
 void Logger::Workers::Worker::setLevel(LogLevel level) {
   const std::lock_guard<std::mutex> lock(m_mutex);
   logTime();
-  stream() << "Changing log level from " << toStr(m_level) << " to " << toStr(level) << '\n';
+  stream() << "Changing log level from " << toStr(m_level) << " to " << toStr(level) << std::endl;
   m_level = level;
 }
 
-void Logger::Workers::Worker::logTime() { stream() << current_time() << " | "; }
+LogLevel Logger::Workers::Worker::level() {
+  const std::lock_guard<std::mutex> lock(m_mutex);
+  return m_level;
+}
+
+void Logger::Workers::Worker::logTime() { logTime(formatTime(std::chrono::system_clock::now())); }
+
+void Logger::Workers::Worker::logTime(std::string_view time) { stream() << time << " | "; }
 
 void Logger::Workers::Worker::logOpeningMessage(std::string_view location) {
   stream() << std::string(TIME_FMT_WIDTH, '-') << '\n';
   logTime();
   stream() << std::string(FULL_HEADER_WIDTH - TIME_FMT_WIDTH, '-') << '\n';
   logTime();
-  stream() << "Opening \"" << location << "\" for logging at level " << toStr(m_level) << '\n';
+  stream() << "Opening \"" << location << "\" for logging at level " << toStr(m_level)
+           << std::endl;
 }
 
 Logger::Workers::FileWorker::FileWorker(LogLevel level, const std::filesystem::path& path)
@@ -95,8 +317,8 @@ Logger::Workers::FileWorker::FileWorker(LogLevel level, const std::filesystem::p
   if (!std::filesystem::exists(path) && path.has_parent_path()) {
     std::filesystem::create_directories(path.parent_path());
   }
+  // Buffered, messages are flushed one at a time or a batch at a time by the caller
   m_stream.open(path, std::ios::app);
-  m_stream << std::unitbuf;
   if (!m_stream.good()) { std::cerr << "Unable to open log at " << path << '\n'; }
   logOpeningMessage(path.string());
 }
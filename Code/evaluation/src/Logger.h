@@ -1,22 +1,52 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <span>
 #include <sstream>
 #include <string>
+#include <string_view>
 
+#include "ShardedCounter.h"
+
+// Statements logging past this level (a LogLevel name) are compiled out, nothing after `<<` is
+// ever evaluated
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL TRACE
+#endif
+
+// Below that, nothing is formatted unless some log wants the level
 // NOLINTNEXTLINE(cppcoreguidelines-macro-usage): Macro needed for log values
-#define LOG(level) \
-  if (true) Logger(level, __FILE__, __LINE__, static_cast<const char*>(__FUNCTION__)).stream()
+#define LOG(level)                                                                          \
+  if constexpr ((level) > LogLevel::LOG_COMPILED_LEVEL) {                                   \
+  } else if (!Logger::enabled(level)) {                                                     \
+  } else                                                                                    \
+    Logger(level, __FILE__, __LINE__, static_cast<const char*>(__FUNCTION__)).stream()
 
 enum LogLevel : char { CRITICAL, ERROR, WARN, INFO, DEBUG, TRACE };
 
 std::string_view toStr(LogLevel level);
 
+struct AsyncLogConfig {
+  // What a message does when the background thread has fallen too far behind
+  enum Overflow : uint8_t { BLOCK, DROP };
+
+  // Messages which can be waiting to be written, rounded up to a power of two
+  std::size_t  capacity          = 8192;
+  Overflow     overflow          = BLOCK;
+  // How often the background thread wakes up to write out whatever has been logged
+  unsigned int flush_interval_ms = 10;
+};
+
 class Logger {
  public:
   Logger(LogLevel level, const std::filesystem::path& path, int line, std::string_view function);
@@ -44,13 +74,41 @@ class Logger {
 
   static void removeConsole() { Workers::removeWorker(""); }
 
+  // From here on messages are queued for a background thread, which writes them to every log in
+  // batches. CRITICAL messages are written out before LOG returns. Start and stop this while no
+  // other threads are logging (before starting them, or after joining them).
+  static void startAsync(AsyncLogConfig config = {});
+  // Writes out everything still queued, then goes back to writing each message as it is logged
+  static void stopAsync();
+  // Returns once everything logged so far has been written
+  static void flush();
+
+  // Messages waiting for the background thread, 0 if there isn't one
+  static std::size_t queuedMessages();
+  // Messages dropped by the background thread falling behind, ever
+  static uint64_t    droppedMessages() { return droppedCount().value(); }
+
   std::ostream& stream() { return m_buffer; }
 
+  // True if any log would write a message at `level`
+  static bool enabled(LogLevel level) {
+    return level <= maxLevel().load(std::memory_order_relaxed);
+  }
+
  private:
   LogLevel m_level;
 
   std::ostringstream m_buffer;
 
+  // A message, along with when it was logged
+  struct Record {
+    LogLevel                              level = INFO;
+    std::chrono::system_clock::time_point time;
+    std::string                           msg;
+  };
+
+  class AsyncWriter;
+
   class Workers {
    public:
     static void addWorker(const std::filesystem::path& path, LogLevel level = INFO);
@@ -59,7 +117,20 @@ class Logger {
 
     static void removeWorker(const std::filesystem::path& path);
 
-    static void log(LogLevel level, std::string_view msg);
+    // Call with the lock held, after any change to the logs or their levels
+    static void updateMaxLevel();
+
+    // Each log is flushed after every message
+    static void log(const Record& record);
+    // Each log is flushed once, after all of the messages
+    static void log(std::span<const Record> records);
+
+    // Creates the (static) set of logs if it doesn't exist yet, so it outlives anything that
+    // writes to it and is created after this
+    static void create() {
+      mutex();
+      workers();
+    }
 
    private:
     class Worker {
@@ -74,12 +145,18 @@ class Logger {
       Worker(const Worker&&)            = delete;
       Worker& operator=(const Worker&&) = delete;
 
-      void log(LogLevel level, std::string_view msg);
+      // Left in the stream's buffer until flushed
+      void log(LogLevel level, std::string_view time, std::string_view msg);
+
+      void flush();
 
       void setLevel(LogLevel level);
 
+      LogLevel level();
+
      protected:
       void logTime();
+      void logTime(std::string_view time);
 
       void logOpeningMessage(std::string_view location);
 
@@ -129,6 +206,25 @@ class Logger {
       return workers;
     }
   };
+
+  // The most verbose level of any log, kept up to date by Workers. Below CRITICAL with no logs.
+  static std::atomic<int>& maxLevel() {
+    static std::atomic<int> level = CRITICAL - 1;
+    return level;
+  }
+
+  // Checked by every message, only set between startAsync and stopAsync
+  static std::atomic<AsyncWriter*>& asyncWriter() {
+    static std::atomic<AsyncWriter*> writer = nullptr;
+    return writer;
+  }
+
+  static std::unique_ptr<AsyncWriter>& ownedAsyncWriter();
+
+  static ShardedCounter& droppedCount() {
+    static ShardedCounter dropped;
+    return dropped;
+  }
 };
 
 class ScopedConsoleLogger {
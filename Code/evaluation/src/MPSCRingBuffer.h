@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded queue which any number of threads push to and one thread pops from, without locks (a
+// Vyukov queue). Each slot carries a sequence number saying whose turn it is: producers claim a
+// slot by advancing the head, then publish it by bumping its sequence, so a slow producer only
+// holds up the consumer, never the other producers.
+template <class T> class MPSCRingBuffer {
+ public:
+  // `capacity` is rounded up to a power of two
+  explicit MPSCRingBuffer(std::size_t capacity);
+
+  // DO NOT allow copy or move, producers and the consumer hold a reference to this
+  MPSCRingBuffer(const MPSCRingBuffer&)            = delete;
+  MPSCRingBuffer& operator=(const MPSCRingBuffer&) = delete;
+  MPSCRingBuffer(MPSCRingBuffer&&)                 = delete;
+  MPSCRingBuffer& operator=(MPSCRingBuffer&&)      = delete;
+
+  // Returns false (and leaves `value` untouched) if the buffer is full. Safe from any thread.
+  bool tryPush(T&& value);
+  // Returns false if there is nothing to pop. Only ever call from one thread at a time.
+  bool tryPop(T& value);
+
+  std::size_t capacity() const { return m_mask + 1; }
+  // Pushes which have claimed a slot so far, including any still moving their value in
+  std::size_t claimed() const { return m_head.load(std::memory_order_acquire); }
+
+ private:
+  struct Slot {
+    // Equal to the position of the push which may fill it, one past that once it is full
+    std::atomic<std::size_t> sequence;
+    T                        value;
+  };
+
+  std::unique_ptr<Slot[]> m_slots;    // NOLINT(*-avoid-c-arrays)
+  std::size_t             m_mask;
+
+  // Kept on their own cache lines, producers hammer the head while the consumer owns the tail
+  alignas(64) std::atomic<std::size_t> m_head = 0;    // NOLINT(*-magic-numbers)
+  alignas(64) std::size_t m_tail              = 0;    // NOLINT(*-magic-numbers)
+};
+
+template <class T>
+MPSCRingBuffer<T>::MPSCRingBuffer(std::size_t capacity)
+    : m_slots(std::make_unique<Slot[]>(std::bit_ceil(std::max<std::size_t>(capacity, 1))))
+    , m_mask(std::bit_ceil(std::max<std::size_t>(capacity, 1)) - 1) {
+  for (std::size_t i = 0; i <= m_mask; ++i) {
+    m_slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <class T> bool MPSCRingBuffer<T>::tryPush(T&& value) {
+  std::size_t position = m_head.load(std::memory_order_relaxed);
+  while (true) {
+    Slot&             slot     = m_slots[position & m_mask];
+    const std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    const auto        lag      = static_cast<std::intptr_t>(sequence - position);
+    if (lag == 0) {
+      if (m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        slot.value = std::move(value);
+        slot.sequence.store(position + 1, std::memory_order_release);
+        return true;
+      }
+      // `position` was reloaded by the failed exchange
+    } else if (lag < 0) {
+      // The consumer has not gotten to the value from a lap ago
+      return false;
+    } else {
+      position = m_head.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <class T> bool MPSCRingBuffer<T>::tryPop(T& value) {
+  Slot& slot = m_slots[m_tail & m_mask];
+  if (slot.sequence.load(std::memory_order_acquire) != m_tail + 1) { return false; }
+  value = std::move(slot.value);
+  // Free for the push one lap from now
+  slot.sequence.store(m_tail + m_mask + 1, std::memory_order_release);
+  ++m_tail;
+  return true;
+}
@@ -0,0 +1,204 @@
+#include "MetricsStore.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Logger.h"
+#include "QuantileSketch.h"
+#include "TimeSeriesBlock.h"
+
+void MetricRollup::add(double value) {
+  ++count;
+  sum += value;
+  min = std::min(min, value);
+  max = std::max(max, value);
+}
+
+// Far past any real time, but far enough from the limits of int64_t that rounding to a bucket
+// cannot overflow
+static constexpr int64_t MAX_TIME_MS = std::numeric_limits<int64_t>::max() / 2;
+
+// Rounds down, so times before the epoch land in the right bucket too
+static int64_t bucketStart(int64_t timestamp_ms, int64_t bucket_ms) {
+  timestamp_ms   = std::clamp(timestamp_ms, -MAX_TIME_MS, MAX_TIME_MS);
+  int64_t bucket = timestamp_ms / bucket_ms;
+  if (timestamp_ms % bucket_ms < 0) { --bucket; }
+  return bucket * bucket_ms;
+}
+
+template <typename Bucket>
+static void addToBucket(std::map<int64_t, Bucket>& buckets, int64_t start_ms, double value,
+                        std::size_t max_buckets) {
+  auto [it, inserted]        = buckets.try_emplace(start_ms);
+  it->second.rollup.start_ms = start_ms;
+  it->second.rollup.add(value);
+  it->second.sketch.add(value);
+  if (inserted && buckets.size() > max_buckets) { buckets.erase(buckets.begin()); }
+}
+
+template <typename Visit>
+void MetricsStore::forEachBucket(const std::map<int64_t, Bucket>& buckets, int64_t bucket_ms,
+                                 int64_t from_ms, int64_t to_ms, Visit&& visit) {
+  // Starting with the bucket `from_ms` falls in, which may begin before it
+  from_ms = std::max(from_ms, -MAX_TIME_MS);
+  auto it = buckets.upper_bound(from_ms);
+  if (it != buckets.begin() && std::prev(it)->first > from_ms - bucket_ms) { --it; }
+  for (; it != buckets.end() && it->first < to_ms; ++it) { visit(it->second); }
+}
+
+bool MetricsStore::record(std::string_view component, std::string_view label,
+                          int64_t timestamp_ms, const nlohmann::json& value) {
+  Series* target = series(component, label);
+  if (target == nullptr) { return false; }
+  if (value.is_number()) {
+    const std::lock_guard<std::mutex> lock(target->mutex);
+    addNumber(*target, timestamp_ms, value.get<double>());
+    return true;
+  }
+
+  std::string dumped = value.dump();
+  // It would push out everything else, and still not fit
+  if (dumped.size() > m_config.max_event_bytes) {
+    LOG(WARN) << "Dropping " << dumped.size() << " byte event for " << component << " "
+              << label << ", larger than a series may hold";
+    return false;
+  }
+  const std::lock_guard<std::mutex> lock(target->mutex);
+  target->event_bytes += dumped.size();
+  target->events.push_back({.timestamp_ms = timestamp_ms, .value = std::move(dumped)});
+  while (target->events.size() > m_config.max_events
+         || target->event_bytes > m_config.max_event_bytes) {
+    target->event_bytes -= target->events.front().value.size();
+    target->events.pop_front();
+  }
+  return true;
+}
+
+std::vector<MetricRollup> MetricsStore::rollups(std::string_view component, std::string_view label,
+                                                Resolution resolution, int64_t from_ms,
+                                                int64_t to_ms) const {
+  std::vector<MetricRollup> result;
+  const Series*             target = find(component, label);
+  if (target == nullptr) { return result; }
+
+  const std::lock_guard<std::mutex> lock(target->mutex);
+  forEachBucket(resolution == HOUR ? target->hours : target->minutes,
+                resolution == HOUR ? HOUR_MS : MINUTE_MS, from_ms, to_ms,
+                [&](const Bucket& bucket) { result.push_back(bucket.rollup); });
+  return result;
+}
+
+std::vector<MetricPoint> MetricsStore::points(std::string_view component, std::string_view label,
+                                              int64_t from_ms, int64_t to_ms) const {
+  std::vector<MetricPoint> result;
+  const Series*            target = find(component, label);
+  if (target == nullptr) { return result; }
+
+  const std::lock_guard<std::mutex> lock(target->mutex);
+  for (const TimeSeriesBlock& block : target->blocks) {
+    if (block.maxTimestamp() < from_ms || block.minTimestamp() >= to_ms) { continue; }
+    TimeSeriesBlock::Reader reader = block.reader();
+    MetricPoint             point{.timestamp_ms = 0, .value = 0};
+    while (reader.next(point.timestamp_ms, point.value)) {
+      if (point.timestamp_ms >= from_ms && point.timestamp_ms < to_ms) { result.push_back(point); }
+    }
+  }
+  // Reports can arrive out of order, keeping the order they arrived in for equal times
+  std::ranges::stable_sort(result, {}, &MetricPoint::timestamp_ms);
+  return result;
+}
+
+std::vector<MetricEvent> MetricsStore::events(std::string_view component, std::string_view label,
+                                              int64_t from_ms, int64_t to_ms) const {
+  std::vector<MetricEvent> result;
+  const Series*            target = find(component, label);
+  if (target == nullptr) { return result; }
+
+  const std::lock_guard<std::mutex> lock(target->mutex);
+  for (const MetricEvent& event : target->events) {
+    if (event.timestamp_ms >= from_ms && event.timestamp_ms < to_ms) { result.push_back(event); }
+  }
+  std::ranges::stable_sort(result, {}, &MetricEvent::timestamp_ms);
+  return result;
+}
+
+QuantileSketch MetricsStore::quantiles(std::string_view component, std::string_view label,
+                                       int64_t from_ms, int64_t to_ms) const {
+  QuantileSketch result;
+  const Series*  target = find(component, label);
+  if (target == nullptr || from_ms >= to_ms) { return result; }
+
+  const auto merge = [&](const Bucket& bucket) { result.merge(bucket.sketch); };
+  // The hours which start and end inside the range
+  const int64_t from_hour  = bucketStart(from_ms, HOUR_MS);
+  const int64_t first_hour = from_hour == from_ms ? from_hour : from_hour + HOUR_MS;
+  const int64_t end_hour   = bucketStart(to_ms, HOUR_MS);
+
+  const std::lock_guard<std::mutex> lock(target->mutex);
+  if (first_hour >= end_hour) {
+    forEachBucket(target->minutes, MINUTE_MS, from_ms, to_ms, merge);
+    return result;
+  }
+  forEachBucket(target->minutes, MINUTE_MS, from_ms, first_hour, merge);
+  forEachBucket(target->hours, HOUR_MS, first_hour, end_hour, merge);
+  forEachBucket(target->minutes, MINUTE_MS, end_hour, to_ms, merge);
+  return result;
+}
+
+std::string MetricsStore::key(std::string_view component, std::string_view label) {
+  std::string key;
+  key.reserve(component.size() + 1 + label.size());
+  key.append(component).push_back('\0');
+  key.append(label);
+  return key;
+}
+
+MetricsStore::Series* MetricsStore::series(std::string_view component, std::string_view label) {
+  const std::string key = MetricsStore::key(component, label);
+  {
+    const std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto                                      it = m_series.find(key);
+    if (it != m_series.end()) { return it->second.get(); }
+  }
+  // Another thread may have added it in between
+  const std::unique_lock<std::shared_mutex> lock(m_mutex);
+  if (auto it = m_series.find(key); it != m_series.end()) { return it->second.get(); }
+  if (m_series.size() >= m_config.max_series) {
+    LOG(WARN) << "Already holding " << m_series.size() << " metric series, not adding "
+              << component << " " << label;
+    return nullptr;
+  }
+  return m_series.emplace(key, std::make_unique<Series>()).first->second.get();
+}
+
+const MetricsStore::Series* MetricsStore::find(std::string_view component,
+                                               std::string_view label) const {
+  const std::shared_lock<std::shared_mutex> lock(m_mutex);
+  auto                                      it = m_series.find(key(component, label));
+  return it == m_series.end() ? nullptr : it->second.get();
+}
+
+void MetricsStore::addNumber(Series& series, int64_t timestamp_ms, double value) const {
+  if (series.blocks.empty() || series.blocks.back().full()) {
+    if (!series.blocks.empty()) { series.blocks.back().shrink(); }
+    series.blocks.emplace_back();
+    // The block being filled does not count towards the limit
+    if (series.blocks.size() > m_config.max_blocks + 1) { series.blocks.pop_front(); }
+  }
+  series.blocks.back().append(timestamp_ms, value);
+
+  addToBucket(series.minutes, bucketStart(timestamp_ms, MINUTE_MS), value,
+              m_config.max_minute_rollups);
+  addToBucket(series.hours, bucketStart(timestamp_ms, HOUR_MS), value, m_config.max_hour_rollups);
+}
+
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "QuantileSketch.h"
+#include "TimeSeriesBlock.h"
+
+// Summary of the numeric values reported in one time bucket
+struct MetricRollup {
+  int64_t  start_ms = 0;
+  uint64_t count    = 0;
+  double   sum      = 0;
+  double   min      = std::numeric_limits<double>::infinity();
+  double   max      = -std::numeric_limits<double>::infinity();
+
+  void add(double value);
+};
+
+struct MetricPoint {
+  int64_t timestamp_ms;
+  double  value;
+};
+
+// A metric whose value is not a number, kept as compact JSON
+struct MetricEvent {
+  int64_t     timestamp_ms;
+  std::string value;
+};
+
+struct MetricsConfig {
+  // Distinct (component, label) pairs, reports for a new one past this are turned away
+  std::size_t max_series = 1024;
+  // Full blocks kept per series (TimeSeriesBlock::CAPACITY points each), the oldest go first
+  std::size_t max_blocks = 1024;
+  // JSON values kept per series, the oldest go first once either limit is passed
+  std::size_t max_events      = 64 * 1024;
+  std::size_t max_event_bytes = 1024 * 1024;
+  // Rollups (and quantile sketches) kept per series, a week of minutes and a year of hours
+  std::size_t max_minute_rollups = 7 * 24 * 60;
+  std::size_t max_hour_rollups   = 366 * 24;
+};
+
+// Holds the metrics reported by the other components, one series per (component, label).
+// Numbers are appended to compressed columnar blocks, and rolled up (and sketched for quantiles)
+// per minute and per hour as they arrive so summaries never have to scan the raw points. Anything
+// else (like a broken link report) is kept to the side as JSON.
+class MetricsStore {
+ public:
+  enum Resolution { MINUTE, HOUR };
+
+  static constexpr int64_t MINUTE_MS = 60 * 1000;
+  static constexpr int64_t HOUR_MS   = 60 * MINUTE_MS;
+
+  explicit MetricsStore(MetricsConfig config = {})
+      : m_config(config) {}
+
+  // DO NOT allow copy or move, the handlers share one store
+  MetricsStore(const MetricsStore&)            = delete;
+  MetricsStore& operator=(const MetricsStore&) = delete;
+  MetricsStore(MetricsStore&&)                 = delete;
+  MetricsStore& operator=(MetricsStore&&)      = delete;
+
+  // Returns false if the value was not stored, because it would start a series past the limit
+  // or is larger than a series may hold
+  bool record(std::string_view component, std::string_view label, int64_t timestamp_ms,
+              const nlohmann::json& value);
+
+  // Everything below covers [from_ms, to_ms), in time order
+  std::vector<MetricRollup> rollups(std::string_view component, std::string_view label,
+                                    Resolution resolution, int64_t from_ms, int64_t to_ms) const;
+  std::vector<MetricPoint>  points(std::string_view component, std::string_view label,
+                                   int64_t from_ms, int64_t to_ms) const;
+  std::vector<MetricEvent>  events(std::string_view component, std::string_view label,
+                                   int64_t from_ms, int64_t to_ms) const;
+  // Merges the hourly sketches for the hours wholly inside the range, and the minutely ones for
+  // the ends, so the cost depends on the length of the range rather than how much was reported
+  QuantileSketch            quantiles(std::string_view component, std::string_view label,
+                                      int64_t from_ms, int64_t to_ms) const;
+
+ private:
+  struct Bucket {
+    MetricRollup   rollup;
+    QuantileSketch sketch;
+  };
+  struct Series {
+    mutable std::mutex          mutex;
+    std::deque<TimeSeriesBlock> blocks;    // The last one is still being filled
+    std::map<int64_t, Bucket>   minutes;
+    std::map<int64_t, Bucket>   hours;
+    std::deque<MetricEvent>     events;
+    std::size_t                 event_bytes = 0;    // Of every event's value
+  };
+
+  static std::string key(std::string_view component, std::string_view label);
+  // Adds the series if there is room for it, otherwise returns nullptr
+  Series*            series(std::string_view component, std::string_view label);
+  const Series*      find(std::string_view component, std::string_view label) const;
+
+  void addNumber(Series& series, int64_t timestamp_ms, double value) const;
+  // Visits the buckets which overlap [from_ms, to_ms)
+  template <typename Visit>
+  static void forEachBucket(const std::map<int64_t, Bucket>& buckets, int64_t bucket_ms,
+                            int64_t from_ms, int64_t to_ms, Visit&& visit);
+
+  MetricsConfig m_config;
+
+  // Series are never removed, so they can be used after the map's lock is released
+  mutable std::shared_mutex                                m_mutex;
+  std::unordered_map<std::string, std::unique_ptr<Series>> m_series;
+};
@@ -0,0 +1,119 @@
+#include "PrometheusRegistry.h"
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Label values escape backslashes, quotes and newlines, help text only the first and last
+static void appendEscaped(std::string& text, std::string_view value, bool quotes) {
+  for (const char c : value) {
+    if (c == '\\') {
+      text += "\\\\";
+    } else if (c == '\n') {
+      text += "\\n";
+    } else if (c == '"' && quotes) {
+      text += "\\\"";
+    } else {
+      text += c;
+    }
+  }
+}
+
+static std::string formatValue(double value) {
+  if (std::isnan(value)) { return "NaN"; }
+  if (std::isinf(value)) { return value > 0 ? "+Inf" : "-Inf"; }
+  std::array<char, 32> buffer{};    // NOLINT(*-magic-numbers): Fits any shortest double
+  return {buffer.data(), std::to_chars(buffer.begin(), buffer.end(), value).ptr};
+}
+
+void PrometheusWriter::family(std::string_view name, std::string_view help, Type type) {
+  m_text += "# HELP ";
+  m_text += name;
+  m_text += ' ';
+  appendEscaped(m_text, help, false);
+  m_text += "\n# TYPE ";
+  m_text += name;
+  switch (type) {
+    case COUNTER: m_text += " counter\n"; break;
+    case GAUGE:   m_text += " gauge\n"; break;
+    case SUMMARY: m_text += " summary\n"; break;
+  }
+}
+
+void PrometheusWriter::sample(std::string_view name, Labels labels, double value) {
+  writeSample(name, labels, {}, formatValue(value));
+}
+
+void PrometheusWriter::sample(std::string_view name, Labels labels, uint64_t value) {
+  writeSample(name, labels, {}, std::to_string(value));
+}
+
+void PrometheusWriter::summary(std::string_view name, Labels labels,
+                               const HistogramSummary& summary, double scale) {
+  for (const auto& [quantile, q] : {std::pair("0.5", 0.5), std::pair("0.9", 0.9),
+                                    std::pair("0.99", 0.99), std::pair("1", 1.0)}) {
+    const std::optional<double> value = summary.quantile(q);
+    writeSample(name, labels, {"quantile", quantile},
+                formatValue(value.has_value() ? *value * scale : NAN));
+  }
+  writeSample(std::string(name) + "_sum", labels, {},
+              formatValue(static_cast<double>(summary.sum()) * scale));
+  writeSample(std::string(name) + "_count", labels, {}, std::to_string(summary.count()));
+}
+
+void PrometheusWriter::writeSample(std::string_view name, Labels labels, Label extra,
+                                   std::string_view value) {
+  m_text += name;
+  bool first = true;
+  auto label = [&](const Label& pair) {
+    m_text += first ? '{' : ',';
+    first   = false;
+    m_text += pair.first;
+    m_text += "=\"";
+    appendEscaped(m_text, pair.second, true);
+    m_text += '"';
+  };
+  for (const Label& pair : labels) { label(pair); }
+  if (!extra.first.empty()) { label(extra); }
+  if (!first) { m_text += '}'; }
+  m_text += ' ';
+  m_text += value;
+  m_text += '\n';
+}
+
+void PrometheusRegistry::add(Collector collector) {
+  const std::lock_guard<std::mutex> lock(m_mutex);
+  m_collectors.push_back(std::move(collector));
+}
+
+void PrometheusRegistry::addCounter(std::string name, std::string help,
+                                    std::function<uint64_t()> value) {
+  add([name = std::move(name), help = std::move(help), value = std::move(value)](
+          PrometheusWriter& out) {
+    out.family(name, help, PrometheusWriter::COUNTER);
+    out.sample(name, {}, value());
+  });
+}
+
+void PrometheusRegistry::addGauge(std::string name, std::string help,
+                                  std::function<double()> value) {
+  add([name = std::move(name), help = std::move(help), value = std::move(value)](
+          PrometheusWriter& out) {
+    out.family(name, help, PrometheusWriter::GAUGE);
+    out.sample(name, {}, value());
+  });
+}
+
+std::string PrometheusRegistry::scrape() const {
+  PrometheusWriter                  out;
+  const std::lock_guard<std::mutex> lock(m_mutex);
+  for (const Collector& collector : m_collectors) { collector(out); }
+  return out.take();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "LogLinearHistogram.h"
+
+// Writes metric families in the Prometheus text exposition format (version 0.0.4)
+class PrometheusWriter {
+ public:
+  enum Type { COUNTER, GAUGE, SUMMARY };
+  using Label  = std::pair<std::string_view, std::string_view>;    // Name and (unescaped) value
+  using Labels = std::initializer_list<Label>;
+
+  // Every sample after this, up to the next family, must belong to it
+  void family(std::string_view name, std::string_view help, Type type);
+  void sample(std::string_view name, Labels labels, double value);
+  // Written exactly, a double only holds integers exactly up to 2^53
+  void sample(std::string_view name, Labels labels, uint64_t value);
+  // Quantiles of the summary (each value multiplied by `scale`), then its sum and count
+  void summary(std::string_view name, Labels labels, const HistogramSummary& summary,
+               double scale);
+
+  std::string take() { return std::move(m_text); }
+
+ private:
+  void writeSample(std::string_view name, Labels labels, Label extra, std::string_view value);
+
+  std::string m_text;
+};
+
+// Where the server's own counters and gauges are collected for scraping. Components register a
+// collector for their metrics while starting up, and every scrape calls each one in turn.
+// Collectors read what the components keep anyway (sharded per-thread cells, atomics), so a
+// scrape never stops the threads doing the work.
+class PrometheusRegistry {
+ public:
+  static constexpr std::string_view CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+
+  using Collector = std::function<void(PrometheusWriter& out)>;
+
+  PrometheusRegistry() = default;
+
+  // DO NOT allow copy or move, the handlers share one registry
+  PrometheusRegistry(const PrometheusRegistry&)            = delete;
+  PrometheusRegistry& operator=(const PrometheusRegistry&) = delete;
+  PrometheusRegistry(PrometheusRegistry&&)                 = delete;
+  PrometheusRegistry& operator=(PrometheusRegistry&&)      = delete;
+
+  // Whatever the collector reads must outlive the registry, or at least the last scrape
+  void add(Collector collector);
+  // A family with a single unlabelled sample
+  void addCounter(std::string name, std::string help, std::function<uint64_t()> value);
+  void addGauge(std::string name, std::string help, std::function<double()> value);
+
+  // Every family, in the order they were registered
+  std::string scrape() const;
+
+ private:
+  mutable std::mutex     m_mutex;
+  std::vector<Collector> m_collectors;
+};
@@ -0,0 +1,83 @@
+#include "QuantileSketch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// The bits below the top SUB_BUCKET_BITS of the mantissa only say where in the bucket a value is
+static constexpr unsigned int MANTISSA_BITS = 52;
+static constexpr unsigned int BUCKET_SHIFT  = MANTISSA_BITS - QuantileSketch::SUB_BUCKET_BITS;
+
+void QuantileSketch::add(double value, uint64_t count) {
+  if (std::isnan(value) || count == 0) { return; }
+  const int32_t bucket = bucketOf(value);
+  auto          it     = std::ranges::lower_bound(m_buckets, bucket, {}, &Bucket::first);
+  if (it != m_buckets.end() && it->first == bucket) {
+    it->second += count;
+  } else {
+    m_buckets.insert(it, {bucket, count});
+  }
+  m_count += count;
+  m_min = std::min(m_min, value);
+  m_max = std::max(m_max, value);
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+  if (other.m_count == 0) { return; }
+  std::vector<Bucket> merged;
+  merged.reserve(m_buckets.size() + other.m_buckets.size());
+  auto mine   = m_buckets.begin();
+  auto theirs = other.m_buckets.begin();
+  while (mine != m_buckets.end() || theirs != other.m_buckets.end()) {
+    if (theirs == other.m_buckets.end()
+        || (mine != m_buckets.end() && mine->first < theirs->first)) {
+      merged.push_back(*mine++);
+    } else if (mine == m_buckets.end() || theirs->first < mine->first) {
+      merged.push_back(*theirs++);
+    } else {
+      merged.emplace_back(mine->first, mine->second + theirs->second);
+      ++mine;
+      ++theirs;
+    }
+  }
+  m_buckets = std::move(merged);
+  m_count += other.m_count;
+  m_min = std::min(m_min, other.m_min);
+  m_max = std::max(m_max, other.m_max);
+}
+
+std::optional<double> QuantileSketch::quantile(double q) const {
+  if (m_count == 0 || !(q >= 0 && q <= 1)) { return std::nullopt; }
+  // The ends are known exactly
+  if (q == 0) { return m_min; }
+  if (q == 1) { return m_max; }
+
+  const auto rank = static_cast<uint64_t>(q * static_cast<double>(m_count - 1));
+  uint64_t   seen = 0;
+  for (const auto& [bucket, count] : m_buckets) {
+    seen += count;
+    if (seen > rank) { return std::clamp(valueOf(bucket), m_min, m_max); }
+  }
+  return m_max;
+}
+
+int32_t QuantileSketch::bucketOf(double value) {
+  if (value == 0) { return 0; }
+  if (value < 0) { return -bucketOf(-value); }
+  // For positive doubles the bits sort the same as the values, so the top bits number the bucket
+  return static_cast<int32_t>(std::bit_cast<uint64_t>(value) >> BUCKET_SHIFT) + 1;
+}
+
+double QuantileSketch::valueOf(int32_t bucket) {
+  if (bucket == 0) { return 0; }
+  if (bucket < 0) { return -valueOf(-bucket); }
+  const auto   index = static_cast<uint64_t>(bucket - 1);
+  const double lower = std::bit_cast<double>(index << BUCKET_SHIFT);
+  const double upper = std::bit_cast<double>((index + 1) << BUCKET_SHIFT);
+  // The middle of the bucket is never more than half a bucket (RELATIVE_ERROR) off
+  return std::isfinite(upper) ? lower + ((upper - lower) / 2) : lower;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Counts values in log-linear buckets (as in an HDR histogram): each power of two is split into
+// 2^SUB_BUCKET_BITS equal buckets, so any quantile is answered to within RELATIVE_ERROR of a
+// value that was actually seen. Only buckets which were hit are kept, and two sketches merge by
+// adding their counts, so per minute sketches can be combined into any longer range.
+class QuantileSketch {
+ public:
+  static constexpr unsigned int SUB_BUCKET_BITS = 7;
+  static constexpr double       RELATIVE_ERROR  = 1.0 / (1U << (SUB_BUCKET_BITS + 1));
+
+  // NaN is ignored, it has no place in an ordering
+  void add(double value, uint64_t count = 1);
+  void merge(const QuantileSketch& other);
+
+  // Estimate of the value `q` of the way through the sorted values, nullopt if there are none
+  // (or `q` is outside of [0, 1])
+  std::optional<double> quantile(double q) const;
+
+  uint64_t    count() const { return m_count; }
+  double      min() const { return m_min; }
+  double      max() const { return m_max; }
+  std::size_t buckets() const { return m_buckets.size(); }
+
+ private:
+  // Bucket numbers are ordered the same as the values in them, negative values included
+  static int32_t bucketOf(double value);
+  static double  valueOf(int32_t bucket);
+
+  using Bucket = std::pair<int32_t, uint64_t>;    // Bucket number and count
+  std::vector<Bucket> m_buckets;                  // Sorted by bucket number
+
+  uint64_t m_count = 0;
+  double   m_min   = std::numeric_limits<double>::infinity();
+  double   m_max   = -std::numeric_limits<double>::infinity();
+};
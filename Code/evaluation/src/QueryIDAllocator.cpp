@@ -0,0 +1,121 @@
+#include "QueryIDAllocator.h"
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "Logger.h"
+#include "Util.h"
+
+// Writes all of `data`, returning false (with errno set) on failure
+static bool writeAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    const ssize_t n = write(fd, data.data(), data.size());
+    if (n == -1 && errno == EINTR) { continue; }
+    if (n == -1) { return false; }
+    data.remove_prefix(n);
+  }
+  return true;
+}
+
+static bool syncPath(const std::filesystem::path& path, int flags) {
+  const int fd = ::open(path.c_str(), flags | O_CLOEXEC);    // NOLINT(*-vararg)
+  if (fd == -1) { return false; }
+  const bool ok = fsync(fd) == 0;
+  ::close(fd);
+  return ok;
+}
+
+bool QueryIDAllocator::open(const std::filesystem::path& path, uint64_t block_size) {
+  m_path       = path;
+  m_block_size = block_size;
+
+  std::error_code ec;
+  if (path.has_parent_path()) { std::filesystem::create_directories(path.parent_path(), ec); }
+  if (ec) {
+    LOG(ERROR) << "Unable to create directory for query IDs " << path << ": " << ec.message();
+    return false;
+  }
+
+  // Nothing below the last reservation is safe to reuse, it may have been handed out already
+  uint64_t start = 0;
+  if (std::filesystem::exists(path)) {
+    std::ifstream file(path);
+    std::string   contents;
+    std::getline(file, contents);
+    const auto [ptr, err] =
+        std::from_chars(contents.data(), contents.data() + contents.size(), start);
+    if (err != std::errc()) {
+      LOG(ERROR) << "Query ID reservation file " << path << " is corrupt (" << contents << ")";
+      return false;
+    }
+  }
+
+  m_reserved_end = start;
+  m_next         = start;
+  if (!reserve(start + m_block_size)) { return false; }
+  LOG(INFO) << "Handing out query IDs from " << start << " (reservation file " << path << ")";
+  return true;
+}
+
+std::optional<uint64_t> QueryIDAllocator::next() {
+  const uint64_t id = m_next.fetch_add(1, std::memory_order_relaxed);
+  if (id < m_reserved_end.load(std::memory_order_acquire)) { return id; }
+
+  // Crossed into a block nobody has reserved yet
+  const std::lock_guard<std::mutex> lock(m_reserve_mutex);
+  const uint64_t                    reserved_end = m_reserved_end.load(std::memory_order_relaxed);
+  if (id < reserved_end) { return id; }
+  const uint64_t blocks = (id - reserved_end) / m_block_size + 1;
+  if (!reserve(reserved_end + blocks * m_block_size)) {
+    LOG(ERROR) << "Unable to reserve query IDs, not handing out " << id;
+    return std::nullopt;
+  }
+  return id;
+}
+
+bool QueryIDAllocator::reserve(uint64_t end) {
+  // Written to a temporary file first so a crash can never leave a partial number behind
+  const std::filesystem::path tmp_path = m_path.string() + ".tmp";
+  constexpr int               FLAGS    = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  constexpr mode_t            MODE     = 0644;
+  const int fd = ::open(tmp_path.c_str(), FLAGS, MODE);    // NOLINT(*-vararg)
+  if (fd == -1) {
+    LOG(ERROR) << "Unable to open " << tmp_path << ": " << my_strerror(errno);
+    return false;
+  }
+  const std::string contents = std::to_string(end) + "\n";
+  const bool        written  = writeAll(fd, contents) && fsync(fd) == 0;
+  if (!written) { LOG(ERROR) << "Unable to write " << tmp_path << ": " << my_strerror(errno); }
+  ::close(fd);
+  if (!written) { return false; }
+
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, m_path, ec);
+  if (ec) {
+    LOG(ERROR) << "Unable to replace " << m_path << ": " << ec.message();
+    return false;
+  }
+  // The rename itself only survives a crash once the directory is synced
+  const std::filesystem::path dir = m_path.has_parent_path() ? m_path.parent_path() : ".";
+  if (!syncPath(dir, O_RDONLY | O_DIRECTORY)) {
+    LOG(ERROR) << "Unable to sync " << dir << ": " << my_strerror(errno);
+    return false;
+  }
+
+  m_reserved_end.store(end, std::memory_order_release);
+  LOG(DEBUG) << "Reserved query IDs up to " << end;
+  return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <optional>
+
+// Hands out query IDs that stay unique across restarts, even after a crash. IDs come from an
+// atomic counter, and are reserved on disk a block at a time, so only the first ID of each block
+// waits on the disk. A restart skips whatever was left of the last reserved block.
+//
+// Without `open`, IDs count up from 0 and nothing is kept (used when there is no data directory).
+class QueryIDAllocator {
+ public:
+  static constexpr uint64_t DEFAULT_BLOCK_SIZE = 10000;
+
+  QueryIDAllocator() = default;
+
+  // DO NOT allow copy or move, the counters are shared by every worker
+  QueryIDAllocator(const QueryIDAllocator&)            = delete;
+  QueryIDAllocator& operator=(const QueryIDAllocator&) = delete;
+  QueryIDAllocator(QueryIDAllocator&&)                 = delete;
+  QueryIDAllocator& operator=(QueryIDAllocator&&)      = delete;
+
+  // Picks up after the reservation recorded in `path` (if any) and reserves the first block
+  bool open(const std::filesystem::path& path, uint64_t block_size = DEFAULT_BLOCK_SIZE);
+
+  // Returns nullopt if a new block was needed but could not be reserved
+  std::optional<uint64_t> next();
+
+ private:
+  // Durably records that every ID below `end` may have been handed out
+  bool reserve(uint64_t end);
+
+  std::filesystem::path m_path;
+  uint64_t              m_block_size = DEFAULT_BLOCK_SIZE;
+
+  std::atomic<uint64_t> m_next = 0;
+  // IDs below this are safe to hand out
+  std::atomic<uint64_t> m_reserved_end = std::numeric_limits<uint64_t>::max();
+  std::mutex            m_reserve_mutex;
+};
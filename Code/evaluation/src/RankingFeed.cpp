@@ -0,0 +1,101 @@
+#include "RankingFeed.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Logger.h"
+#include "Util.h"
+
+RankingInteraction RankingInteraction::fromSearch(const SearchRecord& record) {
+  RankingInteraction interaction;
+  interaction.processed_query = normalizeQuery(record.raw_query);
+  if (record.clicked < record.results.size()) {
+    const auto clicked = record.results.begin() + record.clicked;
+    interaction.links_ignored.assign(record.results.begin(), clicked);
+    interaction.link_clicked = *clicked;
+  }
+  return interaction;
+}
+
+RankingFeed::RankingFeed(std::string       host,
+                         uint16_t          port,
+                         std::string       resource,
+                         RankingFeedConfig config)
+    : m_config(config)
+    , m_resource(std::move(resource))
+    , m_client(std::move(host), port, config.client)
+    , m_batches(
+          config.window_ms,
+          [this](const Interactions& interactions) { return send(interactions); },
+          [this](Interactions& pending, Interactions&& failed) {
+            merge(pending, std::move(failed));
+          }) {}
+
+bool RankingFeed::record(RankingInteraction&& interaction) {
+  // Nothing to rank against
+  if (interaction.processed_query.empty() || interaction.link_clicked.empty()) { return false; }
+  Outcome outcome{.links_ignored = std::move(interaction.links_ignored),
+                  .link_clicked  = std::move(interaction.link_clicked),
+                  .count         = 1};
+  return m_batches.update([&](Interactions& pending) {
+    if (add(pending, interaction.processed_query, std::move(outcome))) { return true; }
+    LOG(WARN) << "Too many queries waiting on Ranking, dropping interaction for "
+              << interaction.processed_query;
+    return false;
+  });
+}
+
+bool RankingFeed::add(Interactions& pending, const std::string& query, Outcome&& outcome) const {
+  auto query_it = pending.find(query);
+  if (query_it == pending.end()) {
+    if (pending.size() >= m_config.max_pending) { return false; }
+    query_it = pending.emplace(query, std::vector<Outcome>()).first;
+  }
+
+  // The same few results tend to come back for a query, so this stays short
+  std::vector<Outcome>& outcomes = query_it->second;
+  auto it = std::find_if(outcomes.begin(), outcomes.end(), [&](const Outcome& existing) {
+    return existing.link_clicked == outcome.link_clicked
+        && existing.links_ignored == outcome.links_ignored;
+  });
+  if (it != outcomes.end()) {
+    it->count += outcome.count;
+  } else {
+    outcomes.push_back(std::move(outcome));
+  }
+  return true;
+}
+
+bool RankingFeed::send(const Interactions& interactions) {
+  nlohmann::json list = nlohmann::json::array();
+  for (const auto& [query, outcomes] : interactions) {
+    for (const Outcome& outcome : outcomes) {
+      list.push_back({
+          {"processed_query",             query},
+          {  "links_ignored", outcome.links_ignored},
+          {   "link_clicked",  outcome.link_clicked},
+          {          "count",         outcome.count}
+      });
+    }
+  }
+
+  LOG(DEBUG) << "Sending interactions for " << interactions.size() << " queries to Ranking";
+  const HTTPClient::Result result =
+      m_client.send(HTTPRequest(HTTPRequest::POST, m_resource, {{"interactions", list}}));
+  if (!result.delivered()) {
+    LOG(ERROR) << "Ranking did not accept interactions for " << interactions.size() << " queries";
+    return false;
+  }
+  return true;
+}
+
+// Goes through `add`, so the failed batch is held to the same limit as anything new
+void RankingFeed::merge(Interactions& pending, Interactions&& failed) const {
+  for (auto& [query, outcomes] : failed) {
+    for (Outcome& outcome : outcomes) { add(pending, query, std::move(outcome)); }
+  }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BatchSender.h"
+#include "HTTPClient.h"
+#include "SearchHistoryStore.h"
+
+// What a search tells Ranking, as described by sendRankingInteractions
+struct RankingInteraction {
+  std::string              processed_query;
+  std::vector<std::string> links_ignored;
+  std::string              link_clicked;
+
+  // The results listed above the click were seen and passed over, the rest may never have been
+  static RankingInteraction fromSearch(const SearchRecord& record);
+};
+
+struct RankingFeedConfig {
+  // Interactions are gathered for this long, then sent together
+  unsigned int window_ms = 1000;
+  // Distinct queries held on to while Ranking is unreachable, new queries past this are dropped
+  std::size_t  max_pending = 64 * 1024;
+
+  HTTPClientConfig client;
+};
+
+// Sends Ranking which links were clicked and which were ignored for each query. Interactions
+// are grouped by processed query, with repeats counted rather than resent, and go out once per
+// window from a background thread.
+class RankingFeed {
+ public:
+  // Interactions are POSTed to `resource` on the host
+  RankingFeed(std::string host, uint16_t port, std::string resource, RankingFeedConfig config = {});
+  ~RankingFeed() { stop(); }
+
+  // DO NOT allow copy or move, the sending thread holds a pointer to this
+  RankingFeed(const RankingFeed&)            = delete;
+  RankingFeed& operator=(const RankingFeed&) = delete;
+  RankingFeed(RankingFeed&&)                 = delete;
+  RankingFeed& operator=(RankingFeed&&)      = delete;
+
+  void start() { m_batches.start(); }
+  // Makes a last attempt at sending whatever is pending, then stops the sending thread
+  void stop() { m_batches.stop(); }
+
+  // Returns false if the interaction was dropped because too many queries are already pending
+  bool record(RankingInteraction&& interaction);
+
+ private:
+  struct Outcome {
+    std::vector<std::string> links_ignored;
+    std::string              link_clicked;
+    unsigned int             count;
+  };
+  // Outcomes of each processed query
+  using Interactions = std::unordered_map<std::string, std::vector<Outcome>>;
+
+  // Sends `interactions`, returning false if Ranking never accepted them
+  bool send(const Interactions& interactions);
+  void merge(Interactions& pending, Interactions&& failed) const;
+  // Counts `outcome` under `query`, returning false if there was no room for a new query
+  bool add(Interactions& pending, const std::string& query, Outcome&& outcome) const;
+
+  RankingFeedConfig m_config;
+  std::string       m_resource;
+  HTTPClient        m_client;
+  // Last, so the sending thread stops before the client goes away
+  BatchSender<Interactions> m_batches;
+};
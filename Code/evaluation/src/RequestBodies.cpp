@@ -0,0 +1,347 @@
+#include "RequestBodies.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "SearchHistoryStore.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+// The full set of events nlohmann's SAX parser hands out, narrowed down to the few a body handler
+// cares about. Scalars other than strings arrive as `json`, which holds them without allocating.
+template <class Handler> class SAXEvents {
+ public:
+  bool null() { return self().scalar(json()); }
+  bool boolean(bool value) { return self().scalar(json(value)); }
+  bool number_integer(json::number_integer_t value) { return self().scalar(json(value)); }
+  bool number_unsigned(json::number_unsigned_t value) { return self().scalar(json(value)); }
+  bool number_float(json::number_float_t value, const std::string& /* text */) {
+    return self().scalar(json(value));
+  }
+  // Only binary formats have these
+  bool binary(json::binary_t& /* value */) { return false; }
+
+  bool start_object(std::size_t /* size */) { return self().start(json::value_t::object); }
+  bool start_array(std::size_t /* size */) { return self().start(json::value_t::array); }
+  bool end_object() { return self().end(); }
+  bool end_array() { return self().end(); }
+
+  bool parse_error(std::size_t /* position */, const std::string& /* token */,
+                   const json::exception& /* error */) {
+    return false;
+  }
+
+ private:
+  Handler& self() { return static_cast<Handler&>(*this); }
+};
+
+// Builds one value which is kept as JSON out of its events
+class ValueBuilder {
+ public:
+  bool building() const { return !m_open.empty(); }
+
+  void start(json::value_t type) {
+    if (m_open.empty()) {
+      m_value = json(type);
+      m_open.push_back(&m_value);
+    } else {
+      m_open.push_back(place(json(type)));
+    }
+  }
+  void key(std::string& name) { m_key = std::move(name); }
+  void add(json value) { place(std::move(value)); }
+  // Returns true once the outermost container is closed, and the value is ready to take
+  bool end() {
+    m_open.pop_back();
+    return m_open.empty();
+  }
+
+  json take() { return std::move(m_value); }
+
+ private:
+  // Only the containers being filled are pointed to, and nothing is added to those but their
+  // own last member, so none of the pointers are invalidated
+  json* place(json value) {
+    json& parent = *m_open.back();
+    if (parent.is_array()) {
+      parent.push_back(std::move(value));
+      return &parent.back();
+    }
+    return &(parent[m_key] = std::move(value));
+  }
+
+  json               m_value;
+  std::vector<json*> m_open;    // Innermost last
+  std::string        m_key;
+};
+
+class SearchResultsHandler : public SAXEvents<SearchResultsHandler> {
+ public:
+  explicit SearchResultsHandler(SearchRecord& record)
+      : m_record(record) {}
+
+  // Every required field was there
+  bool complete() const { return m_has_query_id && m_has_results && m_has_clicked; }
+
+  bool key(std::string& name) {
+    if (m_skip > 0) { return true; }
+    if (name == "query_ID") {
+      m_field = QUERY_ID;
+    } else if (name == "raw_query") {
+      m_field = RAW_QUERY;
+    } else if (name == "results") {
+      m_field = RESULTS;
+    } else if (name == "clicked") {
+      m_field = CLICKED;
+    } else if (name == "query_timestamp") {
+      m_field = QUERY_TIMESTAMP;
+    } else {
+      m_field = OTHER;
+    }
+    return true;
+  }
+
+  bool string(std::string& value) {
+    if (m_skip > 0) { return true; }
+    if (m_in_results) {
+      m_record.results.push_back(std::move(value));
+      return true;
+    }
+    switch (m_field) {
+      case RAW_QUERY:       m_record.raw_query = std::move(value); return true;
+      case QUERY_TIMESTAMP: m_record.query_timestamp = std::move(value); return true;
+      case OTHER:           return true;
+      default:              return false;
+    }
+  }
+
+  bool scalar(const json& value) {
+    if (m_skip > 0) { return true; }
+    if (m_in_results) { return false; }
+    switch (m_field) {
+      case QUERY_ID:
+        if (!value.is_number_unsigned()) { return false; }
+        m_record.query_id = value.get<uint64_t>();
+        m_has_query_id    = true;
+        return true;
+      case CLICKED:
+        if (!value.is_number_unsigned()
+            || value.get<uint64_t>() > std::numeric_limits<unsigned int>::max()) {
+          return false;
+        }
+        m_record.clicked = value.get<unsigned int>();
+        m_has_clicked    = true;
+        return true;
+      case OTHER: return true;
+      default:    return false;
+    }
+  }
+
+  bool start(json::value_t type) {
+    if (m_skip > 0 || (m_in_body && !m_in_results && m_field == OTHER)) {
+      ++m_skip;
+      return true;
+    }
+    if (!m_in_body && type == json::value_t::object) {
+      m_in_body = true;
+      return true;
+    }
+    if (m_in_body && !m_in_results && m_field == RESULTS && type == json::value_t::array) {
+      m_in_results = true;
+      m_has_results = true;
+      m_record.results.clear();
+      return true;
+    }
+    return false;
+  }
+
+  bool end() {
+    if (m_skip > 0) {
+      --m_skip;
+    } else if (m_in_results) {
+      m_in_results = false;
+    } else {
+      m_in_body = false;
+    }
+    return true;
+  }
+
+ private:
+  enum Field : uint8_t { NONE, OTHER, QUERY_ID, RAW_QUERY, RESULTS, CLICKED, QUERY_TIMESTAMP };
+
+  SearchRecord& m_record;
+  Field         m_field      = NONE;
+  bool          m_in_body    = false;
+  bool          m_in_results = false;
+  // How deep into a value nobody asked for the parser is
+  std::size_t   m_skip       = 0;
+
+  bool m_has_query_id = false;
+  bool m_has_results  = false;
+  bool m_has_clicked  = false;
+};
+
+class MetricsReportHandler : public SAXEvents<MetricsReportHandler> {
+ public:
+  MetricsReportHandler(std::vector<ReportedMetric>& metrics, int64_t now_ms)
+      : m_metrics(metrics)
+      , m_now_ms(now_ms) {}
+
+  bool complete() const { return m_has_metrics; }
+
+  bool key(std::string& name) {
+    if (m_skip > 0) { return true; }
+    if (m_value.building()) {
+      m_value.key(name);
+    } else if (m_depth == BODY) {
+      m_field = name == "metrics" ? METRICS : OTHER;
+    } else if (name == "label") {
+      m_field = LABEL;
+    } else if (name == "timestamp") {
+      m_field = TIMESTAMP;
+    } else if (name == "value") {
+      m_field = VALUE;
+    } else {
+      m_field = OTHER;
+    }
+    return true;
+  }
+
+  bool string(std::string& value) {
+    if (m_field == LABEL && m_skip == 0 && m_depth == METRIC) {
+      m_metric.label = std::move(value);
+      m_has_label    = true;
+      return true;
+    }
+    return scalar(json(std::move(value)));
+  }
+
+  bool scalar(json value) {
+    if (m_skip > 0) { return true; }
+    if (m_value.building()) {
+      m_value.add(std::move(value));
+      return true;
+    }
+    if (m_depth == BODY) { return m_field == OTHER; }
+    if (m_depth != METRIC) { return false; }
+    switch (m_field) {
+      case TIMESTAMP:
+        if (!value.is_number_integer()
+            || (value.is_number_unsigned()
+                && value.get<uint64_t>() > std::numeric_limits<int64_t>::max())) {
+          return false;
+        }
+        m_metric.timestamp_ms = value.get<int64_t>();
+        return true;
+      case VALUE:
+        m_metric.value = std::move(value);
+        m_has_value    = true;
+        return true;
+      case OTHER: return true;
+      default:    return false;
+    }
+  }
+
+  bool start(json::value_t type) {
+    if (m_skip > 0 || ((m_depth == BODY || m_depth == METRIC) && m_field == OTHER)) {
+      ++m_skip;
+      return true;
+    }
+    if (m_value.building() || (m_depth == METRIC && m_field == VALUE)) {
+      m_value.start(type);
+      return true;
+    }
+    const bool object = type == json::value_t::object;
+    if (m_depth == OUTSIDE && object) {
+      m_depth = BODY;
+      m_field = NONE;
+      return true;
+    }
+    if (m_depth == BODY && m_field == METRICS && !object) {
+      m_depth       = METRICS_ARRAY;
+      m_has_metrics = true;
+      m_metrics.clear();
+      return true;
+    }
+    if (m_depth == METRICS_ARRAY && object) {
+      m_depth  = METRIC;
+      m_field  = NONE;
+      m_metric = {.label = "", .timestamp_ms = m_now_ms, .value = json()};
+      m_has_label = false;
+      m_has_value = false;
+      return true;
+    }
+    return false;
+  }
+
+  bool end() {
+    if (m_skip > 0) {
+      --m_skip;
+      return true;
+    }
+    if (m_value.building()) {
+      if (m_value.end()) {
+        m_metric.value = m_value.take();
+        m_has_value    = true;
+      }
+      return true;
+    }
+    switch (m_depth) {
+      case METRIC:
+        if (!m_has_label || !m_has_value) { return false; }
+        m_metrics.push_back(std::move(m_metric));
+        m_depth = METRICS_ARRAY;
+        return true;
+      case METRICS_ARRAY: m_depth = BODY; m_field = NONE; return true;
+      default:            m_depth = OUTSIDE; return true;
+    }
+  }
+
+ private:
+  enum Depth : uint8_t { OUTSIDE, BODY, METRICS_ARRAY, METRIC };
+  enum Field : uint8_t { NONE, OTHER, METRICS, LABEL, TIMESTAMP, VALUE };
+
+  std::vector<ReportedMetric>& m_metrics;
+  int64_t                      m_now_ms;
+
+  Depth        m_depth = OUTSIDE;
+  Field        m_field = NONE;
+  std::size_t  m_skip  = 0;
+  ValueBuilder m_value;    // Values which are not numbers, stored as events
+
+  ReportedMetric m_metric;
+  bool           m_has_label   = false;
+  bool           m_has_value   = false;
+  bool           m_has_metrics = false;
+};
+
+}    // namespace
+
+std::optional<SearchRecord> parseSearchResults(std::string_view body) {
+  SearchRecord         record;
+  SearchResultsHandler handler(record);
+  if (!json::sax_parse(body.begin(), body.end(), &handler) || !handler.complete()
+      || record.clicked >= record.results.size()) {
+    return std::nullopt;
+  }
+  return record;
+}
+
+std::optional<std::vector<ReportedMetric>> parseMetricsReport(std::string_view body,
+                                                              int64_t          now_ms) {
+  std::vector<ReportedMetric> metrics;
+  MetricsReportHandler        handler(metrics, now_ms);
+  if (!json::sax_parse(body.begin(), body.end(), &handler) || !handler.complete()) {
+    return std::nullopt;
+  }
+  return metrics;
+}
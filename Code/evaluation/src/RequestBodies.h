@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "SearchHistoryStore.h"
+
+// One entry of a ReportMetrics body
+struct ReportedMetric {
+  std::string    label;
+  int64_t        timestamp_ms = 0;
+  // Numbers are held without allocating, only events are built up as JSON
+  nlohmann::json value;
+};
+
+// These pull the fields a handler needs straight out of the request body, in a single pass over
+// the text, without building a DOM of the whole body first. Anything else in the body is skipped.
+// They return nullopt if the body is not valid JSON, or a field is missing or of the wrong type.
+
+// The body of a ReportSearchResults request. `clicked` is checked to be one of the results.
+std::optional<SearchRecord> parseSearchResults(std::string_view body);
+
+// The body of a ReportMetrics request. Entries without a timestamp are given `now_ms`.
+std::optional<std::vector<ReportedMetric>> parseMetricsReport(std::string_view body,
+                                                              int64_t          now_ms);
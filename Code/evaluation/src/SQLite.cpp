@@ -0,0 +1,77 @@
+#include "SQLite.h"
+
+#include <sqlite3.h>
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "Logger.h"
+
+// Writers wait this long on a lock held by another connection before giving up
+static constexpr int BUSY_TIMEOUT_MS = 5000;
+
+SQLiteDatabase openDatabase(const std::string& path) {
+  const std::filesystem::path fs_path(path);
+  if (fs_path.has_parent_path()) {
+    std::error_code ec;
+    std::filesystem::create_directories(fs_path.parent_path(), ec);
+    if (ec) {
+      LOG(ERROR) << "Unable to create directory for database " << path << ": " << ec.message();
+      return nullptr;
+    }
+  }
+
+  // Connections are never shared between threads without a lock, so SQLite's own mutexes are off
+  constexpr int FLAGS  = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX;
+  sqlite3*      raw_db = nullptr;
+  const int     rc     = sqlite3_open_v2(path.c_str(), &raw_db, FLAGS, nullptr);
+  SQLiteDatabase db(raw_db);    // Needs closing even if opening failed
+  if (rc != SQLITE_OK) {
+    LOG(ERROR) << "Unable to open database " << path << ": " << sqlite3_errstr(rc);
+    return nullptr;
+  }
+  sqlite3_busy_timeout(db.get(), BUSY_TIMEOUT_MS);
+
+  // NORMAL is still crash safe in WAL mode, only the last commits can be lost on power failure
+  if (!executeSQL(db.get(), "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;")) {
+    return nullptr;
+  }
+  LOG(INFO) << "Opened database " << path;
+  return db;
+}
+
+SQLiteStatement prepareStatement(sqlite3* db, std::string_view sql) {
+  sqlite3_stmt* stmt = nullptr;
+  const int     rc   = sqlite3_prepare_v3(db, sql.data(), static_cast<int>(sql.size()),
+                                          SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+  if (rc != SQLITE_OK) {
+    LOG(ERROR) << "Unable to prepare statement (" << sql << "): " << sqlite3_errmsg(db);
+    return nullptr;
+  }
+  return SQLiteStatement(stmt);
+}
+
+bool executeSQL(sqlite3* db, const char* sql) {
+  char*     error = nullptr;
+  const int rc    = sqlite3_exec(db, sql, nullptr, nullptr, &error);
+  if (rc != SQLITE_OK) {
+    LOG(ERROR) << "Failed to execute SQL (" << sql << "): " << (error != nullptr ? error : "");
+    sqlite3_free(error);
+    return false;
+  }
+  return true;
+}
+
+bool bindText(sqlite3_stmt* stmt, int index, std::string_view text) {
+  return sqlite3_bind_text(stmt, index, text.data(), static_cast<int>(text.size()), SQLITE_STATIC)
+      == SQLITE_OK;
+}
+
+std::string_view columnText(sqlite3_stmt* stmt, int index) {
+  // NOLINTNEXTLINE(*-reinterpret-cast): SQLite hands back text as unsigned char
+  const auto* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, index));
+  if (text == nullptr) { return {}; }
+  return {text, static_cast<std::size_t>(sqlite3_column_bytes(stmt, index))};
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <sqlite3.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+struct SQLiteDeleter {
+  void operator()(sqlite3* db) const { sqlite3_close(db); }
+  void operator()(sqlite3_stmt* stmt) const { sqlite3_finalize(stmt); }
+};
+
+using SQLiteDatabase  = std::unique_ptr<sqlite3, SQLiteDeleter>;
+using SQLiteStatement = std::unique_ptr<sqlite3_stmt, SQLiteDeleter>;
+
+// Opens (creating if needed) the database file in WAL mode, so readers never block the writer.
+// Returns nullptr on failure.
+SQLiteDatabase openDatabase(const std::string& path);
+
+// Returns nullptr on failure
+SQLiteStatement prepareStatement(sqlite3* db, std::string_view sql);
+
+// Runs one or more statements which don't return rows
+bool executeSQL(sqlite3* db, const char* sql);
+
+// Binds text without copying, so `text` must outlive the statement's next step
+bool bindText(sqlite3_stmt* stmt, int index, std::string_view text);
+
+std::string_view columnText(sqlite3_stmt* stmt, int index);
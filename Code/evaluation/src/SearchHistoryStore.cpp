@@ -0,0 +1,433 @@
+#include "SearchHistoryStore.h"
+
+#include <sqlite3.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "LRUCache.h"
+#include "Logger.h"
+#include "SQLite.h"
+#include "ShardedCounter.h"
+
+static constexpr const char* SCHEMA = R"(
+CREATE TABLE IF NOT EXISTS queries (
+  query_id        INTEGER PRIMARY KEY,
+  raw_query       TEXT NOT NULL,
+  clicked         INTEGER NOT NULL,
+  query_timestamp TEXT NOT NULL,
+  received_ms     INTEGER NOT NULL
+);
+CREATE TABLE IF NOT EXISTS results (
+  query_id INTEGER NOT NULL REFERENCES queries(query_id),
+  position INTEGER NOT NULL,
+  link     TEXT NOT NULL,
+  PRIMARY KEY (query_id, position)
+) WITHOUT ROWID;
+CREATE TABLE IF NOT EXISTS clicks (
+  query_id INTEGER NOT NULL REFERENCES queries(query_id),
+  position INTEGER NOT NULL,
+  link     TEXT NOT NULL
+);
+CREATE INDEX IF NOT EXISTS clicks_by_link ON clicks(link);
+)";
+
+bool SearchHistoryStore::open(const std::string& path, SearchHistoryConfig config) {
+  if (m_writer.joinable()) {
+    LOG(WARN) << "Search history store is already open";
+    return false;
+  }
+  m_config = config;
+
+  m_write_db = openDatabase(path);
+  if (!m_write_db || !executeSQL(m_write_db.get(), SCHEMA)) { return false; }
+  m_insert_query = prepareStatement(
+      m_write_db.get(),
+      "INSERT OR IGNORE INTO queries (query_id, raw_query, clicked, query_timestamp, received_ms) "
+      "VALUES (?, ?, ?, ?, ?)");
+  m_insert_result = prepareStatement(
+      m_write_db.get(), "INSERT INTO results (query_id, position, link) VALUES (?, ?, ?)");
+  m_insert_click = prepareStatement(
+      m_write_db.get(), "INSERT INTO clicks (query_id, position, link) VALUES (?, ?, ?)");
+
+  m_read_db = openDatabase(path);
+  if (!m_read_db) { return false; }
+  // Every ID asked for is bound at once as a JSON array, so any number are found in one step
+  m_select_queries = prepareStatement(
+      m_read_db.get(),
+      "SELECT queries.query_id, raw_query, clicked, query_timestamp, link FROM queries "
+      "LEFT JOIN results ON results.query_id = queries.query_id "
+      "WHERE queries.query_id IN (SELECT value FROM json_each(?)) "
+      "ORDER BY queries.query_id, position");
+
+  // Keyset paging, each page picks up after the last ID of the one before
+  m_select_after = prepareStatement(
+      m_read_db.get(),
+      "SELECT queries.query_id, raw_query, clicked, query_timestamp, link FROM queries "
+      "LEFT JOIN results ON results.query_id = queries.query_id "
+      "WHERE queries.query_id IN "
+      "(SELECT query_id FROM queries WHERE query_id > ? ORDER BY query_id LIMIT ?) "
+      "ORDER BY queries.query_id, position");
+
+  if (!m_insert_query || !m_insert_result || !m_insert_click || !m_select_queries
+      || !m_select_after) {
+    return false;
+  }
+  {
+    const std::lock_guard<std::mutex> lock(m_cache_mutex);
+    m_cache = LRUCache<uint64_t, SearchRecord>(m_config.cache_size);
+  }
+
+  {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = false;
+  }
+  m_writer = std::thread(&SearchHistoryStore::writeLoop, this);
+  LOG(INFO) << "Search history store opened at " << path;
+  return true;
+}
+
+void SearchHistoryStore::close() {
+  {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_queued_cv.notify_all();
+  if (m_writer.joinable()) { m_writer.join(); }
+
+  // Statements have to be finalized before their database is closed
+  m_insert_query.reset();
+  m_insert_result.reset();
+  m_insert_click.reset();
+  m_write_db.reset();
+  const std::lock_guard<std::mutex> lock(m_read_mutex);
+  m_select_queries.reset();
+  m_select_after.reset();
+  m_read_db.reset();
+  const std::lock_guard<std::mutex> cache_lock(m_cache_mutex);
+  m_cache = LRUCache<uint64_t, SearchRecord>(0);
+}
+
+bool SearchHistoryStore::enqueue(SearchRecord&& record) {
+  SearchRecord cached = record;
+  std::size_t  queued = 0;
+  {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopping) {
+      LOG(WARN) << "Tried to store query " << record.query_id << " in closed search history";
+      return false;
+    }
+    if (m_queue.size() >= m_config.max_queued) {
+      LOG(WARN) << "Search history queue is full, dropping query " << record.query_id;
+      return false;
+    }
+    m_queue.push_back(std::move(record));
+    m_enqueued++;
+    queued = m_queue.size();
+  }
+  {
+    // A repeated ID is not stored, so the cache keeps the first record for it too
+    const std::lock_guard<std::mutex> lock(m_cache_mutex);
+    const uint64_t                    query_id = cached.query_id;
+    m_cache.insert(query_id, std::move(cached));
+  }
+  // The writer only needs waking to start a batch window, or to cut one short
+  if (queued == 1 || queued >= m_config.batch_size) { m_queued_cv.notify_one(); }
+  return true;
+}
+
+void SearchHistoryStore::flush() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  const uint64_t               target = m_enqueued;
+  m_written_cv.wait(lock, [&] { return m_written >= target; });
+}
+
+SearchHistoryStore::WriterStats SearchHistoryStore::writerStats() const {
+  WriterStats stats;
+  // Written first, so it can never be read as past the records enqueued
+  const uint64_t written = m_written.load();
+  stats.queued           = m_enqueued.load() - written;
+  stats.failed_batches   = m_failed_batches.load(std::memory_order_relaxed);
+  stats.dropped_records  = m_dropped_records.load(std::memory_order_relaxed);
+  stats.batch_size.merge(m_batch_sizes);
+  stats.commit_ns.merge(m_commit_ns);
+  return stats;
+}
+
+void SearchHistoryStore::registerMetrics(PrometheusRegistry& registry) const {
+  static constexpr double SECONDS_PER_NS = 1e-9;
+  registry.add([this](PrometheusWriter& out) {
+    const WriterStats stats = writerStats();
+    out.family("evaluation_search_history_queued_records",
+               "Reported searches waiting to be written", PrometheusWriter::GAUGE);
+    out.sample("evaluation_search_history_queued_records", {}, stats.queued);
+    out.family("evaluation_search_history_batch_size", "Records written per transaction",
+               PrometheusWriter::SUMMARY);
+    out.summary("evaluation_search_history_batch_size", {}, stats.batch_size, 1);
+    out.family("evaluation_search_history_commit_seconds",
+               "Time to write and commit a batch of records", PrometheusWriter::SUMMARY);
+    out.summary("evaluation_search_history_commit_seconds", {}, stats.commit_ns, SECONDS_PER_NS);
+    out.family("evaluation_search_history_failed_batches_total",
+               "Batches which failed, and were written again a record at a time",
+               PrometheusWriter::COUNTER);
+    out.sample("evaluation_search_history_failed_batches_total", {}, stats.failed_batches);
+    out.family("evaluation_search_history_dropped_records_total",
+               "Records which could not be written", PrometheusWriter::COUNTER);
+    out.sample("evaluation_search_history_dropped_records_total", {}, stats.dropped_records);
+  });
+}
+
+std::optional<SearchRecord> SearchHistoryStore::find(uint64_t query_id) const {
+  std::vector<SearchRecord> found = find(std::vector<uint64_t>{query_id});
+  if (found.empty()) { return std::nullopt; }
+  return std::move(found.front());
+}
+
+std::vector<SearchRecord> SearchHistoryStore::find(const std::vector<uint64_t>& query_ids) const {
+  std::unordered_map<uint64_t, SearchRecord> found;
+  std::unordered_set<uint64_t>               asked;
+  nlohmann::json                             missing = nlohmann::json::array();
+  {
+    const std::lock_guard<std::mutex> lock(m_cache_mutex);
+    for (const uint64_t query_id : query_ids) {
+      if (!asked.insert(query_id).second) { continue; }
+      if (const SearchRecord* cached = m_cache.get(query_id); cached != nullptr) {
+        found.emplace(query_id, *cached);
+      } else {
+        missing.push_back(query_id);
+      }
+    }
+  }
+
+  std::vector<SearchRecord> looked_up;
+  if (!missing.empty()) {
+    const std::string                 ids = missing.dump();
+    const std::lock_guard<std::mutex> lock(m_read_mutex);
+    if (m_read_db) {
+      sqlite3_stmt* select = m_select_queries.get();
+      sqlite3_reset(select);
+      bindText(select, 1, ids);
+      readRecords(select, looked_up);
+    }
+  }
+
+  if (!looked_up.empty()) {
+    const std::lock_guard<std::mutex> lock(m_cache_mutex);
+    for (SearchRecord& record : looked_up) {
+      m_cache.insert(record.query_id, record);
+      found.emplace(record.query_id, std::move(record));
+    }
+  }
+
+  // IDs which were never stored are left out, as are repeats
+  std::vector<SearchRecord> records;
+  records.reserve(found.size());
+  for (const uint64_t query_id : query_ids) {
+    auto it = found.find(query_id);
+    if (it == found.end()) { continue; }
+    records.push_back(std::move(it->second));
+    found.erase(it);
+  }
+  return records;
+}
+
+std::optional<std::vector<SearchRecord>> SearchHistoryStore::findAfter(uint64_t    after_id,
+                                                                      std::size_t limit) const {
+  std::vector<SearchRecord> records;
+  // IDs are stored signed, so none are past this
+  if (after_id >= static_cast<uint64_t>(std::numeric_limits<sqlite3_int64>::max())) {
+    return records;
+  }
+  const std::lock_guard<std::mutex> lock(m_read_mutex);
+  if (!m_read_db) { return std::nullopt; }
+  sqlite3_stmt* select = m_select_after.get();
+  sqlite3_reset(select);
+  sqlite3_bind_int64(select, 1, static_cast<sqlite3_int64>(after_id));
+  sqlite3_bind_int64(select, 2, static_cast<sqlite3_int64>(limit));
+  if (!readRecords(select, records)) { return std::nullopt; }
+  return records;
+}
+
+bool SearchHistoryStore::forEachQuery(
+    const std::function<void(std::string_view, uint64_t)>& callback) const {
+  const std::lock_guard<std::mutex> lock(m_read_mutex);
+  if (!m_read_db) { return false; }
+
+  // Only run at startup, so not worth keeping prepared
+  const SQLiteStatement select = prepareStatement(
+      m_read_db.get(),
+      "SELECT raw_query, COUNT(*) FROM queries WHERE raw_query != '' GROUP BY raw_query");
+  if (!select) { return false; }
+  int rc = SQLITE_ROW;
+  while ((rc = sqlite3_step(select.get())) == SQLITE_ROW) {
+    callback(columnText(select.get(), 0),
+             static_cast<uint64_t>(sqlite3_column_int64(select.get(), 1)));
+  }
+  if (rc != SQLITE_DONE) {
+    LOG(ERROR) << "Failed to read search history: " << sqlite3_errmsg(m_read_db.get());
+    return false;
+  }
+  return true;
+}
+
+bool SearchHistoryStore::readRecords(sqlite3_stmt*              select,
+                                     std::vector<SearchRecord>& records) const {
+  int rc = SQLITE_ROW;
+  // Rows come grouped by query, one per result (or a single row with no link if it has none)
+  while ((rc = sqlite3_step(select)) == SQLITE_ROW) {
+    const auto query_id = static_cast<uint64_t>(sqlite3_column_int64(select, 0));
+    if (records.empty() || records.back().query_id != query_id) {
+      const auto clicked = static_cast<unsigned int>(sqlite3_column_int(select, 2));
+      records.push_back({.query_id        = query_id,
+                         .raw_query       = std::string(columnText(select, 1)),
+                         .results         = {},
+                         .clicked         = clicked,
+                         .query_timestamp = std::string(columnText(select, 3))});
+    }
+    if (sqlite3_column_type(select, 4) != SQLITE_NULL) {
+      records.back().results.emplace_back(columnText(select, 4));
+    }
+  }
+  sqlite3_reset(select);
+  if (rc != SQLITE_DONE) {
+    LOG(ERROR) << "Failed to look up search history: " << sqlite3_errmsg(m_read_db.get());
+    return false;
+  }
+  return true;
+}
+
+void SearchHistoryStore::writeLoop() {
+  const auto                window = std::chrono::milliseconds(m_config.batch_window_ms);
+  std::vector<SearchRecord> batch;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_queued_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+    if (m_queue.empty()) { break; }    // Only empty here when stopping
+
+    // Give the batch a chance to fill up, one transaction per record would be far slower
+    m_queued_cv.wait_for(lock, window,
+                         [this] { return m_stopping || m_queue.size() >= m_config.batch_size; });
+    batch.swap(m_queue);
+    lock.unlock();
+
+    const auto start = std::chrono::steady_clock::now();
+    if (!writeBatch(batch)) {
+      LOG(ERROR) << "Failed to write batch of " << batch.size()
+                 << " search records, writing them one at a time";
+      addSingleWriter(m_failed_batches);
+      writeEach(batch);
+    }
+    const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    m_commit_ns.record(static_cast<uint64_t>(elapsed.count()));
+    m_batch_sizes.record(batch.size());
+    const std::size_t written = batch.size();
+    batch.clear();
+
+    lock.lock();
+    m_written += written;
+    m_written_cv.notify_all();
+  }
+  lock.unlock();
+  m_written_cv.notify_all();
+}
+
+bool SearchHistoryStore::writeBatch(std::span<const SearchRecord> batch) {
+  if (!executeSQL(m_write_db.get(), "BEGIN IMMEDIATE")) { return false; }
+  for (const SearchRecord& record : batch) {
+    if (!writeRecord(record)) {
+      executeSQL(m_write_db.get(), "ROLLBACK");
+      return false;
+    }
+  }
+  if (!executeSQL(m_write_db.get(), "COMMIT")) {
+    executeSQL(m_write_db.get(), "ROLLBACK");
+    return false;
+  }
+  LOG(DEBUG) << "Committed " << batch.size() << " search records";
+  return true;
+}
+
+void SearchHistoryStore::writeEach(const std::vector<SearchRecord>& batch) {
+  // Only a bad record fails on its own, so the rest of the batch is still stored
+  std::vector<uint64_t> dropped;
+  for (const SearchRecord& record : batch) {
+    if (writeBatch(std::span(&record, 1))) { continue; }
+    LOG(ERROR) << "Dropping search record for query " << record.query_id;
+    dropped.push_back(record.query_id);
+  }
+  if (dropped.empty()) { return; }
+
+  // Cached when they were enqueued, but they must not be found now that they are lost
+  {
+    const std::lock_guard<std::mutex> lock(m_cache_mutex);
+    for (const uint64_t query_id : dropped) { m_cache.erase(query_id); }
+  }
+  addSingleWriter(m_dropped_records, dropped.size());
+}
+
+bool SearchHistoryStore::writeRecord(const SearchRecord& record) {
+  const auto query_id = static_cast<sqlite3_int64>(record.query_id);
+  const auto received_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+
+  sqlite3_stmt* insert_query = m_insert_query.get();
+  sqlite3_reset(insert_query);
+  sqlite3_bind_int64(insert_query, 1, query_id);
+  bindText(insert_query, 2, record.raw_query);
+  sqlite3_bind_int(insert_query, 3, static_cast<int>(record.clicked));
+  bindText(insert_query, 4, record.query_timestamp);
+  sqlite3_bind_int64(insert_query, 5, received_ms);
+  if (sqlite3_step(insert_query) != SQLITE_DONE) {
+    LOG(ERROR) << "Failed to insert query " << record.query_id << ": "
+               << sqlite3_errmsg(m_write_db.get());
+    return false;
+  }
+  if (sqlite3_changes(m_write_db.get()) == 0) {
+    // IDs are supposed to be unique, a repeat is not stored (per the API documentation)
+    LOG(WARN) << "Query " << record.query_id << " was already stored, ignoring it";
+    return true;
+  }
+
+  sqlite3_stmt* insert_result = m_insert_result.get();
+  for (std::size_t position = 0; position < record.results.size(); ++position) {
+    sqlite3_reset(insert_result);
+    sqlite3_bind_int64(insert_result, 1, query_id);
+    sqlite3_bind_int64(insert_result, 2, static_cast<sqlite3_int64>(position));
+    bindText(insert_result, 3, record.results[position]);
+    if (sqlite3_step(insert_result) != SQLITE_DONE) {
+      LOG(ERROR) << "Failed to insert result for query " << record.query_id << ": "
+                 << sqlite3_errmsg(m_write_db.get());
+      return false;
+    }
+  }
+
+  if (record.clicked < record.results.size()) {
+    sqlite3_stmt* insert_click = m_insert_click.get();
+    sqlite3_reset(insert_click);
+    sqlite3_bind_int64(insert_click, 1, query_id);
+    sqlite3_bind_int(insert_click, 2, static_cast<int>(record.clicked));
+    bindText(insert_click, 3, record.results[record.clicked]);
+    if (sqlite3_step(insert_click) != SQLITE_DONE) {
+      LOG(ERROR) << "Failed to insert click for query " << record.query_id << ": "
+                 << sqlite3_errmsg(m_write_db.get());
+      return false;
+    }
+  }
+  return true;
+}
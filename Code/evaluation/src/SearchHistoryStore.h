@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "LRUCache.h"
+#include "LogLinearHistogram.h"
+#include "PrometheusRegistry.h"
+#include "SQLite.h"
+
+// A search reported by the UI, as described in the ReportSearchResults API
+struct SearchRecord {
+  uint64_t                 query_id = 0;
+  std::string              raw_query;
+  std::vector<std::string> results;
+  unsigned int             clicked = 0;
+  std::string              query_timestamp;
+};
+
+struct SearchHistoryConfig {
+  // A batch is committed once this many records are queued, or the oldest has waited the window
+  std::size_t  batch_size      = 256;
+  unsigned int batch_window_ms = 20;
+  // Records past this are rejected rather than buffered
+  std::size_t  max_queued      = 64 * 1024;
+  // Recently reported or looked up records kept in memory, so they are found without the disk
+  std::size_t  cache_size      = 4096;
+};
+
+// Stores reported searches in SQLite. Records are queued and committed in batches by a single
+// writer thread, so reporting a search never waits on the disk. Lookups use their own connection,
+// which WAL mode lets run alongside the writer.
+class SearchHistoryStore {
+ public:
+  SearchHistoryStore() = default;
+  ~SearchHistoryStore() { close(); }
+
+  // DO NOT allow copy or move, the writer thread holds a pointer to this
+  SearchHistoryStore(const SearchHistoryStore&)            = delete;
+  SearchHistoryStore& operator=(const SearchHistoryStore&) = delete;
+  SearchHistoryStore(SearchHistoryStore&&)                 = delete;
+  SearchHistoryStore& operator=(SearchHistoryStore&&)      = delete;
+
+  // Opens (creating if needed) the database file at `path` and starts the writer thread. This
+  // must be a real file, an in-memory database can't be shared between the two connections.
+  bool open(const std::string& path, SearchHistoryConfig config = {});
+  // Commits everything still queued, then stops the writer thread and closes the database
+  void close();
+
+  // Returns false if the store is not open or the queue is full
+  bool enqueue(SearchRecord&& record);
+  // Blocks until every record enqueued before the call has been written
+  void flush();
+
+  std::optional<SearchRecord> find(uint64_t query_id) const;
+  // The records for whichever of `query_ids` are stored, in the order asked for. Cached records
+  // are used as is, the rest are looked up together in one statement.
+  std::vector<SearchRecord>   find(const std::vector<uint64_t>& query_ids) const;
+  // Up to `limit` records with IDs past `after_id`, in ID order, or nullopt if the lookup failed.
+  // Paging on from the last ID returned walks the whole history a page at a time, without the
+  // lookup lock being held in between.
+  std::optional<std::vector<SearchRecord>> findAfter(uint64_t after_id, std::size_t limit) const;
+  // Calls `callback` with every distinct raw query and how often it was searched. Only sees
+  // what has been written, so `flush` first to include queued records.
+  bool forEachQuery(const std::function<void(std::string_view, uint64_t)>& callback) const;
+
+  // What the writer thread has done so far, read without holding it up
+  struct WriterStats {
+    uint64_t         queued          = 0;    // Enqueued, but not written yet
+    uint64_t         failed_batches  = 0;    // Written again one record per transaction
+    uint64_t         dropped_records = 0;
+    HistogramSummary batch_size;
+    HistogramSummary commit_ns;
+  };
+  WriterStats writerStats() const;
+  // The store must outlive every scrape of the registry
+  void        registerMetrics(PrometheusRegistry& registry) const;
+
+ private:
+  void writeLoop();
+  bool writeBatch(std::span<const SearchRecord> batch);
+  // Writes each record in its own transaction, dropping any that still fail
+  void writeEach(const std::vector<SearchRecord>& batch);
+  bool writeRecord(const SearchRecord& record);
+  // Reads the rows of a query joined with its results, must hold the lookup lock
+  bool readRecords(sqlite3_stmt* select, std::vector<SearchRecord>& records) const;
+
+  SearchHistoryConfig m_config;
+
+  // Only used by the writer thread
+  SQLiteDatabase  m_write_db;
+  SQLiteStatement m_insert_query;
+  SQLiteStatement m_insert_result;
+  SQLiteStatement m_insert_click;
+
+  mutable std::mutex m_read_mutex;
+  SQLiteDatabase     m_read_db;
+  SQLiteStatement    m_select_queries;
+  SQLiteStatement    m_select_after;
+
+  // Also holds records which are still queued, so they can be found before they are written
+  mutable std::mutex                       m_cache_mutex;
+  mutable LRUCache<uint64_t, SearchRecord> m_cache{0};
+
+  std::mutex                m_mutex;
+  std::condition_variable   m_queued_cv;
+  std::condition_variable   m_written_cv;
+  std::vector<SearchRecord> m_queue;
+  // Only changed under the lock, atomic so the stats can be read without it
+  std::atomic<uint64_t>     m_enqueued = 0;    // Records ever queued
+  std::atomic<uint64_t>     m_written  = 0;    // Records the writer is done with (even if failed)
+  // Also set until the store is opened
+  bool                      m_stopping = true;
+
+  std::thread m_writer;
+
+  // Only written by the writer thread
+  LogLinearHistogram    m_batch_sizes;
+  LogLinearHistogram    m_commit_ns;
+  std::atomic<uint64_t> m_failed_batches  = 0;
+  std::atomic<uint64_t> m_dropped_records = 0;
+};
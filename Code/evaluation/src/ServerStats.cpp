@@ -0,0 +1,107 @@
+#include "ServerStats.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "ShardedCounter.h"
+
+ServerStats::ServerStats()
+    : m_started(std::chrono::steady_clock::now()) {
+  static std::atomic<uint64_t> next_id = 1;
+  m_id                                 = next_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+ServerStats::Shard& ServerStats::local() {
+  struct Cached {
+    uint64_t stats_id = 0;
+    Shard*   shard    = nullptr;
+  };
+  thread_local Cached cached;
+  if (cached.stats_id != m_id) {
+    const std::lock_guard<std::mutex> lock(m_shards_mutex);
+    m_shards.push_back(std::make_unique<Shard>());
+    cached = {.stats_id = m_id, .shard = m_shards.back().get()};
+  }
+  return *cached.shard;
+}
+
+void ServerStats::record(std::size_t route, const RequestTiming& timing) {
+  Shard& shard = local();
+  route        = std::min(route, MAX_ROUTES - 1);
+  addSingleWriter(shard.requests[route]);
+  std::array<LogLinearHistogram, NUM_PHASES>& latency = shard.latency[route];
+  latency[FIRST_BYTE].record(timing.first_byte_ns);
+  latency[PARSE].record(timing.parse_ns);
+  latency[HANDLER].record(timing.handler_ns);
+  latency[SEND].record(timing.send_ns);
+  addSingleWriter(shard.status_codes[route][std::min(timing.status, MAX_STATUS - 1)]);
+  addSingleWriter(shard.bytes_in, timing.bytes_in);
+  addSingleWriter(shard.bytes_out, timing.bytes_out);
+}
+
+void ServerStats::connectionOpened() { addSingleWriter(local().connections_opened); }
+
+void ServerStats::connectionClosed() { addSingleWriter(local().connections_closed); }
+
+ServerStats::Summary ServerStats::summary() const {
+  Summary summary;
+  summary.uptime = std::chrono::steady_clock::now() - m_started;
+
+  const std::lock_guard<std::mutex> lock(m_shards_mutex);
+  for (const std::unique_ptr<Shard>& shard : m_shards) {
+    for (std::size_t route = 0; route < MAX_ROUTES; ++route) {
+      RouteSummary&  route_summary = summary.routes[route];
+      const uint64_t requests      = shard->requests[route].load(std::memory_order_relaxed);
+      route_summary.requests      += requests;
+      summary.requests            += requests;
+      for (std::size_t phase = 0; phase < NUM_PHASES; ++phase) {
+        route_summary.latency[phase].merge(shard->latency[route][phase]);
+      }
+      for (unsigned int status = 0; status < MAX_STATUS; ++status) {
+        const uint64_t count = shard->status_codes[route][status].load(std::memory_order_relaxed);
+        if (count == 0) { continue; }
+        route_summary.status_codes[status] += count;
+        summary.status_codes[status]       += count;
+      }
+    }
+    summary.bytes_in           += shard->bytes_in.load(std::memory_order_relaxed);
+    summary.bytes_out          += shard->bytes_out.load(std::memory_order_relaxed);
+    summary.connections_opened += shard->connections_opened.load(std::memory_order_relaxed);
+    summary.connections_closed += shard->connections_closed.load(std::memory_order_relaxed);
+  }
+  return summary;
+}
+
+const char* ServerStats::phaseName(Phase phase) {
+  switch (phase) {
+    case FIRST_BYTE: return "first_byte";
+    case PARSE:      return "parse";
+    case HANDLER:    return "handler";
+    case SEND:       return "send";
+    default:         return "unknown";
+  }
+}
+
+OpenConnection::OpenConnection(ServerStats* stats)
+    : m_stats(stats) {
+  if (m_stats != nullptr) { m_stats->connectionOpened(); }
+}
+
+OpenConnection::~OpenConnection() {
+  if (m_stats != nullptr) { m_stats->connectionClosed(); }
+}
+
+OpenConnection& OpenConnection::operator=(OpenConnection&& other) noexcept {
+  if (this != &other) {
+    if (m_stats != nullptr) { m_stats->connectionClosed(); }
+    m_stats = std::exchange(other.m_stats, nullptr);
+  }
+  return *this;
+}
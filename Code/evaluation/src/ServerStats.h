@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "LogLinearHistogram.h"
+
+// What happened to one request, recorded once the response has gone out
+struct RequestTiming {
+  // From the request arriving to the first byte of its response being sent
+  uint64_t first_byte_ns = 0;
+  uint64_t parse_ns      = 0;
+  // In the handler, not counting the time spent sending
+  uint64_t handler_ns    = 0;
+  uint64_t send_ns       = 0;
+
+  unsigned int status    = 0;
+  uint64_t     bytes_in  = 0;
+  uint64_t     bytes_out = 0;
+};
+
+// Request rates, status codes and latencies per route, for watching the server itself. Every
+// thread records into its own shard, so the hot path never takes a lock or shares a cache line
+// with another thread. Shards are only locked to be added (once per thread) and to be merged.
+class ServerStats {
+ public:
+  enum Phase { FIRST_BYTE, PARSE, HANDLER, SEND, NUM_PHASES };
+
+  // Routes are numbered by the server, any number past the last one is lumped in with it
+  static constexpr std::size_t MAX_ROUTES = 16;
+
+  struct RouteSummary {
+    uint64_t                                 requests = 0;
+    std::map<unsigned int, uint64_t>         status_codes;
+    std::array<HistogramSummary, NUM_PHASES> latency;
+  };
+  struct Summary {
+    std::chrono::steady_clock::duration  uptime{};
+    uint64_t                             requests           = 0;
+    uint64_t                             bytes_in           = 0;
+    uint64_t                             bytes_out          = 0;
+    uint64_t                             connections_opened = 0;
+    uint64_t                             connections_closed = 0;
+    std::map<unsigned int, uint64_t>     status_codes;    // Over every route
+    std::array<RouteSummary, MAX_ROUTES> routes;
+  };
+
+  ServerStats();
+
+  // DO NOT allow copy or move, every thread holds on to its shard
+  ServerStats(const ServerStats&)            = delete;
+  ServerStats& operator=(const ServerStats&) = delete;
+  ServerStats(ServerStats&&)                 = delete;
+  ServerStats& operator=(ServerStats&&)      = delete;
+
+  void record(std::size_t route, const RequestTiming& timing);
+  void connectionOpened();
+  void connectionClosed();
+
+  // Adds up every shard. Counts from requests still being recorded may be partly missing.
+  Summary summary() const;
+
+  static const char* phaseName(Phase phase);
+
+ private:
+  static constexpr unsigned int MAX_STATUS = 600;
+
+  // Only written by the thread which owns it. Aligned so neighbouring shards never share a line.
+  struct alignas(64) Shard {    // NOLINT(*-magic-numbers)
+    using Counters = std::array<std::atomic<uint64_t>, MAX_STATUS>;    // By status code
+
+    std::array<std::array<LogLinearHistogram, NUM_PHASES>, MAX_ROUTES> latency;
+    std::array<std::atomic<uint64_t>, MAX_ROUTES>                      requests{};
+    std::array<Counters, MAX_ROUTES>                                   status_codes{};
+    std::atomic<uint64_t>                                              bytes_in{0};
+    std::atomic<uint64_t>                                              bytes_out{0};
+    std::atomic<uint64_t>                                              connections_opened{0};
+    std::atomic<uint64_t>                                              connections_closed{0};
+  };
+
+  // The calling thread's shard, made the first time it records anything
+  Shard& local();
+
+  // Tells apart stats objects that reuse an address, so a thread never picks up a stale shard
+  uint64_t                              m_id;
+  std::chrono::steady_clock::time_point m_started;
+
+  mutable std::mutex                  m_shards_mutex;
+  std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+// Counts a connection as open for as long as this is alive (and has not been moved from). Does
+// nothing without stats.
+class OpenConnection {
+ public:
+  OpenConnection() = default;
+  explicit OpenConnection(ServerStats* stats);
+  ~OpenConnection();
+
+  OpenConnection(OpenConnection&& other) noexcept
+      : m_stats(std::exchange(other.m_stats, nullptr)) {}
+  OpenConnection& operator=(OpenConnection&& other) noexcept;
+
+  // DO NOT allow copy, the connection would be counted as closed twice
+  OpenConnection(const OpenConnection&)            = delete;
+  OpenConnection& operator=(const OpenConnection&) = delete;
+
+ private:
+  ServerStats* m_stats = nullptr;
+};
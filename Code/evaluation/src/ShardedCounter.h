@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Adds to a count only one thread ever writes, though any may read it. With no other writer there
+// is no need for a locked read-modify-write.
+inline void addSingleWriter(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+  counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// A count any number of threads add to. Each thread adds to one of a set of cells, each on its
+// own cache line, so threads don't fight over a line. Reading adds the cells up without holding
+// up the writers. Threads may share a cell, so adding is still atomic.
+class ShardedCounter {
+ public:
+  static constexpr std::size_t CELLS = 16;
+
+  void add(uint64_t amount = 1) {
+    m_cells[cellIndex()].value.fetch_add(amount, std::memory_order_relaxed);
+  }
+
+  uint64_t value() const {
+    uint64_t total = 0;
+    for (const Cell& cell : m_cells) { total += cell.value.load(std::memory_order_relaxed); }
+    return total;
+  }
+
+ private:
+  struct alignas(64) Cell {    // NOLINT(*-magic-numbers)
+    std::atomic<uint64_t> value{0};
+  };
+
+  // Handed out to threads in turn, the first time each one adds to any counter
+  static std::size_t cellIndex() {
+    static std::atomic<std::size_t> next = 0;
+    thread_local const std::size_t  cell = next.fetch_add(1, std::memory_order_relaxed) % CELLS;
+    return cell;
+  }
+
+  std::array<Cell, CELLS> m_cells{};
+};
@@ -4,21 +4,28 @@
 #include <asm-generic/socket.h>
 #include <bits/types.h>
 #include <bits/types/struct_timeval.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
 #include <cctype>
 #include <cerrno>
+#include <climits>
 #include <cstdint>
 #include <cstring>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 
+#include "ByteBuffer.h"
 #include "Logger.h"
 #include "Util.h"
 
@@ -32,15 +39,18 @@ std::unordered_set<uint16_t> TCPSocket::ports_in_use = {};
 TCPSocket::TCPSocket()
     : m_socket(-1)
     , m_send_timeout(0)
-    , m_recv_timeout(0) {}
+    , m_recv_timeout(0)
+    , m_non_blocking(false) {}
 
 TCPSocket::TCPSocket(TCPSocket&& sock) noexcept
     : m_socket(sock.m_socket)
     , m_send_timeout(sock.m_send_timeout)
-    , m_recv_timeout(sock.m_recv_timeout) {
+    , m_recv_timeout(sock.m_recv_timeout)
+    , m_non_blocking(sock.m_non_blocking) {
   sock.m_socket       = -1;
   sock.m_send_timeout = 0;
   sock.m_recv_timeout = 0;
+  sock.m_non_blocking = false;
 }
 
 TCPSocket& TCPSocket::operator=(TCPSocket&& sock) noexcept {
@@ -50,9 +60,11 @@ TCPSocket& TCPSocket::operator=(TCPSocket&& sock) noexcept {
   m_socket            = sock.m_socket;
   m_send_timeout      = sock.m_send_timeout;
   m_recv_timeout      = sock.m_recv_timeout;
+  m_non_blocking      = sock.m_non_blocking;
   sock.m_socket       = -1;
   sock.m_send_timeout = 0;
   sock.m_recv_timeout = 0;
+  sock.m_non_blocking = false;
   return *this;
 }
 
@@ -107,6 +119,7 @@ bool TCPSocket::close() {
     m_socket       = -1;
     m_send_timeout = 0;
     m_recv_timeout = 0;
+    m_non_blocking = false;
   }
   return ret == 0;
 }
@@ -120,7 +133,12 @@ bool TCPSocket::send<std::string_view>(const std::string_view& val, bool full_ms
   LOG(DEBUG) << "Sending message:\n" << val;
   unsigned int sent = 0;
   do {
-    const ssize_t n = ::send(m_socket, val.data() + sent, val.length() - sent, 0);
+    const ssize_t n = ::send(m_socket, val.data() + sent, val.length() - sent, MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR) { continue; }
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && m_non_blocking) {
+      if (waitWritable()) { continue; }
+      break;
+    }
     if (n == -1) {
       LOG(WARN) << "Send Failed: " << my_strerror(errno);
       break;
@@ -134,6 +152,49 @@ bool TCPSocket::send<std::string_view>(const std::string_view& val, bool full_ms
   return sent == val.length();
 }
 
+bool TCPSocket::sendv(std::span<iovec> parts) const {
+  if (m_socket == -1) {
+    LOG(WARN) << "Tried to send on closed socket";
+    return false;
+  }
+  std::size_t total = 0;
+  for (const iovec& part : parts) { total += part.iov_len; }
+
+  std::size_t sent = 0;
+  while (!parts.empty()) {
+    msghdr msg{};
+    msg.msg_iov    = parts.data();
+    msg.msg_iovlen = std::min<std::size_t>(parts.size(), IOV_MAX);
+    const ssize_t n = ::sendmsg(m_socket, &msg, MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR) { continue; }
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && m_non_blocking) {
+      if (waitWritable()) { continue; }
+      break;
+    }
+    if (n == -1) {
+      LOG(WARN) << "Sendmsg Failed: " << my_strerror(errno);
+      break;
+    }
+    sent += n;
+
+    // Skip what was sent, the first part left may have only been partially sent
+    std::size_t done = n;
+    while (!parts.empty() && done >= parts.front().iov_len) {
+      done -= parts.front().iov_len;
+      parts = parts.subspan(1);
+    }
+    if (done > 0) {
+      parts.front().iov_base = static_cast<char*>(parts.front().iov_base) + done;
+      parts.front().iov_len -= done;
+    }
+    LOG(TRACE) << "Sent " << n << " bytes (overall " << sent << "/" << total << ")";
+  }
+  if (sent < total) {
+    LOG(WARN) << "Failed to send full message (sent " << sent << " of " << total << ")";
+  }
+  return sent == total;
+}
+
 std::string TCPSocket::recv() const {
   std::string buf;
   if (m_socket == -1) {
@@ -152,6 +213,78 @@ std::string TCPSocket::recv() const {
   return buf;
 }
 
+ssize_t TCPSocket::recv(ByteBuffer& buffer) const {
+  if (m_socket == -1) {
+    LOG(WARN) << "Tried to receive on closed socket";
+    return -1;
+  }
+  // Reads straight into the buffer, filling whatever space it already has
+  const std::span<char> space = buffer.prepare(RECV_BUFFER_SIZE);
+  ssize_t               n     = 0;
+  do {
+    n = ::recv(m_socket, space.data(), space.size(), 0);
+  } while (n == -1 && errno == EINTR);
+  if (n == -1) {
+    const int err = errno;
+    if (!m_non_blocking || (err != EAGAIN && err != EWOULDBLOCK)) {
+      LOG(WARN) << "Recv failed: " << my_strerror(err);
+    }
+    errno = err;
+    return -1;
+  }
+  buffer.commit(n);
+  LOG(DEBUG) << "Received " << n << " bytes on fd " << m_socket;
+  return n;
+}
+
+bool TCPSocket::peerClosed() const {
+  if (m_socket == -1) { return true; }
+  char    byte = 0;
+  ssize_t n    = 0;
+  do {
+    n = ::recv(m_socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  } while (n == -1 && errno == EINTR);
+  return n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+bool TCPSocket::setNonBlocking(bool non_blocking) {
+  if (m_socket == -1) {
+    LOG(WARN) << "Tried to set non-blocking on closed socket";
+    return false;
+  }
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg, hicpp-vararg)
+  const int flags = fcntl(m_socket, F_GETFL, 0);
+  if (flags == -1) {
+    LOG(WARN) << "Unable to get flags of socket (fd: " << m_socket << "): " << my_strerror(errno);
+    return false;
+  }
+  const int new_flags = non_blocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg, hicpp-vararg)
+  if (fcntl(m_socket, F_SETFL, new_flags) == -1) {
+    LOG(WARN) << "Unable to set flags of socket (fd: " << m_socket << "): " << my_strerror(errno);
+    return false;
+  }
+  m_non_blocking = non_blocking;
+  LOG(TRACE) << "Set socket (fd: " << m_socket << ") non-blocking: " << non_blocking;
+  return true;
+}
+
+bool TCPSocket::waitWritable() const {
+  pollfd    poll_fd{.fd = m_socket, .events = POLLOUT, .revents = 0};
+  const int timeout = m_send_timeout == 0 ? -1 : static_cast<int>(m_send_timeout);
+  int       ret     = 0;
+  do { ret = poll(&poll_fd, 1, timeout); } while (ret == -1 && errno == EINTR);
+  if (ret == -1) {
+    LOG(WARN) << "Poll for writable socket (fd: " << m_socket << ") failed: " << my_strerror(errno);
+    return false;
+  }
+  if (ret == 0) {
+    LOG(WARN) << "Timed out waiting for socket (fd: " << m_socket << ") to be writable";
+    return false;
+  }
+  return true;
+}
+
 template <> bool TCPSocket::setTimeout<SO_RCVTIMEO>(unsigned int timeout_ms) {
   return setTimeout(timeout_ms, SO_RCVTIMEO);
 }
@@ -172,7 +305,7 @@ bool TCPSocket::setTimeout(unsigned int timeout_ms, int option) {
   }
 
   struct timeval tv{.tv_sec  = timeout_ms / 1000,
-                    .tv_usec = static_cast<__suseconds_t>(timeout_ms) * 1000};
+                    .tv_usec = static_cast<__suseconds_t>(timeout_ms % 1000) * 1000};
   LOG(DEBUG) << "Setting timeout (fd: " << m_socket << ") to " << tv.tv_sec << "." << tv.tv_usec;
   if (setsockopt(m_socket, SOL_SOCKET, option, &tv, sizeof(tv)) == -1) {
     LOG(WARN) << "Unable to setsockopt for timeout: " << my_strerror(errno);
@@ -345,8 +478,9 @@ std::string SocketStream::nextLine(bool skip_whitespace) {
   }
   const unsigned int start_pos = m_pos;
   while (m_pos < m_buffer.length() && m_buffer[m_pos] != '\n') { grab_if_needed(++m_pos); }
-  std::string line = m_buffer.substr(start_pos, (m_pos++) - start_pos);
-  if (line.back() == '\r') { line.pop_back(); }    // HTTP uses CRLF
+  std::string line = m_buffer.substr(start_pos, m_pos - start_pos);
+  if (m_pos < m_buffer.length()) { m_pos++; }    // Skip the newline
+  if (!line.empty() && line.back() == '\r') { line.pop_back(); }    // HTTP uses CRLF
   return line;
 }
 
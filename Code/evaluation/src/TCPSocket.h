@@ -3,10 +3,13 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <iostream>
 #include <optional>
+#include <span>
 
+#include "ByteBuffer.h"
 #include "Logger.h"
 #include "Util.h"
 
@@ -35,12 +38,26 @@ class TCPSocket {
   // full_msg - send until all bytes are sent
   // unsigned int send(std::string_view msg, bool full_msg = true) const;
   template <class T> bool send(const T& val, bool full_msg = true) const;
+  // Gathers `parts` into as few sendmsg calls as possible, always sending the full message.
+  // `parts` tracks progress on partial sends, so the iovecs are modified.
+  bool                    sendv(std::span<iovec> parts) const;
 
   // 0 for no timeout, option: SO_RCVTIMEO or SO_SNDTIMEO
   template <int option> bool setTimeout(unsigned int timeout_ms);
   std::string                recv() const;
   int                        fd() const { return m_socket; }
 
+  // Non-blocking sockets return from recv immediately, and send waits for the socket to become
+  // writable (up to the send timeout) instead of failing
+  bool setNonBlocking(bool non_blocking);
+  bool nonBlocking() const { return m_non_blocking; }
+
+  // Appends whatever is available to `buffer`. Returns the number of bytes read, 0 if the peer
+  // closed the connection, or -1 on error (errno is EAGAIN if a non-blocking socket had no data)
+  ssize_t recv(ByteBuffer& buffer) const;
+  // Whether the peer has closed (or reset) the connection, found without waiting or reading
+  bool    peerClosed() const;
+
   // Server Side Functions
   bool                     bind(uint16_t port) const;
   bool                     listen(int backlog) const;
@@ -58,20 +75,33 @@ class TCPSocket {
   unsigned int m_send_timeout;
   unsigned int m_recv_timeout;
 
+  bool m_non_blocking;
+
   // This constnstructor should only be used internally to avoid misuse
   explicit TCPSocket(int sockfd)
       : m_socket(sockfd)
       , m_send_timeout(0)
-      , m_recv_timeout(0) {}
+      , m_recv_timeout(0)
+      , m_non_blocking(false) {}
 
   bool setTimeout(unsigned int timeout_ms, int option);
 
+  // Blocks until a non-blocking socket can be written to, or the send timeout expires
+  bool waitWritable() const;
+
 #ifdef REUSEADDR
   static std::mutex                   ports_mutex;
   static std::unordered_set<uint16_t> ports_in_use;
 #endif
 };
 
+// Defined in TCPSocket.cpp. Declared so no other file instantiates the generic send below for a
+// string_view, which would only call itself.
+template <>
+bool TCPSocket::send<std::string_view>(const std::string_view& val, bool full_msg) const;
+template <> bool TCPSocket::setTimeout<SO_RCVTIMEO>(unsigned int timeout_ms);
+template <> bool TCPSocket::setTimeout<SO_SNDTIMEO>(unsigned int timeout_ms);
+
 template <class T> bool TCPSocket::send(const T& val, bool full_msg) const {
   using namespace std;
   std::string val_str;
@@ -88,6 +118,14 @@ class SocketStream {
   SocketStream(const TCPSocket& sock)
       : m_socket(sock) {}
 
+  // Starts with data that was already read off of the socket. If `complete` is set, the stream
+  // will never read from the socket, and only provides the buffered data. Only the benchmarks
+  // use this, to parse text in memory.
+  SocketStream(const TCPSocket& sock, std::string buffered, bool complete = false)
+      : m_buffer(std::move(buffered))
+      , m_timed_out(complete)
+      , m_socket(sock) {}
+
   bool        hasNext();
   std::string nextWord();
   std::string nextLine(bool skip_whitespace = false);
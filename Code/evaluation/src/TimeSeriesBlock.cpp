@@ -0,0 +1,138 @@
+#include "TimeSeriesBlock.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// Bits used to record where the changed bits of a value start, and how many there are
+static constexpr unsigned int LEADING_BITS     = 5;
+static constexpr unsigned int SIGNIFICANT_BITS = 6;
+static constexpr unsigned int MAX_LEADING      = (1U << LEADING_BITS) - 1;
+static constexpr unsigned int VALUE_BITS       = 64;
+static constexpr unsigned int BYTE_BITS        = 8;
+static constexpr uint8_t      VARINT_MORE      = 0x80;
+static constexpr uint8_t      VARINT_MASK      = 0x7F;
+static constexpr unsigned int VARINT_SHIFT     = 7;
+
+static uint64_t zigzag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> (VALUE_BITS - 1));
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+bool TimeSeriesBlock::append(int64_t timestamp_ms, double value) {
+  if (full()) { return false; }
+
+  // Deltas wrap rather than overflow, decoding wraps them back
+  const int64_t delta =
+      m_size == 0 ? timestamp_ms
+                  : static_cast<int64_t>(static_cast<uint64_t>(timestamp_ms)
+                                         - static_cast<uint64_t>(m_last_timestamp));
+  for (uint64_t bits = zigzag(delta);; bits >>= VARINT_SHIFT) {
+    if (bits <= VARINT_MASK) {
+      m_timestamps.push_back(static_cast<uint8_t>(bits));
+      break;
+    }
+    m_timestamps.push_back(static_cast<uint8_t>((bits & VARINT_MASK) | VARINT_MORE));
+  }
+
+  const uint64_t value_bits = std::bit_cast<uint64_t>(value);
+  if (m_size == 0) {
+    writeBits(value_bits, VALUE_BITS);
+    m_min_timestamp = timestamp_ms;
+    m_max_timestamp = timestamp_ms;
+  } else if (const uint64_t xored = value_bits ^ m_last_value_bits; xored == 0) {
+    writeBits(0, 1);
+  } else {
+    const unsigned int leading  = std::min<unsigned int>(std::countl_zero(xored), MAX_LEADING);
+    const unsigned int trailing = std::countr_zero(xored);
+    // Reuse the last window if the changed bits fit in it, saving the 11 bits describing one
+    if (m_significant != 0 && leading >= m_leading
+        && trailing >= VALUE_BITS - m_leading - m_significant) {
+      writeBits(0b10, 2);
+      writeBits(xored >> (VALUE_BITS - m_leading - m_significant), m_significant);
+    } else {
+      m_leading     = leading;
+      m_significant = VALUE_BITS - leading - trailing;
+      writeBits(0b11, 2);
+      writeBits(leading, LEADING_BITS);
+      // 64 significant bits wraps around to 0, which is otherwise impossible
+      writeBits(m_significant % VALUE_BITS, SIGNIFICANT_BITS);
+      writeBits(xored >> trailing, m_significant);
+    }
+  }
+
+  m_last_value_bits = value_bits;
+  m_last_timestamp  = timestamp_ms;
+  m_min_timestamp   = std::min(m_min_timestamp, timestamp_ms);
+  m_max_timestamp   = std::max(m_max_timestamp, timestamp_ms);
+  ++m_size;
+  return true;
+}
+
+std::size_t TimeSeriesBlock::bytes() const { return m_timestamps.size() + m_values.size(); }
+
+void TimeSeriesBlock::shrink() {
+  m_timestamps.shrink_to_fit();
+  m_values.shrink_to_fit();
+}
+
+void TimeSeriesBlock::writeBits(uint64_t bits, unsigned int count) {
+  while (count > 0) {
+    const unsigned int offset = m_value_bits % BYTE_BITS;
+    if (offset == 0) { m_values.push_back(0); }
+    const unsigned int n     = std::min(BYTE_BITS - offset, count);
+    const uint64_t     chunk = (bits >> (count - n)) & ((1U << n) - 1);
+    m_values.back() |= static_cast<uint8_t>(chunk << (BYTE_BITS - offset - n));
+    m_value_bits += n;
+    count -= n;
+  }
+}
+
+bool TimeSeriesBlock::Reader::next(int64_t& timestamp_ms, double& value) {
+  if (m_index >= m_block.m_size) { return false; }
+
+  uint64_t zigzagged = 0;
+  for (unsigned int shift = 0;; shift += VARINT_SHIFT) {
+    const uint8_t byte = m_block.m_timestamps[m_byte_pos++];
+    zigzagged |= static_cast<uint64_t>(byte & VARINT_MASK) << shift;
+    if ((byte & VARINT_MORE) == 0) { break; }
+  }
+  const int64_t delta = unzigzag(zigzagged);
+  m_timestamp = m_index == 0 ? delta
+                             : static_cast<int64_t>(static_cast<uint64_t>(m_timestamp)
+                                                    + static_cast<uint64_t>(delta));
+
+  if (m_index == 0) {
+    m_value_bits = readBits(VALUE_BITS);
+  } else if (readBits(1) == 1) {
+    if (readBits(1) == 1) {
+      m_leading     = static_cast<unsigned int>(readBits(LEADING_BITS));
+      m_significant = static_cast<unsigned int>(readBits(SIGNIFICANT_BITS));
+      if (m_significant == 0) { m_significant = VALUE_BITS; }
+    }
+    m_value_bits ^= readBits(m_significant) << (VALUE_BITS - m_leading - m_significant);
+  }
+
+  ++m_index;
+  timestamp_ms = m_timestamp;
+  value        = std::bit_cast<double>(m_value_bits);
+  return true;
+}
+
+uint64_t TimeSeriesBlock::Reader::readBits(unsigned int count) {
+  uint64_t bits = 0;
+  while (count > 0) {
+    const unsigned int offset = m_bit_pos % BYTE_BITS;
+    const unsigned int n      = std::min(BYTE_BITS - offset, count);
+    const uint8_t      byte   = m_block.m_values[m_bit_pos / BYTE_BITS];
+    const uint64_t     chunk  = (byte >> (BYTE_BITS - offset - n)) & ((1U << n) - 1);
+    bits                      = (bits << n) | chunk;
+    m_bit_pos += n;
+    count -= n;
+  }
+  return bits;
+}
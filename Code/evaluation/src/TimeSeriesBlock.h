@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Up to CAPACITY points of one numeric series, stored as two compressed columns. Timestamps are
+// varint encoded deltas from the previous point, so regular reports take a byte or two. Values
+// are XOR'd with the previous value and only the changed bits are kept (Gorilla encoding), which
+// for a slowly moving metric is a few bits a point instead of eight bytes.
+class TimeSeriesBlock {
+ public:
+  static constexpr std::size_t CAPACITY = 1024;
+
+  // Returns false (storing nothing) once the block is full
+  bool append(int64_t timestamp_ms, double value);
+
+  std::size_t size() const { return m_size; }
+  bool        full() const { return m_size >= CAPACITY; }
+  // Range of the timestamps in the block, which may not have arrived in order
+  int64_t     minTimestamp() const { return m_min_timestamp; }
+  int64_t     maxTimestamp() const { return m_max_timestamp; }
+  // Bytes used by the two columns
+  std::size_t bytes() const;
+  // Gives back the spare capacity of the columns, for once the block is full
+  void        shrink();
+
+  // Decodes the points in the order they were appended
+  class Reader {
+   public:
+    explicit Reader(const TimeSeriesBlock& block)
+        : m_block(block) {}
+    // Returns false once every point has been read
+    bool next(int64_t& timestamp_ms, double& value);
+
+   private:
+    uint64_t readBits(unsigned int count);
+
+    const TimeSeriesBlock& m_block;
+    std::size_t            m_index       = 0;
+    std::size_t            m_byte_pos    = 0;
+    std::size_t            m_bit_pos     = 0;
+    int64_t                m_timestamp   = 0;
+    uint64_t               m_value_bits  = 0;
+    unsigned int           m_leading     = 0;
+    unsigned int           m_significant = 0;
+  };
+  Reader reader() const { return Reader(*this); }
+
+ private:
+  void writeBits(uint64_t bits, unsigned int count);
+
+  std::size_t m_size           = 0;
+  int64_t     m_min_timestamp  = 0;
+  int64_t     m_max_timestamp  = 0;
+  int64_t     m_last_timestamp = 0;
+
+  std::vector<uint8_t> m_timestamps;    // Zigzag varint deltas
+  std::vector<uint8_t> m_values;        // XOR bit stream, most significant bit first
+  std::size_t          m_value_bits = 0;
+
+  // The last value, and the window of bits its XOR used
+  uint64_t     m_last_value_bits = 0;
+  unsigned int m_leading         = 0;
+  unsigned int m_significant     = 0;
+};
@@ -1,8 +1,11 @@
 #include "Util.h"
 
 #include <array>
+#include <cctype>
 #include <cstring>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 
 static constexpr unsigned int STRERROR_BUFFER_SIZE = 128;
 
@@ -11,3 +14,37 @@ std::string my_strerror(int errnum) {
   // NOLINTNEXTLINE(misc-include-cleaner): Gets stuck in an include loop
   return strerror_r(errnum, buf.data(), STRERROR_BUFFER_SIZE);
 }
+
+std::string toLower(std::string_view str) {
+  std::string lower(str);
+  for (char& c : lower) { c = static_cast<char>(std::tolower(static_cast<unsigned char>(c))); }
+  return lower;
+}
+
+std::string collapseWhitespace(std::string_view text, bool trim_end) {
+  std::string result;
+  result.reserve(text.size());
+  bool space = false;
+  for (const char c : text) {
+    if (std::isspace(static_cast<unsigned char>(c)) != 0) {
+      space = true;
+      continue;
+    }
+    if (space && !result.empty()) { result.push_back(' '); }
+    space = false;
+    result.push_back(c);
+  }
+  if (space && !trim_end && !result.empty()) { result.push_back(' '); }
+  return result;
+}
+
+std::string normalizeQuery(std::string_view query) { return toLower(collapseWhitespace(query)); }
+
+unsigned int parsePositive(const std::string& arg, std::string_view name) {
+  const int value = std::stoi(arg);
+  if (value < 1) {
+    throw std::invalid_argument("Non-positive value provided for " + std::string(name) + " ("
+                                + arg + "), must be positive");
+  }
+  return static_cast<unsigned int>(value);
+}
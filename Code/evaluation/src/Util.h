@@ -1,5 +1,19 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 std::string my_strerror(int errnum);
+
+std::string toLower(std::string_view str);
+
+// Collapses whitespace runs into single spaces and trims the start. A partial query keeps one
+// trailing space (`trim_end` false), it means the last word is finished.
+std::string collapseWhitespace(std::string_view text, bool trim_end = true);
+
+// The form queries are matched and passed on in, ignoring case and repeated whitespace
+std::string normalizeQuery(std::string_view query);
+
+// For command line options, throws for anything that is not a positive integer. `name` is what
+// the error calls the value.
+unsigned int parsePositive(const std::string& arg, std::string_view name);
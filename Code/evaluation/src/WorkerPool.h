@@ -0,0 +1,109 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Logger.h"
+
+// Fixed number of threads pulling jobs off of a bounded queue. Jobs are moved in by `submit` and
+// handed (by rvalue) to the handler on whichever worker thread picks them up.
+template <class Job> class WorkerPool {
+ public:
+  using Handler = std::function<void(Job&&)>;
+
+  WorkerPool(unsigned int num_threads, std::size_t queue_size, Handler handler);
+  ~WorkerPool() { stop(); }
+
+  // DO NOT allow copy or move, the worker threads hold a pointer to this
+  WorkerPool(const WorkerPool&)            = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+  WorkerPool(WorkerPool&&)                 = delete;
+  WorkerPool& operator=(WorkerPool&&)      = delete;
+
+  // Returns false (and leaves `job` untouched) if the queue is full or the pool is stopped
+  bool submit(Job&& job);
+
+  // Finishes all queued jobs, then joins the worker threads
+  void stop();
+
+  std::size_t queued() const {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size();
+  }
+
+ private:
+  void work();
+
+  Handler     m_handler;
+  std::size_t m_queue_size;
+
+  mutable std::mutex      m_mutex;
+  std::condition_variable m_cv;
+  std::deque<Job>         m_queue;
+  bool                    m_stopping = false;
+
+  std::vector<std::thread> m_threads;
+};
+
+template <class Job>
+WorkerPool<Job>::WorkerPool(unsigned int num_threads, std::size_t queue_size, Handler handler)
+    : m_handler(std::move(handler))
+    , m_queue_size(queue_size) {
+  m_threads.reserve(num_threads);
+  for (unsigned int i = 0; i < num_threads; ++i) {
+    m_threads.emplace_back(&WorkerPool::work, this);
+  }
+  LOG(DEBUG) << "Started worker pool with " << num_threads << " threads (queue size "
+             << queue_size << ")";
+}
+
+template <class Job> bool WorkerPool<Job>::submit(Job&& job) {
+  {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopping) {
+      LOG(WARN) << "Tried to submit job to stopped worker pool";
+      return false;
+    }
+    if (m_queue.size() >= m_queue_size) {
+      LOG(WARN) << "Worker pool queue is full (" << m_queue.size() << " jobs)";
+      return false;
+    }
+    m_queue.push_back(std::move(job));
+  }
+  m_cv.notify_one();
+  return true;
+}
+
+template <class Job> void WorkerPool<Job>::stop() {
+  {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopping && m_threads.empty()) { return; }
+    m_stopping = true;
+  }
+  m_cv.notify_all();
+  for (std::thread& thread : m_threads) {
+    if (thread.joinable()) { thread.join(); }
+  }
+  m_threads.clear();
+  LOG(DEBUG) << "Stopped worker pool";
+}
+
+template <class Job> void WorkerPool<Job>::work() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+      if (m_queue.empty()) { return; }    // Only empty here when stopping
+      job = std::move(m_queue.front());
+      m_queue.pop_front();
+    }
+    m_handler(std::move(job));
+  }
+}
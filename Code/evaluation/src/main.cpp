@@ -7,28 +7,59 @@
 #include <cstdint>
 #include <cstdlib>
 #include <exception>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 
+#include "AutofillIndex.h"
 #include "HTTPServer.h"
+#include "LinkAnalysisForwarder.h"
 #include "Logger.h"
+#include "MetricsStore.h"
+#include "PrometheusRegistry.h"
+#include "QueryIDAllocator.h"
+#include "RankingFeed.h"
+#include "SearchHistoryStore.h"
+#include "ServerStats.h"
 #include "Util.h"
 
 // Default values for arguments
 static constexpr uint16_t DEFAULT_LISTENER_PORT = 8080;
 static constexpr int      DEFAULT_BACKLOG_SIZE  = 10;
 static constexpr bool DEFAULT_LOG_CONSOLE = false;
+static constexpr const char* DEFAULT_DATABASE_PATH = "data/evaluation.db";
+// Used for every JSON body with --pretty-json, otherwise they are sent without whitespace
+static constexpr int DEFAULT_PRETTY_JSON_INDENT = 2;
+
+// Where clicks are forwarded
+static constexpr const char* LINK_ANALYSIS_HOST = "lspt-link-analysis.cs.rpi.edu";
+static constexpr uint16_t    LINK_ANALYSIS_PORT = 1234;
 
 // Clang tidy hates getopt so it is a bit messy here
 // NOLINTBEGIN
 #include <getopt.h>
 
 // Command line option info
-constexpr const char*   short_options  = ":p:b:c";
+constexpr const char*   short_options  = ":p:b:ct:q:i:m:d:jr:P:R:L:o:";
 constexpr struct option long_options[] = {
-    {   "port", required_argument, 0, 'p'},
-    {"backlog", required_argument, 0, 'b'},
-    {"console", no_argument, 0, 'c'},
-    {        0,                 0, 0,   0}
+    {        "port", required_argument, 0, 'p'},
+    {     "backlog", required_argument, 0, 'b'},
+    {     "console",       no_argument, 0, 'c'},
+    {     "threads", required_argument, 0, 't'},
+    {       "queue", required_argument, 0, 'q'},
+    {"idle-timeout", required_argument, 0, 'i'},
+    {"max-requests", required_argument, 0, 'm'},
+    {    "database", required_argument, 0, 'd'},
+    { "pretty-json",       no_argument, 0, 'j'},
+    {"ranking-host", required_argument, 0, 'r'},
+    {"ranking-port", required_argument, 0, 'P'},
+    {"ranking-path", required_argument, 0, 'R'},
+    {"log-capacity", required_argument, 0, 'L'},
+    {"log-overflow", required_argument, 0, 'o'},
+    {             0,                 0, 0,   0}
 };
 
 // Extern variable declarations
@@ -86,6 +117,14 @@ bool set_up_signal_handling() {
   return true;
 }
 
+// What logging does once the background thread falls behind, "block" or "drop"
+AsyncLogConfig::Overflow parse_overflow(std::string_view arg) {
+  if (arg == "block") { return AsyncLogConfig::BLOCK; }
+  if (arg == "drop") { return AsyncLogConfig::DROP; }
+  throw std::invalid_argument("Unknown log overflow policy (" + std::string(arg)
+                              + "), must be block or drop");
+}
+
 }    // namespace
 // NOLINTEND
 
@@ -100,6 +139,13 @@ int main(int argc, char* argv[]) {
   // Set default values
   uint16_t listener_port = DEFAULT_LISTENER_PORT;
   int      backlog_size  = DEFAULT_BACKLOG_SIZE;
+  HTTPServerConfig config;
+  std::string      database_path = DEFAULT_DATABASE_PATH;
+  AsyncLogConfig   log_config;
+  // Where clicked and ignored links are sent, Ranking is only fed if all three are given
+  std::string  ranking_host;
+  unsigned int ranking_port = 0;
+  std::string  ranking_path;
 
   // Read command line options
   int option = -1;
@@ -123,6 +169,17 @@ int main(int argc, char* argv[]) {
             Logger::addConsole(TRACE);
           }
           continue;
+        case 't': config.num_threads = parsePositive(optarg, "thread count"); continue;
+        case 'q': config.queue_size = parsePositive(optarg, "queue size"); continue;
+        case 'i': config.idle_timeout_ms = parsePositive(optarg, "idle timeout"); continue;
+        case 'm': config.max_requests = parsePositive(optarg, "max requests"); continue;
+        case 'd': database_path = optarg; continue;
+        case 'j': config.json_indent = DEFAULT_PRETTY_JSON_INDENT; continue;
+        case 'r': ranking_host = optarg; continue;
+        case 'P': ranking_port = parsePositive(optarg, "ranking port"); continue;
+        case 'R': ranking_path = optarg; continue;
+        case 'L': log_config.capacity = parsePositive(optarg, "log capacity"); continue;
+        case 'o': log_config.overflow = parse_overflow(optarg); continue;
         case '?':
           LOG(CRITICAL) << "Command line option: " << static_cast<char>(optopt) << " is invalid";
           return EXIT_FAILURE;
@@ -141,13 +198,80 @@ int main(int argc, char* argv[]) {
     LOG(CRITICAL) << "Caught exception while handling command line arguments: " << e.what();
     return EXIT_FAILURE;
   }
+  const bool feed_ranking = !ranking_host.empty() || ranking_port != 0 || !ranking_path.empty();
+  if (feed_ranking && (ranking_host.empty() || ranking_port == 0 || ranking_path.empty())) {
+    LOG(CRITICAL) << "Ranking needs all of --ranking-host, --ranking-port and --ranking-path";
+    return EXIT_FAILURE;
+  }
+  if (ranking_port > std::numeric_limits<uint16_t>::max()) {
+    LOG(CRITICAL) << "Ranking port (" << ranking_port << ") is out of range";
+    return EXIT_FAILURE;
+  }
+
+  // Every log has been added, from here on messages are written out by a background thread.
+  // Whatever is still queued at exit is written when the writer is destroyed.
+  Logger::startAsync(log_config);
 
   if (!set_up_signal_handling()) {
     LOG(CRITICAL) << "Falied to set up signal handling";
     return EXIT_FAILURE;
   }
 
+  // Set up storage, anything still queued is written out when these go out of scope
+  SearchHistoryStore search_history;
+  if (!search_history.open(database_path)) {
+    LOG(CRITICAL) << "Failed to open search history database at " << database_path;
+    return EXIT_FAILURE;
+  }
+  // IDs are reserved next to the database, so both move together
+  QueryIDAllocator query_ids;
+  const std::filesystem::path query_ids_path =
+      std::filesystem::path(database_path).replace_filename("query_ids");
+  if (!query_ids.open(query_ids_path)) {
+    LOG(CRITICAL) << "Failed to open query ID reservations at " << query_ids_path;
+    return EXIT_FAILURE;
+  }
+  // Autofill suggestions come from every query searched so far
+  AutofillIndex autofill;
+  if (!search_history.forEachQuery(
+          [&](std::string_view query, uint64_t count) { autofill.add(query, count); })) {
+    LOG(CRITICAL) << "Failed to load search history for autofill";
+    return EXIT_FAILURE;
+  }
+  LOG(INFO) << "Loaded " << autofill.size() << " queries for autofill";
+  // Both are stopped (sending what is left) after the server, once nothing more is recorded
+  LinkAnalysisForwarder link_analysis(LINK_ANALYSIS_HOST, LINK_ANALYSIS_PORT);
+  link_analysis.start();
+  std::optional<RankingFeed> ranking;
+  if (feed_ranking) {
+    ranking.emplace(ranking_host, static_cast<uint16_t>(ranking_port), ranking_path);
+    ranking->start();
+    LOG(INFO) << "Feeding Ranking at " << ranking_host << ":" << ranking_port << ranking_path;
+  }
+  // Only kept in memory, reports start over from nothing on a restart
+  MetricsStore metrics;
+  // Request counts and latencies per route, served at /v0/ServerStats
+  ServerStats  stats;
+  // Everything above, scraped at /metrics
+  PrometheusRegistry registry;
+
+  const HTTPServices services{.search_history = &search_history,
+                              .query_ids      = &query_ids,
+                              .autofill       = &autofill,
+                              .link_analysis  = &link_analysis,
+                              .ranking        = ranking ? &ranking.value() : nullptr,
+                              .metrics        = &metrics,
+                              .stats          = &stats,
+                              .prometheus     = &registry};
+
   // Set up HTTP server
-  HTTPServer server(listener_port, backlog_size);
+  HTTPServer server(listener_port, backlog_size, config, services);
+  server.registerMetrics(registry);
+  search_history.registerMetrics(registry);
+  registry.addGauge("evaluation_log_queued_messages", "Log messages waiting to be written",
+                    [] { return static_cast<double>(Logger::queuedMessages()); });
+  registry.addCounter("evaluation_log_dropped_messages_total",
+                      "Log messages dropped because the queue was full",
+                      [] { return Logger::droppedMessages(); });
   return (server.run(shutdown_pipe[0]) ? EXIT_SUCCESS : EXIT_FAILURE);
 }
@@ -81,6 +81,21 @@ if $MISSING; then
   make -C "$REPO_DIR/googletest/build" > /dev/null
 fi
 
+echo "> Ensuring Google Benchmark library & headers are available ..."
+if [ ! -f "$REPO_DIR/benchmark/build/src/libbenchmark.a" ]; then
+  if [ ! -d "$REPO_DIR/benchmark" ]; then
+    echo "  > Cloning Google Benchmark repository ..."
+    git clone https://github.com/google/benchmark.git benchmark -b v1.9.1 > /dev/null
+  fi
+  if [ ! -f "$REPO_DIR/benchmark/build/Makefile" ]; then
+    echo "  > Building Google Benchmark ..."
+    cmake -S "$REPO_DIR/benchmark" -B "$REPO_DIR/benchmark/build" -DCMAKE_BUILD_TYPE=Release \
+      -DBENCHMARK_ENABLE_TESTING=OFF > /dev/null
+  fi
+  echo "  > Compiling library binaries"
+  make -C "$REPO_DIR/benchmark/build" > /dev/null
+fi
+
 echo "> Ensuring sqlite3.o exists ..."
 if [ ! -f "$REPO_DIR/sqlite/sqlite3.o" ]; then
   mkdir -p "$REPO_DIR/sqlite"
@@ -1,13 +1,18 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include "TCPSocket.h"
 #include "HTTPServer.h"
 
 #include <gtest/gtest.h>
 
-static std::pair<TCPSocket, TCPSocket> get_server_and_client(uint16_t port) {
+inline std::pair<TCPSocket, TCPSocket> get_server_and_client(uint16_t port) {
   std::pair<TCPSocket, TCPSocket> sockets;
 
   EXPECT_TRUE(sockets.first.create());
@@ -25,10 +30,76 @@ static std::pair<TCPSocket, TCPSocket> get_server_and_client(uint16_t port) {
   return sockets;
 }
 
-void compare_http_responses(const HTTPResponse& h1, const HTTPResponse& h2) {
+inline void compare_http_responses(const HTTPResponse& h1, const HTTPResponse& h2) {
   EXPECT_EQ(h1.version, h2.version);
   EXPECT_EQ(h1.code, h2.code);
   EXPECT_EQ(h1.status, h2.status);
   EXPECT_EQ(h1.headers, h2.headers);
   EXPECT_EQ(h1.body, h2.body);
-}
\ No newline at end of file
+}
+// Stands in for another component's server. Each request is answered with the next of `codes`
+// (200 once they run out), and kept so tests can check what was sent.
+class FakeHost {
+ public:
+  static constexpr unsigned int IDLE_TIMEOUT_MS = 300;
+
+  // Every response waits `delay_ms` before it is sent
+  explicit FakeHost(uint16_t port, std::vector<unsigned int> codes = {}, unsigned int delay_ms = 0)
+      : m_delay_ms(delay_ms)
+      , m_codes(std::move(codes)) {
+    EXPECT_TRUE(m_listener.create());
+    EXPECT_TRUE(m_listener.bind(port));
+    EXPECT_TRUE(m_listener.listen(4));
+    EXPECT_TRUE(m_listener.setTimeout<SO_RCVTIMEO>(50));
+    m_accepter = std::thread([this] { acceptLoop(); });
+  }
+
+  ~FakeHost() {
+    m_stopping = true;
+    m_accepter.join();
+    for (std::thread& thread : m_servers) { thread.join(); }
+  }
+
+  std::vector<HTTPRequest> requests() {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_requests;
+  }
+  unsigned int connections() const { return m_connections; }
+
+ private:
+  void acceptLoop() {
+    while (!m_stopping) {
+      std::optional<TCPSocket> client = m_listener.accept();
+      if (!client.has_value()) { continue; }
+      ++m_connections;
+      // Idle connections are dropped, like a real server would
+      EXPECT_TRUE(client->setTimeout<SO_RCVTIMEO>(IDLE_TIMEOUT_MS));
+      m_servers.emplace_back([this, sock = std::move(client.value())]() mutable { serve(sock); });
+    }
+  }
+
+  void serve(TCPSocket& sock) {
+    while (std::optional<HTTPRequest> request = HTTPWorker::parseRequest(sock)) {
+      unsigned int code = 200;
+      {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        m_requests.push_back(std::move(request.value()));
+        if (m_next_code < m_codes.size()) { code = m_codes[m_next_code++]; }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(m_delay_ms));
+      if (!sendResponse(sock, HTTPResponse(code, code == 200 ? "OK" : "Error"))) { return; }
+    }
+  }
+
+  TCPSocket                 m_listener;
+  std::atomic<bool>         m_stopping    = false;
+  std::atomic<unsigned int> m_connections = 0;
+  std::thread               m_accepter;
+  unsigned int              m_delay_ms;
+
+  std::mutex                m_mutex;
+  std::vector<unsigned int> m_codes;
+  std::size_t               m_next_code = 0;
+  std::vector<HTTPRequest>  m_requests;
+  std::vector<std::thread>  m_servers;
+};
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AutofillIndex.h"
+
+using Suggestions = std::vector<std::string>;
+
+TEST(AutofillTest, Empty) {
+  const AutofillIndex autofill;
+  EXPECT_EQ(autofill.suggest("", 5), Suggestions());
+  EXPECT_EQ(autofill.suggest("anything", 5), Suggestions());
+}
+
+TEST(AutofillTest, RankedByFrequency) {
+  AutofillIndex autofill;
+  autofill.add("why is rpi so cool", 2);
+  autofill.add("why is the sky blue", 5);
+  autofill.add("why", 1);
+  autofill.add("what is rpi", 10);
+
+  EXPECT_EQ(autofill.suggest("why", 5),
+            Suggestions({"why is the sky blue", "why is rpi so cool", "why"}));
+  EXPECT_EQ(autofill.suggest("w", 2), Suggestions({"what is rpi", "why is the sky blue"}));
+  EXPECT_EQ(autofill.suggest("", 1), Suggestions({"what is rpi"}));
+  EXPECT_EQ(autofill.suggest("why is r", 5), Suggestions({"why is rpi so cool"}));
+  EXPECT_EQ(autofill.suggest("why not", 5), Suggestions());
+}
+
+TEST(AutofillTest, PrefixEndsInsideEdge) {
+  AutofillIndex autofill;
+  autofill.add("data structures");
+  EXPECT_EQ(autofill.suggest("data str", 5), Suggestions({"data structures"}));
+  EXPECT_EQ(autofill.suggest("data stx", 5), Suggestions());
+  EXPECT_EQ(autofill.suggest("data structures and", 5), Suggestions());
+}
+
+TEST(AutofillTest, IncrementsReorder) {
+  AutofillIndex autofill;
+  autofill.add("alpha", 3);
+  autofill.add("alpine", 2);
+  EXPECT_EQ(autofill.suggest("al", 2), Suggestions({"alpha", "alpine"}));
+  autofill.add("alpine", 2);
+  EXPECT_EQ(autofill.suggest("al", 2), Suggestions({"alpine", "alpha"}));
+  EXPECT_EQ(autofill.size(), 2u);
+}
+
+TEST(AutofillTest, IgnoresCaseAndWhitespace) {
+  AutofillIndex autofill;
+  autofill.add("  How do I   pass Data Structures ");
+  autofill.add("how do i pass data structures");
+  EXPECT_EQ(autofill.size(), 1u);
+  EXPECT_EQ(autofill.suggest("HOW  DO I ", 5), Suggestions({"How do I pass Data Structures"}));
+  // A trailing space means the word is finished
+  EXPECT_EQ(autofill.suggest("how do i pass ", 5),
+            Suggestions({"How do I pass Data Structures"}));
+  EXPECT_EQ(autofill.suggest("how do ipass", 5), Suggestions());
+}
+
+TEST(AutofillTest, KeepsOnlyTopCompletions) {
+  AutofillIndex autofill;
+  for (unsigned int i = 0; i < 2 * AutofillIndex::MAX_SUGGESTIONS; ++i) {
+    autofill.add("query " + std::to_string(100 + i), i + 1);
+  }
+  const Suggestions suggestions = autofill.suggest("query", 100);
+  ASSERT_EQ(suggestions.size(), AutofillIndex::MAX_SUGGESTIONS);
+  EXPECT_EQ(suggestions.front(),
+            "query " + std::to_string(100 + 2 * AutofillIndex::MAX_SUGGESTIONS - 1));
+  // A low count query climbing past the others shows up again
+  autofill.add("query 100", 1000);
+  EXPECT_EQ(autofill.suggest("query", 1), Suggestions({"query 100"}));
+  EXPECT_EQ(autofill.suggest("query 1", 1), Suggestions({"query 100"}));
+}
+
+TEST(AutofillTest, ReadersDuringWrites) {
+  constexpr unsigned int QUERIES = 2000;
+  constexpr int          READERS = 4;
+
+  AutofillIndex     autofill;
+  std::atomic<bool> done = false;
+  std::atomic<bool> bad  = false;
+
+  std::vector<std::thread> readers;
+  readers.reserve(READERS);
+  for (int r = 0; r < READERS; ++r) {
+    readers.emplace_back([&] {
+      while (!done) {
+        // Whatever snapshot is seen, it should be consistent
+        const Suggestions suggestions = autofill.suggest("query ", AutofillIndex::MAX_SUGGESTIONS);
+        for (const std::string& suggestion : suggestions) {
+          if (!suggestion.starts_with("query ")) { bad = true; }
+        }
+      }
+    });
+  }
+  for (unsigned int i = 0; i < QUERIES; ++i) { autofill.add("query " + std::to_string(i), i + 1); }
+  done = true;
+  for (std::thread& reader : readers) { reader.join(); }
+
+  EXPECT_FALSE(bad);
+  EXPECT_EQ(autofill.size(), QUERIES);
+  EXPECT_EQ(autofill.suggest("query", 1), Suggestions({"query " + std::to_string(QUERIES - 1)}));
+}
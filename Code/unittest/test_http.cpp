@@ -109,7 +109,7 @@ TEST(HTTPTest, ResponseConstructors) {
   HTTPResponse resp2(400, "Bad Request", body);
 
   HTTPResponse resp3(400, "Bad Request");
-  resp3.body    = body.dump(2);
+  resp3.body    = body.dump();
   resp3.headers = {
       {"Content-Length", std::to_string(resp3.body.length())},
       {  "Content-Type",                  "application/json"}
@@ -128,6 +128,27 @@ TEST(HTTPTest, ResponseConstructors) {
   EXPECT_EQ(resp2.body, resp3.body);
 }
 
+TEST(HTTPTest, SendResponse) {
+  std::pair<TCPSocket, TCPSocket> sockets = get_server_and_client(PORT_NUM);
+  EXPECT_TRUE(sockets.second.setTimeout<SO_RCVTIMEO>(1000));
+
+  // One status line that is cached and one that is not
+  HTTPResponse cached(200, "OK", {{"query_ID", 7}});
+  cached.headers["Connection"] = "close";
+  HTTPResponse uncached(418, "I'm a teapot");
+  uncached.headers["X-Custom"] = "value";
+
+  for (const HTTPResponse& response : {cached, uncached}) {
+    EXPECT_TRUE(sendResponse(sockets.first, response));
+    std::optional<HTTPResponse> received = HTTPWorker::parseResponse(sockets.second);
+    ASSERT_TRUE(received.has_value());
+    EXPECT_EQ(to_string(received.value()).size(), to_string(response).size());
+    EXPECT_EQ(received->code, response.code);
+    EXPECT_EQ(received->status, response.status);
+    EXPECT_EQ(received->body, response.body);
+  }
+}
+
 class ShutdownPipeWrapper {
  public:
   bool init() {
@@ -283,7 +304,7 @@ TEST(HTTPTest, BadlyFormattedRequest) {
       {  "error",            "Bad Request"},
       {"message", "Error parsing request."}
   };
-  EXPECT_EQ(response.body, expected_json.dump(2));
+  EXPECT_EQ(response.body, expected_json.dump());
 }
 
 TEST(HTTPTest, BadHTTPVersion) {
@@ -318,7 +339,7 @@ TEST(HTTPTest, BadHTTPVersion) {
       {  "error", "HTTP Version Not Supported"},
       {"message",     "HTTP/1.1 Must be Used."}
   };
-  EXPECT_EQ(response.body, expected_json.dump(2));
+  EXPECT_EQ(response.body, expected_json.dump());
 }
 
 TEST(HTTPTest, BodyNoContentLength) {
@@ -360,7 +381,7 @@ TEST(HTTPTest, BodyNoContentLength) {
       {  "error",                                                     "Length Required"},
       {"message", "Content-Length header must be specified when sending a request body"}
   };
-  EXPECT_EQ(response.body, expected_json.dump(2));
+  EXPECT_EQ(response.body, expected_json.dump());
 }
 
 TEST(HTTPTest, BodyBadContentLength) {
@@ -402,7 +423,7 @@ TEST(HTTPTest, BodyBadContentLength) {
       {  "error",                                   "Bad Request"},
       {"message", "Specified content length (ABCDEFG) is invalid"}
   };
-  EXPECT_EQ(response.body, expected_json.dump(2));
+  EXPECT_EQ(response.body, expected_json.dump());
 }
 
 TEST(HTTPTest, BodyWrongContentLength) {
@@ -427,9 +448,12 @@ TEST(HTTPTest, BodyWrongContentLength) {
                           {"query_timestamp", "Tue, 29 Oct 2024 16:56:32 GMT"}
   });
 
-  request.headers["Content-Length"] = "69";
+  // The body is framed by Content-Length, so only a body cut short can be detected
+  const std::string content_length  = std::to_string(request.body.length() + 31);
+  request.headers["Content-Length"] = content_length;
 
   EXPECT_TRUE(client.send(request));
+  EXPECT_EQ(shutdown(client.fd(), SHUT_WR), 0);
 
   std::optional<HTTPResponse> response_opt = HTTPWorker::parseResponse(client);
 
@@ -443,10 +467,46 @@ TEST(HTTPTest, BodyWrongContentLength) {
 
   nlohmann::json expected_json = {
       {  "error",                                                "Bad Request"},
-      {"message", "Provided content length 69 does not match actual content length "
- + std::to_string(request.body.length())                     }
+      {"message", "Provided content length " + content_length
+ + " does not match actual content length " + std::to_string(request.body.length())}
   };
-  EXPECT_EQ(response.body, expected_json.dump(2));
+  EXPECT_EQ(response.body, expected_json.dump());
+}
+
+TEST(HTTPTest, ChunkedBodyCutShort) {
+  HTTPServerWrapper server(PORT_NUM, 1);
+
+  EXPECT_TRUE(server.init());
+
+  server.run();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  TCPSocket client;
+  EXPECT_TRUE(client.create());
+  EXPECT_TRUE(client.connect("127.0.0.1", PORT_NUM));
+
+  // There is no Content-Length to compare against, the last (empty) chunk just never comes
+  EXPECT_TRUE(client.send("POST /v0/ReportMetrics HTTP/1.1\r\n"
+                          "Transfer-Encoding: chunked\r\n"
+                          "\r\n"
+                          "7\r\n{\"metri\r\n"));
+  EXPECT_EQ(shutdown(client.fd(), SHUT_WR), 0);
+
+  std::optional<HTTPResponse> response_opt = HTTPWorker::parseResponse(client);
+
+  ASSERT_TRUE(response_opt.has_value());
+
+  HTTPResponse& response = response_opt.value();
+
+  EXPECT_EQ(response.code, 400u);
+  EXPECT_EQ(response.status, "Bad Request");
+
+  nlohmann::json expected_json = {
+      {  "error",                              "Bad Request"},
+      {"message", "Chunked body ended before its last chunk"}
+  };
+  EXPECT_EQ(response.body, expected_json.dump());
 }
 
 TEST(HTTPTest, BadResource) {
@@ -480,5 +540,734 @@ TEST(HTTPTest, BadResource) {
       {  "error",                         "Not Found"},
       {"message", "Resource (API function) not found"}
   };
-  EXPECT_EQ(response.body, expected_json.dump(2));
+  EXPECT_EQ(response.body, expected_json.dump());
+}
+
+TEST(HTTPTest, IdleClientsDontBlock) {
+  HTTPServer server_obj(PORT_NUM, 16, {.num_threads = 1});
+  ShutdownPipeWrapper pipe;
+  EXPECT_TRUE(pipe.init());
+  std::thread server_thread([&] { server_obj.run(pipe.get_fd()); });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // With a single worker thread, these used to hold up everybody behind them
+  std::vector<TCPSocket> idle_clients(8);
+  for (TCPSocket& idle : idle_clients) {
+    EXPECT_TRUE(idle.create());
+    EXPECT_TRUE(idle.connect("127.0.0.1", PORT_NUM));
+    EXPECT_TRUE(idle.send("GET /v0/GetQu"));
+  }
+
+  TCPSocket client;
+  EXPECT_TRUE(client.create());
+  EXPECT_TRUE(client.connect("127.0.0.1", PORT_NUM));
+  EXPECT_TRUE(client.setTimeout<SO_RCVTIMEO>(1000));
+  EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::GET, "/v0/GetQueryID")));
+
+  std::optional<HTTPResponse> response_opt = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response_opt.has_value());
+  EXPECT_EQ(response_opt->code, 200u);
+
+  EXPECT_TRUE(pipe.shutdown());
+  server_thread.join();
+}
+
+TEST(ParseHTTPTest, ParseChunkedRequest) {
+  std::pair<TCPSocket, TCPSocket> sockets = get_server_and_client(PORT_NUM);
+  EXPECT_TRUE(sockets.first.setTimeout<SO_RCVTIMEO>(2000));
+
+  std::string chunked =
+      "POST /v0/ReportMetrics HTTP/1.1\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "\r\n"
+      "7\r\n{\"metri\r\n"
+      "a;ext=1\r\ncs\": []}\r\n\r\n"
+      "0\r\n"
+      "\r\n";
+  sockets.second.send(chunked);
+
+  const auto                 start      = std::chrono::steady_clock::now();
+  std::optional<HTTPRequest> request_op = HTTPWorker::parseRequest(sockets.first);
+  ASSERT_TRUE(request_op.has_value());
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1000));
+  EXPECT_EQ(request_op->body, "{\"metrics\": []}\r\n");
+}
+
+TEST(ParseHTTPTest, ResponseEndsAtContentLength) {
+  std::pair<TCPSocket, TCPSocket> sockets = get_server_and_client(PORT_NUM);
+  EXPECT_TRUE(sockets.second.setTimeout<SO_RCVTIMEO>(2000));
+
+  // The connection stays open, so this only returns quickly if the body length is respected
+  EXPECT_TRUE(sockets.first.send(HTTPResponse(200, "OK", {{"query_ID", 7}})));
+
+  const auto                  start       = std::chrono::steady_clock::now();
+  std::optional<HTTPResponse> response_op = HTTPWorker::parseResponse(sockets.second);
+  ASSERT_TRUE(response_op.has_value());
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1000));
+  EXPECT_EQ(nlohmann::json::parse(response_op->body), nlohmann::json({{"query_ID", 7}}));
+}
+
+class KeepAliveTest : public testing::Test {
+ protected:
+  void start(HTTPServerConfig config) {
+    m_server = std::make_unique<HTTPServer>(PORT_NUM, 4, config);
+    EXPECT_TRUE(m_pipe.init());
+    m_thread = std::thread([this] { m_server->run(m_pipe.get_fd()); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    EXPECT_TRUE(m_client.create());
+    EXPECT_TRUE(m_client.connect("127.0.0.1", PORT_NUM));
+    EXPECT_TRUE(m_client.setTimeout<SO_RCVTIMEO>(1000));
+  }
+
+  void TearDown() override {
+    EXPECT_TRUE(m_pipe.shutdown());
+    m_thread.join();
+  }
+
+  ShutdownPipeWrapper         m_pipe;
+  std::unique_ptr<HTTPServer> m_server;
+  std::thread                 m_thread;
+  TCPSocket                   m_client;
+};
+
+TEST_F(KeepAliveTest, SequentialRequests) {
+  start({});
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(m_client.send(HTTPRequest(HTTPRequest::GET, "/v0/GetQueryID")));
+    std::optional<HTTPResponse> response = HTTPWorker::parseResponse(m_client);
+    ASSERT_TRUE(response.has_value());
+    EXPECT_EQ(response->code, 200u);
+    EXPECT_FALSE(response->headers.contains("connection"));
+  }
+}
+
+TEST_F(KeepAliveTest, PipelinedRequests) {
+  start({});
+  const std::string get = to_string(HTTPRequest(HTTPRequest::GET, "/v0/GetQueryID"));
+  EXPECT_TRUE(m_client.send(get + get + get));
+
+  ByteBuffer                  buffer;
+  std::optional<unsigned int> last_id;
+  for (int i = 0; i < 3; ++i) {
+    std::optional<HTTPResponse> response = HTTPWorker::parseResponse(m_client, buffer);
+    ASSERT_TRUE(response.has_value());
+    EXPECT_EQ(response->code, 200u);
+    const unsigned int id = nlohmann::json::parse(response->body).at("query_ID");
+    if (last_id.has_value()) { EXPECT_EQ(id, last_id.value() + 1); }
+    last_id = id;
+  }
+}
+
+TEST_F(KeepAliveTest, ConnectionClose) {
+  start({});
+  HTTPRequest request(HTTPRequest::GET, "/v0/GetQueryID");
+  request.headers["Connection"] = "close";
+  EXPECT_TRUE(m_client.send(request));
+
+  std::optional<HTTPResponse> response = HTTPWorker::parseResponse(m_client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->headers["connection"], "close");
+  EXPECT_EQ(m_client.recv(), "");    // Server closed the connection
+}
+
+TEST_F(KeepAliveTest, MaxRequests) {
+  start({.max_requests = 2});
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_TRUE(m_client.send(HTTPRequest(HTTPRequest::GET, "/v0/GetQueryID")));
+    std::optional<HTTPResponse> response = HTTPWorker::parseResponse(m_client);
+    ASSERT_TRUE(response.has_value());
+    EXPECT_EQ(response->headers.contains("connection"), i == 1);
+  }
+  EXPECT_EQ(m_client.recv(), "");
+}
+
+TEST_F(KeepAliveTest, IdleTimeout) {
+  start({.idle_timeout_ms = 50});
+  EXPECT_TRUE(m_client.send(HTTPRequest(HTTPRequest::GET, "/v0/GetQueryID")));
+  EXPECT_TRUE(HTTPWorker::parseResponse(m_client).has_value());
+
+  const auto start_time = std::chrono::steady_clock::now();
+  EXPECT_EQ(m_client.recv(), "");
+  EXPECT_LT(std::chrono::steady_clock::now() - start_time, std::chrono::milliseconds(500));
+}
+
+TEST_F(KeepAliveTest, EndlessHeaders) {
+  start({});
+  // Never finishes its headers, it is cut off once the parser's limit is passed
+  std::string request = "GET /v0/GetQueryID HTTP/1.1\r\n";
+  while (request.size() <= HTTPParser::MAX_HEADER_SIZE + 4096) { request += "X-Filler: abc\r\n"; }
+  EXPECT_TRUE(m_client.send(request));
+  std::optional<HTTPResponse> response = HTTPWorker::parseResponse(m_client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 431u);
+}
+
+TEST_F(KeepAliveTest, StreamingClientDoesNotStallOthers) {
+  start({});
+  // Sends a body as fast as it can, without ever finishing it
+  std::atomic<bool> stop = false;
+  std::thread       streamer([&] {
+    TCPSocket sock;
+    EXPECT_TRUE(sock.create());
+    EXPECT_TRUE(sock.connect("127.0.0.1", PORT_NUM));
+    EXPECT_TRUE(sock.setTimeout<SO_SNDTIMEO>(100));
+    EXPECT_TRUE(sock.send("POST /v0/ReportMetrics HTTP/1.1\r\nContent-Length: 60000000\r\n\r\n"));
+    const std::string chunk(64 * 1024, 'a');
+    while (!stop && sock.send(chunk)) {}
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  for (int i = 0; i < 10; ++i) {
+    const auto start_time = std::chrono::steady_clock::now();
+    EXPECT_TRUE(m_client.send(HTTPRequest(HTTPRequest::GET, "/v0/GetQueryID")));
+    const std::optional<HTTPResponse> response = HTTPWorker::parseResponse(m_client);
+    // Not asserted, the streamer still has to be stopped
+    EXPECT_TRUE(response.has_value() && response->code == 200u);
+    EXPECT_LT(std::chrono::steady_clock::now() - start_time, std::chrono::milliseconds(200));
+  }
+  stop = true;
+  streamer.join();
+}
+
+TEST_F(KeepAliveTest, StalledReaderIsDropped) {
+  start({.num_threads = 1, .idle_timeout_ms = 200, .max_requests = 1000000});
+  // Asks for far more than the socket buffers hold, and never reads any of it
+  std::atomic<bool> stalled = false;
+  std::atomic<bool> stop    = false;
+  std::thread       staller([&] {
+    TCPSocket sock;
+    EXPECT_TRUE(sock.create());
+    const int buffer_size = 4096;
+    EXPECT_EQ(setsockopt(sock.fd(), SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size)), 0);
+    EXPECT_TRUE(sock.connect("127.0.0.1", PORT_NUM));
+    EXPECT_TRUE(sock.setTimeout<SO_SNDTIMEO>(500));
+    const std::string request = to_string(HTTPRequest(HTTPRequest::GET, "/v0/GetQueryID"));
+    std::string       requests;
+    for (int i = 0; i < 1000; ++i) { requests += request; }
+    while (sock.send(requests)) {}
+    // The worker has stopped reading, so it is stuck sending
+    stalled = true;
+    while (!stop) { std::this_thread::sleep_for(std::chrono::milliseconds(10)); }
+  });
+  while (!stalled) { std::this_thread::sleep_for(std::chrono::milliseconds(10)); }
+
+  // The only worker gives up on the staller once its send times out. The fixture's client has sat
+  // idle for too long by now, so this needs a new one.
+  TCPSocket client;
+  EXPECT_TRUE(client.create());
+  EXPECT_TRUE(client.connect("127.0.0.1", PORT_NUM));
+  EXPECT_TRUE(client.setTimeout<SO_RCVTIMEO>(1000));
+  EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::GET, "/v0/GetQueryID")));
+  const std::optional<HTTPResponse> response = HTTPWorker::parseResponse(client);
+  // Not asserted, the staller still has to be stopped
+  EXPECT_TRUE(response.has_value() && response->code == 200u);
+  stop = true;
+  staller.join();
+}
+
+TEST_F(KeepAliveTest, CompactJSON) {
+  start({});
+  EXPECT_TRUE(m_client.send(HTTPRequest(HTTPRequest::GET, "/v0/GetQueryID")));
+  std::optional<HTTPResponse> response = HTTPWorker::parseResponse(m_client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->body, nlohmann::json::parse(response->body).dump());
+
+  // Asked for by the client
+  HTTPRequest request(HTTPRequest::GET, "/v0/GetQueryID");
+  request.headers["Accept"] = "application/json; indent=2";
+  EXPECT_TRUE(m_client.send(request));
+  response = HTTPWorker::parseResponse(m_client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->body, nlohmann::json::parse(response->body).dump(2));
+  EXPECT_NE(response->body.find('\n'), std::string::npos);
+
+  // Errors are serialized ahead of time, so they stay compact
+  request.resource = "/v0/Missing";
+  EXPECT_TRUE(m_client.send(request));
+  response = HTTPWorker::parseResponse(m_client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 404u);
+  EXPECT_EQ(response->body, nlohmann::json::parse(response->body).dump());
+}
+
+TEST_F(KeepAliveTest, PrettyJSON) {
+  start({.json_indent = 4});
+  EXPECT_TRUE(m_client.send(HTTPRequest(HTTPRequest::GET, "/v0/GetQueryID")));
+  std::optional<HTTPResponse> response = HTTPWorker::parseResponse(m_client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->body, nlohmann::json::parse(response->body).dump(4));
+}
+
+TEST_F(KeepAliveTest, Routing) {
+  start({});
+  EXPECT_TRUE(m_client.send(HTTPRequest(HTTPRequest::GET, "/v0/ReportSearchResults")));
+  std::optional<HTTPResponse> response = HTTPWorker::parseResponse(m_client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 405u);
+  EXPECT_EQ(response->headers["allow"], "POST");
+
+  EXPECT_TRUE(m_client.send(HTTPRequest(HTTPRequest::DELETE, "/v0/GetQueryData")));
+  response = HTTPWorker::parseResponse(m_client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 405u);
+  EXPECT_EQ(response->headers["allow"], "GET, POST");
+
+  // Only the versions which exist are routed
+  for (const char* target : {"/v1/GetQueryID", "/v/GetQueryID", "/v0GetQueryID", "/GetQueryID",
+                             "/v0/GetQueryIDs", "/v0/"}) {
+    EXPECT_TRUE(m_client.send(HTTPRequest(HTTPRequest::GET, target)));
+    response = HTTPWorker::parseResponse(m_client);
+    ASSERT_TRUE(response.has_value());
+    EXPECT_EQ(response->code, 404u) << target;
+  }
+
+  // The query string is not part of the route
+  EXPECT_TRUE(m_client.send(HTTPRequest(HTTPRequest::GET, "/v0/GetQueryID?x=1")));
+  response = HTTPWorker::parseResponse(m_client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 200u);
+}
+
+TEST(HTTPTest, StoreAndGetQueryData) {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "test_http_history";
+  std::filesystem::remove_all(dir);
+  SearchHistoryStore history;
+  ASSERT_TRUE(history.open((dir / "history.db").string()));
+
+  HTTPServer          server_obj(PORT_NUM, 4, {}, {.search_history = &history});
+  ShutdownPipeWrapper pipe;
+  EXPECT_TRUE(pipe.init());
+  std::thread server_thread([&] { server_obj.run(pipe.get_fd()); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  TCPSocket client;
+  EXPECT_TRUE(client.create());
+  EXPECT_TRUE(client.connect("127.0.0.1", PORT_NUM));
+  EXPECT_TRUE(client.setTimeout<SO_RCVTIMEO>(1000));
+
+  const nlohmann::json search = {
+      {       "query_ID",                            1234},
+      {      "raw_query",           "How do I do a thing"},
+      {        "results",     {"link1", "link2", "link3"}},
+      {        "clicked",                               1},
+      {"query_timestamp", "Tue, 29 Oct 2024 16:56:32 GMT"}
+  };
+  EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::POST, "/v0/ReportSearchResults", search)));
+  std::optional<HTTPResponse> response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 200u);
+  history.flush();
+
+  for (const auto& [id, expected] : {
+           std::pair{"1234", nlohmann::json::array({{{"query_ID", 1234},
+                                                     {"results", {"link1", "link2", "link3"}},
+                                                     {"clicked", 1}}})},
+           std::pair{"4321", nlohmann::json::array()}
+  }) {
+    HTTPRequest request(HTTPRequest::GET, "/v0/GetQueryData");
+    request.headers["Query-ID"] = id;
+    EXPECT_TRUE(client.send(request));
+    response = HTTPWorker::parseResponse(client);
+    ASSERT_TRUE(response.has_value());
+    EXPECT_EQ(response->code, 200u);
+    EXPECT_EQ(nlohmann::json::parse(response->body).at("queries"), expected);
+  }
+
+  // Many IDs at once, by list or by range
+  for (uint64_t id = 1235; id < 1240; ++id) {
+    nlohmann::json other = search;
+    other["query_ID"]    = id;
+    EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::POST, "/v0/ReportSearchResults", other)));
+    EXPECT_TRUE(HTTPWorker::parseResponse(client).has_value());
+  }
+  for (const auto& [body, expected_ids] : {
+           std::pair{nlohmann::json{{"query_IDs", {1239, 4321, 1234}}},
+                     std::vector<uint64_t>{1239, 1234}},
+           std::pair{nlohmann::json{{"first_query_ID", 1237}, {"last_query_ID", 1300}},
+                     std::vector<uint64_t>{1237, 1238, 1239}},
+  }) {
+    EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::POST, "/v0/GetQueryData", body)));
+    response = HTTPWorker::parseResponse(client);
+    ASSERT_TRUE(response.has_value());
+    EXPECT_EQ(response->code, 200u);
+    std::vector<uint64_t> ids;
+    const nlohmann::json  queries = nlohmann::json::parse(response->body).at("queries");
+    for (const nlohmann::json& query : queries) {
+      ids.push_back(query.at("query_ID"));
+      EXPECT_EQ(query.at("clicked"), 1);
+    }
+    EXPECT_EQ(ids, expected_ids);
+  }
+
+  const nlohmann::json too_many = {
+      {"first_query_ID", 1},
+      { "last_query_ID", HTTPWorker::MAX_QUERY_IDS + 1}
+  };
+  EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::POST, "/v0/GetQueryData", too_many)));
+  response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 400u);
+
+  EXPECT_TRUE(pipe.shutdown());
+  server_thread.join();
+  history.close();
+  std::filesystem::remove_all(dir);
+}
+
+TEST(HTTPTest, GetAutofill) {
+  AutofillIndex autofill;
+  autofill.add("How do I pass Data Structures", 3);
+  autofill.add("How do I get out of Arch", 2);
+  autofill.add("How do I do a thing", 1);
+  autofill.add("Best Food Near RPI", 5);
+
+  HTTPServer          server_obj(PORT_NUM, 4, {}, {.autofill = &autofill});
+  ShutdownPipeWrapper pipe;
+  EXPECT_TRUE(pipe.init());
+  std::thread server_thread([&] { server_obj.run(pipe.get_fd()); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  TCPSocket client;
+  EXPECT_TRUE(client.create());
+  EXPECT_TRUE(client.connect("127.0.0.1", PORT_NUM));
+  EXPECT_TRUE(client.setTimeout<SO_RCVTIMEO>(1000));
+
+  HTTPRequest request(HTTPRequest::GET, "/v0/GetAutofill");
+  request.headers["Partial-Query"]   = "how do i ";
+  request.headers["Num-Suggestions"] = "2";
+  EXPECT_TRUE(client.send(request));
+  std::optional<HTTPResponse> response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 200u);
+  EXPECT_EQ(nlohmann::json::parse(response->body).at("suggestions"),
+            nlohmann::json({"How do I pass Data Structures", "How do I get out of Arch"}));
+
+  // Reported searches are suggested straight away
+  const nlohmann::json search = {
+      {  "query_ID",                  1},
+      { "raw_query", "How do I do a thing"},
+      {   "results",          {"link1"}},
+      {   "clicked",                  0}
+  };
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::POST, "/v0/ReportSearchResults", search)));
+    response = HTTPWorker::parseResponse(client);
+    ASSERT_TRUE(response.has_value());
+    EXPECT_EQ(response->code, 200u);
+  }
+  EXPECT_TRUE(client.send(request));
+  response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(nlohmann::json::parse(response->body).at("suggestions"),
+            nlohmann::json({"How do I do a thing", "How do I pass Data Structures"}));
+
+  request.headers["Num-Suggestions"] = "lots";
+  EXPECT_TRUE(client.send(request));
+  response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 400u);
+
+  EXPECT_TRUE(pipe.shutdown());
+  server_thread.join();
+}
+
+TEST(HTTPTest, ReportAndGetMetrics) {
+  MetricsStore        metrics;
+  HTTPServer          server_obj(PORT_NUM, 4, {}, {.metrics = &metrics});
+  ShutdownPipeWrapper pipe;
+  EXPECT_TRUE(pipe.init());
+  std::thread server_thread([&] { server_obj.run(pipe.get_fd()); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  TCPSocket client;
+  EXPECT_TRUE(client.create());
+  EXPECT_TRUE(client.connect("127.0.0.1", PORT_NUM));
+  EXPECT_TRUE(client.setTimeout<SO_RCVTIMEO>(1000));
+
+  const nlohmann::json report = {
+      {"metrics",
+       {{{"label", "latency_ms"}, {"value", 12}, {"timestamp", 60000}},
+        {{"label", "latency_ms"}, {"value", 4.5}, {"timestamp", 61000}},
+        {{"label", "latency_ms"}, {"value", 30}, {"timestamp", 125000}},
+        {{"label", "broken_links"}, {"value", {"rpi.edu/gone"}}, {"timestamp", 60000}}}}
+  };
+  HTTPRequest post(HTTPRequest::POST, "/v0/ReportMetrics", report);
+  post.headers["Component"] = "Crawling";
+  EXPECT_TRUE(client.send(post));
+  std::optional<HTTPResponse> response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 200u);
+
+  HTTPRequest get(HTTPRequest::GET, "/v0/GetMetrics");
+  get.headers["Component"] = "Crawling";
+  get.headers["Label"]     = "latency_ms";
+  get.headers["To"]        = "120000";
+  EXPECT_TRUE(client.send(get));
+  response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 200u);
+  const nlohmann::json expected_rollups = {
+      {{"start", 60000}, {"count", 2}, {"sum", 16.5}, {"min", 4.5}, {"max", 12}}
+  };
+  EXPECT_EQ(nlohmann::json::parse(response->body).at("rollups"), expected_rollups);
+
+  get.headers["Label"] = "broken_links";
+  get.headers.erase("To");
+  EXPECT_TRUE(client.send(get));
+  response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  const nlohmann::json expected_events = {
+      {{"timestamp", 60000}, {"value", {"rpi.edu/gone"}}}
+  };
+  EXPECT_EQ(nlohmann::json::parse(response->body).at("events"), expected_events);
+
+  // A batch with one bad entry is turned away as a whole
+  HTTPRequest bad(HTTPRequest::POST, "/v0/ReportMetrics",
+                  {{"metrics", {{{"label", "latency_ms"}, {"value", 1}}, {{"value", 2}}}}});
+  bad.headers["Component"] = "Crawling";
+  EXPECT_TRUE(client.send(bad));
+  response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 400u);
+  EXPECT_EQ(metrics.points("Crawling", "latency_ms", 0, 1000000).size(), 3u);
+
+  post.headers.erase("Component");
+  EXPECT_TRUE(client.send(post));
+  response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 400u);
+
+  EXPECT_TRUE(pipe.shutdown());
+  server_thread.join();
+}
+
+TEST(HTTPTest, ReportMetricsPastLimit) {
+  MetricsStore        metrics({.max_series = 1});
+  HTTPServer          server_obj(PORT_NUM, 4, {}, {.metrics = &metrics});
+  ShutdownPipeWrapper pipe;
+  EXPECT_TRUE(pipe.init());
+  std::thread server_thread([&] { server_obj.run(pipe.get_fd()); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  TCPSocket client;
+  EXPECT_TRUE(client.create());
+  EXPECT_TRUE(client.connect("127.0.0.1", PORT_NUM));
+  EXPECT_TRUE(client.setTimeout<SO_RCVTIMEO>(1000));
+
+  // The second label would be a second series, the first is still kept
+  const nlohmann::json report = {
+      {"metrics", {{{"label", "pages"}, {"value", 1}}, {{"label", "links"}, {"value", 2}}}}
+  };
+  HTTPRequest post(HTTPRequest::POST, "/v0/ReportMetrics", report);
+  post.headers["Component"] = "Crawling";
+  EXPECT_TRUE(client.send(post));
+  const std::optional<HTTPResponse> response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 507u);
+  EXPECT_EQ(metrics.points("Crawling", "pages", 0, INT64_MAX).size(), 1u);
+  EXPECT_TRUE(metrics.points("Crawling", "links", 0, INT64_MAX).empty());
+
+  EXPECT_TRUE(pipe.shutdown());
+  server_thread.join();
+}
+
+TEST(HTTPTest, GetQuantiles) {
+  MetricsStore metrics;
+  for (int value = 1; value <= 100; ++value) { metrics.record("Querying", "Query Time", 0, value); }
+  HTTPServer          server_obj(PORT_NUM, 4, {}, {.metrics = &metrics});
+  ShutdownPipeWrapper pipe;
+  EXPECT_TRUE(pipe.init());
+  std::thread server_thread([&] { server_obj.run(pipe.get_fd()); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  TCPSocket client;
+  EXPECT_TRUE(client.create());
+  EXPECT_TRUE(client.connect("127.0.0.1", PORT_NUM));
+  EXPECT_TRUE(client.setTimeout<SO_RCVTIMEO>(1000));
+
+  HTTPRequest request(HTTPRequest::GET, "/v0/GetQuantiles");
+  request.headers["Component"] = "Querying";
+  request.headers["Label"]     = "Query Time";
+  request.headers["Quantiles"] = "0, 0.5,1";
+  EXPECT_TRUE(client.send(request));
+  std::optional<HTTPResponse> response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 200u);
+  nlohmann::json body = nlohmann::json::parse(response->body);
+  EXPECT_EQ(body.at("count"), 100);
+  EXPECT_EQ(body.at("quantiles").at("0"), 1);
+  EXPECT_NEAR(body.at("quantiles").at("0.5").get<double>(), 50,
+              50 * QuantileSketch::RELATIVE_ERROR);
+  EXPECT_EQ(body.at("quantiles").at("1"), 100);
+
+  // Nothing reported in the range
+  request.headers["From"] = "60000";
+  request.headers.erase("Quantiles");
+  EXPECT_TRUE(client.send(request));
+  response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  body = nlohmann::json::parse(response->body);
+  EXPECT_EQ(body.at("count"), 0);
+  EXPECT_TRUE(body.at("quantiles").at("0.99").is_null());
+
+  request.headers["Quantiles"] = "0.5,2";
+  EXPECT_TRUE(client.send(request));
+  response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 400u);
+
+  EXPECT_TRUE(pipe.shutdown());
+  server_thread.join();
+}
+
+TEST(HTTPTest, GetServerStats) {
+  ServerStats         stats;
+  HTTPServer          server_obj(PORT_NUM, 4, {}, {.stats = &stats});
+  ShutdownPipeWrapper pipe;
+  EXPECT_TRUE(pipe.init());
+  std::thread server_thread([&] { server_obj.run(pipe.get_fd()); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  TCPSocket client;
+  EXPECT_TRUE(client.create());
+  EXPECT_TRUE(client.connect("127.0.0.1", PORT_NUM));
+  EXPECT_TRUE(client.setTimeout<SO_RCVTIMEO>(1000));
+
+  for (const char* target : {"/v0/GetQueryID", "/v0/GetQueryID", "/v0/GetQueryID", "/v0/Missing"}) {
+    EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::GET, target)));
+    ASSERT_TRUE(HTTPWorker::parseResponse(client).has_value());
+  }
+  EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::GET, "/v0/ServerStats")));
+  std::optional<HTTPResponse> response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 200u);
+
+  // This request is only counted once it is done
+  const nlohmann::json body = nlohmann::json::parse(response->body);
+  EXPECT_EQ(body.at("requests"), 4);
+  EXPECT_GT(body.at("bytes_in"), 0);
+  EXPECT_GT(body.at("bytes_out"), 0);
+  EXPECT_EQ(body.at("connections").at("open"), 1);
+  EXPECT_EQ(body.at("status_codes"), nlohmann::json({{"200", 3}, {"404", 1}}));
+  EXPECT_EQ(body.at("routes").size(), 2u);
+  EXPECT_EQ(body.at("routes").at("unrouted").at("requests"), 1);
+  const nlohmann::json& query_id = body.at("routes").at("/v0/GetQueryID");
+  EXPECT_EQ(query_id.at("requests"), 3);
+  for (const char* phase : {"first_byte", "parse", "handler", "send"}) {
+    const nlohmann::json& latency = query_id.at("latency_us").at(phase);
+    EXPECT_LE(latency.at("p50"), latency.at("max")) << phase;
+  }
+  EXPECT_GT(query_id.at("latency_us").at("first_byte").at("max"), 0);
+
+  EXPECT_TRUE(pipe.shutdown());
+  server_thread.join();
+  EXPECT_EQ(stats.summary().connections_opened, stats.summary().connections_closed);
+}
+
+TEST(HTTPTest, PrometheusMetrics) {
+  ServerStats         stats;
+  PrometheusRegistry  registry;
+  HTTPServer          server_obj(PORT_NUM, 4, {}, {.stats = &stats, .prometheus = &registry});
+  server_obj.registerMetrics(registry);
+  registry.addCounter("test_total", "Test", [] { return uint64_t{42}; });
+  ShutdownPipeWrapper pipe;
+  EXPECT_TRUE(pipe.init());
+  std::thread server_thread([&] { server_obj.run(pipe.get_fd()); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  TCPSocket client;
+  EXPECT_TRUE(client.create());
+  EXPECT_TRUE(client.connect("127.0.0.1", PORT_NUM));
+  EXPECT_TRUE(client.setTimeout<SO_RCVTIMEO>(1000));
+
+  for (const char* target : {"/v0/GetQueryID", "/v0/GetQueryID", "/metric", "/v0/metrics"}) {
+    EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::GET, target)));
+    ASSERT_TRUE(HTTPWorker::parseResponse(client).has_value());
+  }
+  EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::DELETE, "/metrics")));
+  std::optional<HTTPResponse> response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 405u);
+
+  EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::GET, "/metrics")));
+  response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 200u);
+  EXPECT_EQ(response->headers["content-type"], PrometheusRegistry::CONTENT_TYPE);
+  const std::string& body = response->body;
+  for (const char* line : {
+           "# TYPE evaluation_http_requests_total counter\n",
+           "evaluation_http_requests_total{route=\"/v0/GetQueryID\",code=\"200\"} 2\n",
+           "evaluation_http_requests_total{route=\"unrouted\",code=\"404\"} 2\n",
+           "evaluation_http_requests_total{route=\"/metrics\",code=\"405\"} 1\n",
+           "evaluation_http_request_seconds_count{route=\"/v0/GetQueryID\",phase=\"send\"} 2\n",
+           "evaluation_http_open_connections 1\n",
+           "evaluation_http_queued_connections 0\n",
+           "test_total 42\n",
+       }) {
+    EXPECT_NE(body.find(line), std::string::npos) << line;
+  }
+
+  EXPECT_TRUE(pipe.shutdown());
+  server_thread.join();
+}
+
+TEST(HTTPTest, ExportSearchHistory) {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "test_http_export";
+  std::filesystem::remove_all(dir);
+  SearchHistoryStore history;
+  ASSERT_TRUE(history.open((dir / "history.db").string()));
+  // More than one page, so the export takes a few chunks
+  const uint64_t num_records = (HTTPWorker::EXPORT_PAGE_SIZE * 3) / 2;
+  for (uint64_t id = 1; id <= num_records; ++id) {
+    EXPECT_TRUE(history.enqueue({.query_id        = id,
+                                 .raw_query       = "query " + std::to_string(id),
+                                 .results         = {"link1", "link2"},
+                                 .clicked         = 1,
+                                 .query_timestamp = ""}));
+  }
+  history.flush();
+
+  HTTPServer          server_obj(PORT_NUM, 4, {}, {.search_history = &history});
+  ShutdownPipeWrapper pipe;
+  EXPECT_TRUE(pipe.init());
+  std::thread server_thread([&] { server_obj.run(pipe.get_fd()); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  TCPSocket client;
+  EXPECT_TRUE(client.create());
+  EXPECT_TRUE(client.connect("127.0.0.1", PORT_NUM));
+  EXPECT_TRUE(client.setTimeout<SO_RCVTIMEO>(1000));
+
+  HTTPRequest request(HTTPRequest::GET, "/v0/ExportSearchHistory");
+  request.headers["After-ID"] = "10";
+  EXPECT_TRUE(client.send(request));
+  std::optional<HTTPResponse> response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 200u);
+  EXPECT_EQ(response->headers["transfer-encoding"], "chunked");
+
+  uint64_t           expected_id = 11;
+  std::istringstream lines(response->body);
+  for (std::string line; std::getline(lines, line); ++expected_id) {
+    const nlohmann::json query = nlohmann::json::parse(line);
+    EXPECT_EQ(query.at("query_ID"), expected_id);
+    EXPECT_EQ(query.at("raw_query"), "query " + std::to_string(expected_id));
+  }
+  EXPECT_EQ(expected_id, num_records + 1);
+
+  // The connection is still good for the next request
+  request.headers["After-ID"] = std::to_string(num_records);
+  EXPECT_TRUE(client.send(request));
+  response = HTTPWorker::parseResponse(client);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 200u);
+  EXPECT_EQ(response->body, "");
+
+  EXPECT_TRUE(pipe.shutdown());
+  server_thread.join();
+  history.close();
+  std::filesystem::remove_all(dir);
 }
@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "HTTPClient.h"
+#include "TestUtil.hpp"
+
+static constexpr uint16_t PORT_NUM = 8081;
+
+static HTTPClientConfig fastRetries() {
+  return {.timeout_ms = 500, .max_attempts = 3, .initial_backoff_ms = 10, .max_backoff_ms = 20};
+}
+
+TEST(HTTPClientTest, ReusesConnection) {
+  FakeHost   host(PORT_NUM);
+  HTTPClient client("localhost", PORT_NUM, fastRetries());
+  for (int i = 0; i < 3; ++i) {
+    std::optional<HTTPResponse> response =
+        client.send(HTTPRequest(HTTPRequest::POST, "/test", {{"i", i}})).response;
+    ASSERT_TRUE(response.has_value());
+    EXPECT_EQ(response->code, 200u);
+  }
+  EXPECT_EQ(host.connections(), 1u);
+
+  const std::vector<HTTPRequest> requests = host.requests();
+  ASSERT_EQ(requests.size(), 3u);
+  EXPECT_EQ(requests[2].resource, "/test");
+  EXPECT_EQ(requests[2].headers.at("host"), "localhost:8081");
+  EXPECT_EQ(requests[2].body, R"({"i":2})");
+}
+
+TEST(HTTPClientTest, ReconnectsWhenIdleConnectionClosed) {
+  FakeHost   host(PORT_NUM);
+  HTTPClient client("localhost", PORT_NUM, fastRetries());
+  EXPECT_TRUE(client.send(HTTPRequest(HTTPRequest::GET, "/test")).response.has_value());
+  std::this_thread::sleep_for(std::chrono::milliseconds(2 * FakeHost::IDLE_TIMEOUT_MS));
+
+  std::optional<HTTPResponse> response =
+      client.send(HTTPRequest(HTTPRequest::GET, "/test")).response;
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 200u);
+  EXPECT_EQ(host.connections(), 2u);
+  EXPECT_EQ(host.requests().size(), 2u);
+}
+
+TEST(HTTPClientTest, RetriesServerErrors) {
+  FakeHost   host(PORT_NUM, {503, 500});
+  HTTPClient client("localhost", PORT_NUM, fastRetries());
+  std::optional<HTTPResponse> response =
+      client.send(HTTPRequest(HTTPRequest::GET, "/test")).response;
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(response->code, 200u);
+  EXPECT_EQ(host.requests().size(), 3u);
+}
+
+TEST(HTTPClientTest, NoResendAfterTimeout) {
+  // Answers too late, after the request was already handled
+  FakeHost   host(PORT_NUM, {}, 2 * fastRetries().timeout_ms);
+  HTTPClient client("localhost", PORT_NUM, fastRetries());
+  const HTTPClient::Result result =
+      client.send(HTTPRequest(HTTPRequest::POST, "/test", {{"clicks", 1}}));
+  EXPECT_FALSE(result.response.has_value());
+  EXPECT_TRUE(result.sent);
+  // Sending it again could have it handled twice
+  EXPECT_TRUE(result.delivered());
+  EXPECT_EQ(host.requests().size(), 1u);
+}
+
+TEST(HTTPClientTest, GivesUp) {
+  {
+    FakeHost   host(PORT_NUM, {503, 503, 503, 503});
+    HTTPClient client("localhost", PORT_NUM, fastRetries());
+    std::optional<HTTPResponse> response =
+        client.send(HTTPRequest(HTTPRequest::GET, "/test")).response;
+    ASSERT_TRUE(response.has_value());
+    EXPECT_EQ(response->code, 503u);
+    EXPECT_EQ(host.requests().size(), 3u);
+  }
+
+  // Nothing listening any more
+  HTTPClient               client("localhost", PORT_NUM, fastRetries());
+  const HTTPClient::Result result = client.send(HTTPRequest(HTTPRequest::GET, "/test"));
+  EXPECT_FALSE(result.response.has_value());
+  EXPECT_FALSE(result.delivered());
+}
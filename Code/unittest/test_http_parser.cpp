@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+
+#include "ByteBuffer.h"
+#include "HTTPParser.h"
+
+// Feeds `message` to the parser one byte at a time, returning the result after the last byte
+static HTTPParser::Result parseBytewise(HTTPParser& parser, ByteBuffer& buffer,
+                                        std::string_view message) {
+  HTTPParser::Result result = HTTPParser::INCOMPLETE;
+  for (const char c : message) {
+    EXPECT_EQ(result, HTTPParser::INCOMPLETE);
+    buffer.append(std::string_view(&c, 1));
+    result = parser.parse(buffer);
+  }
+  return result;
+}
+
+TEST(HTTPParserTest, ParseRequest) {
+  const std::string_view get =
+      "GET /v0/GetAutofill HTTP/1.1\r\n"
+      "Num-Suggestions: 10\r\n"
+      "Partial-Query:   How do I make  \r\n"
+      "\r\n";
+  ByteBuffer buffer;
+  buffer.append(get);
+  HTTPParser parser;
+  ASSERT_EQ(parser.parse(buffer), HTTPParser::COMPLETE);
+  EXPECT_EQ(parser.length(), get.size());
+
+  const HTTPRequestView request = parser.request(buffer);
+  EXPECT_EQ(request.method, "GET");
+  EXPECT_EQ(request.target, "/v0/GetAutofill");
+  EXPECT_EQ(request.version, "HTTP/1.1");
+  ASSERT_EQ(request.headers.size(), 2u);
+  EXPECT_EQ(request.headers.begin()->name, "Num-Suggestions");
+  EXPECT_EQ(request.headers.get("partial-query"), "How do I make");
+  EXPECT_FALSE(request.headers.contains("content-length"));
+  EXPECT_TRUE(request.body.empty());
+
+  // Views point straight into the buffer
+  EXPECT_EQ(request.target.data(), buffer.data() + 4);
+}
+
+TEST(HTTPParserTest, ParseIncrementally) {
+  const std::string_view post =
+      "POST /v0/ReportMetrics HTTP/1.1\r\nContent-Length: 5\r\n\r\n"
+      "abcde";
+  ByteBuffer buffer;
+  HTTPParser parser;
+  ASSERT_EQ(parseBytewise(parser, buffer, post), HTTPParser::COMPLETE);
+  EXPECT_EQ(parser.length(), post.size());
+  EXPECT_EQ(parser.request(buffer).body, "abcde");
+}
+
+TEST(HTTPParserTest, PipelinedRequests) {
+  const std::string_view post =
+      "POST /v0/ReportMetrics HTTP/1.1\r\nContent-Length: 5\r\n\r\n"
+      "abcde";
+  const std::string_view get = "GET /v0/GetQueryID HTTP/1.1\r\n\r\n";
+  ByteBuffer             buffer;
+  buffer.append(post);
+  buffer.append(get);
+
+  HTTPParser parser;
+  ASSERT_EQ(parser.parse(buffer), HTTPParser::COMPLETE);
+  EXPECT_EQ(parser.length(), post.size());
+  buffer.consume(parser.length());
+  parser.reset();
+
+  ASSERT_EQ(parser.parse(buffer), HTTPParser::COMPLETE);
+  EXPECT_EQ(parser.request(buffer).target, "/v0/GetQueryID");
+  EXPECT_EQ(parser.length(), buffer.size());
+}
+
+TEST(HTTPParserTest, ChunkedBody) {
+  const std::string_view chunked =
+      "POST /v0/ReportMetrics HTTP/1.1\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "\r\n"
+      "7\r\n{\"metri\r\n"
+      "a;ext=1\r\ncs\": []}\r\n\r\n"
+      "0\r\n"
+      "Trailer: ignored\r\n"
+      "\r\n";
+  ByteBuffer buffer;
+  HTTPParser parser;
+  ASSERT_EQ(parseBytewise(parser, buffer, chunked), HTTPParser::COMPLETE);
+  EXPECT_EQ(parser.length(), chunked.size());
+
+  const HTTPRequestView request = parser.request(buffer);
+  EXPECT_EQ(request.body, "{\"metrics\": []}\r\n");
+  EXPECT_EQ(request.headers.size(), 1u);
+}
+
+TEST(HTTPParserTest, RejectsJunkEarly) {
+  ByteBuffer buffer;
+  HTTPParser parser;
+  buffer.append("GE");
+  EXPECT_EQ(parser.parse(buffer), HTTPParser::INCOMPLETE);
+  buffer.append("X");
+  EXPECT_EQ(parser.parse(buffer), HTTPParser::ERROR);
+  EXPECT_EQ(parser.error(), HTTPParser::BAD_START_LINE);
+}
+
+TEST(HTTPParserTest, BadFraming) {
+  const auto parse = [](std::string_view message) {
+    ByteBuffer buffer;
+    buffer.append(message);
+    HTTPParser parser;
+    EXPECT_EQ(parser.parse(buffer), HTTPParser::ERROR);
+    return parser.error();
+  };
+  EXPECT_EQ(parse("POST / HTTP/1.1\r\nContent-Length: abc\r\n\r\n"),
+            HTTPParser::BAD_CONTENT_LENGTH);
+  EXPECT_EQ(parse("POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n"),
+            HTTPParser::BAD_CONTENT_LENGTH);
+  EXPECT_EQ(parse("POST / HTTP/1.1\r\nContent-Length: 999999999999\r\n\r\n"),
+            HTTPParser::BODY_TOO_LARGE);
+  EXPECT_EQ(parse("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n"),
+            HTTPParser::BAD_CHUNK);
+  EXPECT_EQ(parse("GET / HTTP/1.1\r\nNo colon here\r\n\r\n"), HTTPParser::BAD_HEADER);
+  EXPECT_EQ(parse("GET /  HTTP/1.1\r\n\r\n"), HTTPParser::BAD_START_LINE);
+
+  std::string many_headers = "GET / HTTP/1.1\r\n";
+  for (std::size_t i = 0; i <= HTTPHeaderList::MAX_HEADERS; ++i) { many_headers += "A: b\r\n"; }
+  EXPECT_EQ(parse(many_headers), HTTPParser::TOO_MANY_HEADERS);
+}
+
+TEST(HTTPParserTest, HeadersAvailableOnError) {
+  ByteBuffer buffer;
+  buffer.append("POST / HTTP/1.1\r\nContent-Length: ABCDEFG\r\n\r\n");
+  HTTPParser parser;
+  ASSERT_EQ(parser.parse(buffer), HTTPParser::ERROR);
+  EXPECT_TRUE(parser.headersComplete());
+  EXPECT_EQ(parser.request(buffer).headers.get("Content-Length"), "ABCDEFG");
+}
+
+TEST(HTTPParserTest, ResponseUntilClose) {
+  ByteBuffer buffer;
+  buffer.append("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\nsome body");
+  HTTPParser parser(HTTPParser::RESPONSE);
+  EXPECT_EQ(parser.parse(buffer), HTTPParser::INCOMPLETE);
+  ASSERT_EQ(parser.finish(buffer), HTTPParser::COMPLETE);
+
+  const HTTPResponseView response = parser.response(buffer);
+  EXPECT_EQ(response.code, 200u);
+  EXPECT_EQ(response.status, "OK");
+  EXPECT_EQ(response.body, "some body");
+}
+
+TEST(HTTPParserTest, ResponseWithoutBody) {
+  ByteBuffer buffer;
+  buffer.append("HTTP/1.1 204 No Content\r\n\r\n");
+  HTTPParser parser(HTTPParser::RESPONSE);
+  ASSERT_EQ(parser.parse(buffer), HTTPParser::COMPLETE);
+  EXPECT_EQ(parser.response(buffer).status, "No Content");
+}
+
+TEST(ByteBufferTest, ReusesSpace) {
+  ByteBuffer buffer(16);
+  buffer.append("0123456789");
+  buffer.consume(8);
+  EXPECT_EQ(buffer.view(), "89");
+
+  // Slides the unread bytes down instead of growing
+  buffer.append("abcdefghij");
+  EXPECT_EQ(buffer.view(), "89abcdefghij");
+  EXPECT_EQ(buffer.capacity(), 16u);
+
+  buffer.append("klmnopqrstuvwxyz");
+  EXPECT_EQ(buffer.view(), "89abcdefghijklmnopqrstuvwxyz");
+  EXPECT_GE(buffer.capacity(), buffer.size());
+
+  buffer.consume(buffer.size());
+  EXPECT_TRUE(buffer.empty());
+}
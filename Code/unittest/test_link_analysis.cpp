@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "LinkAnalysisForwarder.h"
+#include "TestUtil.hpp"
+
+static constexpr uint16_t PORT_NUM = 8082;
+
+static LinkAnalysisConfig testConfig() {
+  return {.window_ms = 50,
+          .client    = {.timeout_ms = 500, .initial_backoff_ms = 10, .max_backoff_ms = 20}};
+}
+
+// Clicks per link across every update the host was sent
+static std::map<std::string, unsigned int> receivedClicks(FakeHost& host) {
+  std::map<std::string, unsigned int> clicks;
+  for (const HTTPRequest& request : host.requests()) {
+    EXPECT_EQ(request.resource, "/evaluation/update_metadata");
+    const nlohmann::json            body   = nlohmann::json::parse(request.body);
+    const std::vector<std::string>  links  = body.at("list_of_clicked_links");
+    const std::vector<unsigned int> counts = body.at("click_count");
+    EXPECT_EQ(links.size(), counts.size());
+    for (std::size_t i = 0; i < links.size(); ++i) { clicks[links[i]] += counts[i]; }
+  }
+  return clicks;
+}
+
+TEST(LinkAnalysisTest, BatchesClicks) {
+  FakeHost              host(PORT_NUM);
+  LinkAnalysisForwarder forwarder("localhost", PORT_NUM, testConfig());
+  forwarder.start();
+  for (int i = 0; i < 100; ++i) { EXPECT_TRUE(forwarder.recordClick("link1")); }
+  EXPECT_TRUE(forwarder.recordClick("link2"));
+  forwarder.stop();
+
+  EXPECT_EQ(receivedClicks(host), (std::map<std::string, unsigned int>{{"link1", 100},
+                                                                       {"link2", 1}}));
+  // One window should have covered all of them
+  EXPECT_LE(host.requests().size(), 2u);
+}
+
+TEST(LinkAnalysisTest, KeepsClicksWhileUnavailable) {
+  // Every attempt in the first window fails
+  FakeHost              host(PORT_NUM, {503, 503, 503, 503});
+  LinkAnalysisForwarder forwarder("localhost", PORT_NUM, testConfig());
+  forwarder.start();
+  EXPECT_TRUE(forwarder.recordClick("link1"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_TRUE(forwarder.recordClick("link1"));
+  forwarder.stop();
+
+  // Each of the four failed attempts carried the first click as well
+  EXPECT_EQ(receivedClicks(host)["link1"], 4u + 2u);
+}
+
+TEST(LinkAnalysisTest, NeverCountsClicksTwice) {
+  // Takes the clicks, but answers too late
+  FakeHost              host(PORT_NUM, {}, 2 * testConfig().client.timeout_ms);
+  LinkAnalysisForwarder forwarder("localhost", PORT_NUM, testConfig());
+  forwarder.start();
+  EXPECT_TRUE(forwarder.recordClick("link1"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(800));
+  forwarder.stop();
+
+  EXPECT_EQ(receivedClicks(host)["link1"], 1u);
+}
+
+TEST(LinkAnalysisTest, LimitsPendingLinks) {
+  LinkAnalysisConfig config = testConfig();
+  config.max_pending        = 2;
+  config.window_ms          = 60 * 1000;
+  LinkAnalysisForwarder forwarder("localhost", PORT_NUM, config);
+  EXPECT_FALSE(forwarder.recordClick("link1"));    // Not started
+  forwarder.start();
+  EXPECT_TRUE(forwarder.recordClick("link1"));
+  EXPECT_TRUE(forwarder.recordClick("link2"));
+  EXPECT_FALSE(forwarder.recordClick("link3"));
+  EXPECT_TRUE(forwarder.recordClick("link1"));
+}
@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+#include "LogLinearHistogram.h"
+
+TEST(LogLinearHistogramTest, Buckets) {
+  // Buckets are contiguous, and every value lands in the bucket covering it
+  uint64_t next = 0;
+  for (std::size_t bucket = 0; bucket < LogLinearHistogram::BUCKETS; ++bucket) {
+    EXPECT_EQ(LogLinearHistogram::lowerBound(bucket), next) << bucket;
+    next = LogLinearHistogram::lowerBound(bucket) + LogLinearHistogram::width(bucket);
+  }
+  EXPECT_EQ(next, uint64_t{1} << LogLinearHistogram::MAX_BITS);
+
+  for (const uint64_t value : {0ULL, 7ULL, 8ULL, 1000ULL, 123456789ULL, (1ULL << 36) - 1}) {
+    const std::size_t bucket = LogLinearHistogram::bucketOf(value);
+    EXPECT_LE(LogLinearHistogram::lowerBound(bucket), value);
+    EXPECT_LT(value, LogLinearHistogram::lowerBound(bucket) + LogLinearHistogram::width(bucket));
+    // Never off by more than one part in SUB_BUCKETS
+    EXPECT_LE(LogLinearHistogram::width(bucket) * LogLinearHistogram::SUB_BUCKETS,
+              std::max<uint64_t>(value, LogLinearHistogram::SUB_BUCKETS));
+  }
+  EXPECT_EQ(LogLinearHistogram::bucketOf(UINT64_MAX), LogLinearHistogram::BUCKETS - 1);
+}
+
+TEST(LogLinearHistogramTest, Quantiles) {
+  LogLinearHistogram histogram;
+  HistogramSummary   empty;
+  empty.merge(histogram);
+  EXPECT_EQ(empty.count(), 0u);
+  EXPECT_FALSE(empty.quantile(0.5).has_value());
+
+  for (uint64_t us = 1; us <= 1000; ++us) { histogram.record(us * 1000); }
+  HistogramSummary summary;
+  summary.merge(histogram);
+  summary.merge(histogram);
+  EXPECT_EQ(summary.count(), 2000u);
+  EXPECT_EQ(summary.sum(), 1001000000u);
+  EXPECT_DOUBLE_EQ(summary.mean(), 500500);
+  for (const auto& [q, exact] : {std::pair(0.5, 500000.0), std::pair(0.99, 990000.0),
+                                 std::pair(1.0, 1000000.0)}) {
+    const std::optional<double> estimate = summary.quantile(q);
+    ASSERT_TRUE(estimate.has_value());
+    EXPECT_NEAR(*estimate, exact, exact / LogLinearHistogram::SUB_BUCKETS) << "q = " << q;
+  }
+}
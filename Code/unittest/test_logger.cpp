@@ -1,7 +1,15 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "Logger.h"
 
@@ -104,3 +112,112 @@ TEST(LoggerTest, TestCloseConsole) {
   LOG(CRITICAL) << "WE HAVE A HUGE HUGE PROBLEM AHHH";
   EXPECT_TRUE(testing::internal::GetCapturedStdout().empty());
 }
+
+static std::vector<std::string> readLines(const std::filesystem::path& path) {
+  std::ifstream            log_file(path);
+  std::vector<std::string> lines;
+  std::string              line;
+  while (std::getline(log_file, line)) { lines.push_back(line); }
+  return lines;
+}
+
+TEST(LoggerTest, TestAsync) {
+  const std::filesystem::path log_path = std::filesystem::temp_directory_path() / "test_async.log";
+  std::filesystem::remove(log_path);
+  Logger::addFile(log_path);
+  // Small enough that the threads have to wait on the writer
+  Logger::startAsync({.capacity = 16, .overflow = AsyncLogConfig::BLOCK, .flush_interval_ms = 1});
+
+  static constexpr int     THREADS  = 4;
+  static constexpr int     MESSAGES = 500;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; ++t) {
+    threads.emplace_back([t] {
+      for (int i = 0; i < MESSAGES; ++i) { LOG(INFO) << "Thread " << t << " message " << i; }
+    });
+  }
+  for (std::thread& thread : threads) { thread.join(); }
+  Logger::flush();
+
+  // Nothing lost, and each thread's messages are in the order it logged them
+  std::array<int, THREADS> next{};
+  for (const std::string& line : readLines(log_path)) {
+    const std::size_t at = line.find("Thread ");
+    if (at == std::string::npos) { continue; }
+    int t = 0;
+    int i = 0;
+    ASSERT_EQ(std::sscanf(line.c_str() + at, "Thread %d message %d", &t, &i), 2) << line;
+    EXPECT_EQ(i, next.at(t)++);
+  }
+  for (const int count : next) { EXPECT_EQ(count, MESSAGES); }
+
+  // Written before LOG returns, without waiting on a flush
+  LOG(CRITICAL) << "Critical and async";
+  EXPECT_THAT(readLines(log_path).back() + "\n",
+              testing::MatchesRegex(log_regex("CRITICAL", "Critical and async")));
+
+  Logger::stopAsync();
+  Logger::removeFile(log_path);
+}
+
+TEST(LoggerTest, TestAsyncDrop) {
+  const std::filesystem::path log_path = std::filesystem::temp_directory_path() / "test_drop.log";
+  std::filesystem::remove(log_path);
+  Logger::addFile(log_path);
+  // The writer only wakes up when stopped, so nearly everything is dropped
+  const uint64_t dropped_before = Logger::droppedMessages();
+  Logger::startAsync({.capacity = 4, .overflow = AsyncLogConfig::DROP, .flush_interval_ms = 60000});
+  for (int i = 0; i < 100; ++i) { LOG(INFO) << "Dropped message " << i; }
+  EXPECT_GT(Logger::queuedMessages(), 0u);
+  EXPECT_LE(Logger::queuedMessages(), 4u);
+  Logger::stopAsync();
+  Logger::removeFile(log_path);
+  EXPECT_EQ(Logger::queuedMessages(), 0u);
+
+  const std::vector<std::string> lines   = readLines(log_path);
+  const auto written = std::ranges::count_if(lines, [](const std::string& line) {
+    return line.find("Dropped message") != std::string::npos;
+  });
+  EXPECT_GE(written, 4);
+  EXPECT_LT(written, 100);
+  EXPECT_EQ(Logger::droppedMessages() - dropped_before, static_cast<uint64_t>(100 - written));
+  EXPECT_THAT(lines.back() + "\n",
+              testing::MatchesRegex(log_regex("WARN", "Dropped [0-9]+ log messages")));
+}
+
+TEST(LoggerTest, TestSkipsFormatting) {
+  int  evaluated = 0;
+  auto evaluate  = [&evaluated] { return ++evaluated; };
+
+  testing::internal::CaptureStdout();
+  Logger::addConsole(INFO);
+  LOG(DEBUG) << evaluate();
+  EXPECT_EQ(evaluated, 0);
+  LOG(INFO) << evaluate();
+  EXPECT_EQ(evaluated, 1);
+  Logger::removeConsole();
+  testing::internal::GetCapturedStdout();
+
+  // Not even CRITICAL is formatted with nowhere to write it
+  LOG(CRITICAL) << evaluate();
+  EXPECT_EQ(evaluated, 1);
+}
+
+// As if built with -DLOG_COMPILED_LEVEL=WARN, from here down
+#undef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL WARN
+
+TEST(LoggerTest, TestCompiledLevel) {
+  int  evaluated = 0;
+  auto evaluate  = [&evaluated] { return ++evaluated; };
+
+  testing::internal::CaptureStdout();
+  Logger::addConsole(TRACE);
+  LOG(INFO) << evaluate();
+  LOG(TRACE) << evaluate();
+  EXPECT_EQ(evaluated, 0);
+  LOG(WARN) << evaluate();
+  EXPECT_EQ(evaluated, 1);
+  Logger::removeConsole();
+  EXPECT_THAT(testing::internal::GetCapturedStdout(), testing::HasSubstr("WARN"));
+}
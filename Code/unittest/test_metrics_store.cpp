@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <vector>
+
+#include "MetricsStore.h"
+#include "TimeSeriesBlock.h"
+
+static std::vector<MetricPoint> readAll(const TimeSeriesBlock& block) {
+  std::vector<MetricPoint> points;
+  TimeSeriesBlock::Reader  reader = block.reader();
+  MetricPoint              point{.timestamp_ms = 0, .value = 0};
+  while (reader.next(point.timestamp_ms, point.value)) { points.push_back(point); }
+  return points;
+}
+
+TEST(TimeSeriesBlockTest, RoundTrip) {
+  const std::vector<MetricPoint> expected = {
+      {                       1700000000000,                                    12.5},
+      {                       1700000001000,                                    12.5},
+      {                       1700000002000,                                    13.0},
+      // Out of order
+      {                       1700000001500,                                      -7},
+      {                       1700000001500,                                       0},
+      {                                  -5,                                   1e300},
+      {std::numeric_limits<int64_t>::max(), std::numeric_limits<double>::infinity()},
+      {std::numeric_limits<int64_t>::min(),      std::numeric_limits<double>::min()},
+      {                       1700000003000,                               0.1 + 0.2},
+  };
+  TimeSeriesBlock block;
+  for (const MetricPoint& point : expected) {
+    EXPECT_TRUE(block.append(point.timestamp_ms, point.value));
+  }
+  EXPECT_EQ(block.size(), expected.size());
+  EXPECT_EQ(block.minTimestamp(), std::numeric_limits<int64_t>::min());
+  EXPECT_EQ(block.maxTimestamp(), std::numeric_limits<int64_t>::max());
+
+  const std::vector<MetricPoint> points = readAll(block);
+  ASSERT_EQ(points.size(), expected.size());
+  for (std::size_t i = 0; i < points.size(); ++i) {
+    EXPECT_EQ(points[i].timestamp_ms, expected[i].timestamp_ms);
+    EXPECT_EQ(points[i].value, expected[i].value);
+  }
+
+  TimeSeriesBlock nan;
+  EXPECT_TRUE(nan.append(0, std::numeric_limits<double>::quiet_NaN()));
+  EXPECT_TRUE(std::isnan(readAll(nan).at(0).value));
+}
+
+TEST(TimeSeriesBlockTest, FullAndCompact) {
+  TimeSeriesBlock block;
+  for (std::size_t i = 0; i < TimeSeriesBlock::CAPACITY; ++i) {
+    EXPECT_TRUE(block.append(static_cast<int64_t>(i) * 1000, static_cast<double>(i % 4)));
+  }
+  EXPECT_TRUE(block.full());
+  EXPECT_FALSE(block.append(0, 0));
+  // A regular report of a slowly moving value is a small fraction of 16 bytes a point
+  EXPECT_LT(block.bytes(), TimeSeriesBlock::CAPACITY * 4);
+
+  const std::vector<MetricPoint> points = readAll(block);
+  ASSERT_EQ(points.size(), TimeSeriesBlock::CAPACITY);
+  for (std::size_t i = 0; i < points.size(); ++i) {
+    EXPECT_EQ(points[i].timestamp_ms, static_cast<int64_t>(i) * 1000);
+    EXPECT_EQ(points[i].value, static_cast<double>(i % 4));
+  }
+}
+
+TEST(MetricsStoreTest, Rollups) {
+  MetricsStore metrics;
+  metrics.record("Querying", "latency_ms", 0, 10);
+  metrics.record("Querying", "latency_ms", 59999, 20);
+  metrics.record("Querying", "latency_ms", 60000, 5);
+  metrics.record("Querying", "latency_ms", -1, 100);
+  metrics.record("Querying", "latency_ms", MetricsStore::HOUR_MS + 1, 1);
+  metrics.record("Crawling", "latency_ms", 0, 1000);
+
+  const std::vector<MetricRollup> minutes =
+      metrics.rollups("Querying", "latency_ms", MetricsStore::MINUTE, 0, MetricsStore::HOUR_MS);
+  ASSERT_EQ(minutes.size(), 2u);
+  EXPECT_EQ(minutes[0].start_ms, 0);
+  EXPECT_EQ(minutes[0].count, 2u);
+  EXPECT_EQ(minutes[0].sum, 30);
+  EXPECT_EQ(minutes[0].min, 10);
+  EXPECT_EQ(minutes[0].max, 20);
+  EXPECT_EQ(minutes[1].start_ms, 60000);
+  EXPECT_EQ(minutes[1].count, 1u);
+
+  const std::vector<MetricRollup> hours =
+      metrics.rollups("Querying", "latency_ms", MetricsStore::HOUR, -MetricsStore::HOUR_MS,
+                      2 * MetricsStore::HOUR_MS);
+  ASSERT_EQ(hours.size(), 3u);
+  EXPECT_EQ(hours[0].start_ms, -MetricsStore::HOUR_MS);
+  EXPECT_EQ(hours[1].count, 3u);
+  EXPECT_EQ(hours[1].max, 20);
+  EXPECT_EQ(hours[2].sum, 1);
+
+  const std::vector<MetricPoint> points = metrics.points("Querying", "latency_ms", 0, 60001);
+  ASSERT_EQ(points.size(), 3u);
+  EXPECT_EQ(points[0].value, 10);
+  EXPECT_EQ(points[2].timestamp_ms, 60000);
+
+  EXPECT_TRUE(metrics.rollups("Indexing", "latency_ms", MetricsStore::MINUTE, 0, 1).empty());
+  EXPECT_TRUE(metrics.points("Querying", "missing", 0, 1).empty());
+}
+
+TEST(MetricsStoreTest, Events) {
+  MetricsStore metrics;
+  metrics.record("Crawling", "broken_links", 20, {"a.com", "b.com"});
+  metrics.record("Crawling", "broken_links", 10, {{"url", "c.com"}});
+  metrics.record("Crawling", "broken_links", 30, 3);
+
+  const std::vector<MetricEvent> events = metrics.events("Crawling", "broken_links", 0, 25);
+  ASSERT_EQ(events.size(), 2u);
+  EXPECT_EQ(events[0].timestamp_ms, 10);
+  EXPECT_EQ(nlohmann::json::parse(events[0].value), nlohmann::json({{"url", "c.com"}}));
+  EXPECT_EQ(nlohmann::json::parse(events[1].value), nlohmann::json({"a.com", "b.com"}));
+  // Numbers are kept as points, not events
+  EXPECT_EQ(metrics.points("Crawling", "broken_links", 0, 100).size(), 1u);
+}
+
+TEST(MetricsStoreTest, Retention) {
+  MetricsStore metrics(
+      {.max_blocks = 1, .max_events = 2, .max_minute_rollups = 2, .max_hour_rollups = 1});
+  const auto points = static_cast<int64_t>(3 * TimeSeriesBlock::CAPACITY);
+  for (int64_t i = 0; i < points; ++i) { metrics.record("Indexing", "docs", i, 1); }
+  // One full block, along with the one being filled
+  EXPECT_EQ(metrics.points("Indexing", "docs", 0, points).size(), 2 * TimeSeriesBlock::CAPACITY);
+
+  for (int64_t minute = 0; minute < 3; ++minute) {
+    metrics.record("Indexing", "size", minute * MetricsStore::MINUTE_MS, 1);
+  }
+  const std::vector<MetricRollup> minutes =
+      metrics.rollups("Indexing", "size", MetricsStore::MINUTE, 0, MetricsStore::HOUR_MS);
+  ASSERT_EQ(minutes.size(), 2u);
+  EXPECT_EQ(minutes[0].start_ms, MetricsStore::MINUTE_MS);
+
+  for (int64_t i = 0; i < 3; ++i) { metrics.record("Indexing", "errors", i, "error"); }
+  const std::vector<MetricEvent> events = metrics.events("Indexing", "errors", 0, 3);
+  ASSERT_EQ(events.size(), 2u);
+  EXPECT_EQ(events[0].timestamp_ms, 1);
+}
+
+TEST(MetricsStoreTest, Limits) {
+  MetricsStore metrics({.max_series = 2, .max_event_bytes = 10});
+  EXPECT_TRUE(metrics.record("Crawling", "pages", 0, 1));
+  EXPECT_TRUE(metrics.record("Crawling", "errors", 0, "abc"));
+  // Both series already exist, a third does not fit
+  EXPECT_TRUE(metrics.record("Crawling", "pages", 1, 2));
+  EXPECT_FALSE(metrics.record("Crawling", "links", 0, 1));
+  EXPECT_TRUE(metrics.points("Crawling", "links", 0, 10).empty());
+
+  // "abc" is 5 bytes dumped, so a third pushes out the first
+  EXPECT_TRUE(metrics.record("Crawling", "errors", 1, "def"));
+  EXPECT_TRUE(metrics.record("Crawling", "errors", 2, "ghi"));
+  std::vector<MetricEvent> events = metrics.events("Crawling", "errors", 0, 10);
+  ASSERT_EQ(events.size(), 2u);
+  EXPECT_EQ(events[0].timestamp_ms, 1);
+
+  // Too large on its own, and leaves what is there alone
+  EXPECT_FALSE(metrics.record("Crawling", "errors", 3, "too long to keep"));
+  events = metrics.events("Crawling", "errors", 0, 10);
+  ASSERT_EQ(events.size(), 2u);
+  EXPECT_EQ(events[1].timestamp_ms, 2);
+}
+
+TEST(MetricsStoreTest, Quantiles) {
+  MetricsStore metrics;
+  // Minute after minute of latencies from 1 to 100, across two and a half hours
+  const int64_t end_ms = (5 * MetricsStore::HOUR_MS) / 2;
+  for (int64_t minute = 0; minute * MetricsStore::MINUTE_MS < end_ms; ++minute) {
+    for (int value = 1; value <= 100; ++value) {
+      metrics.record("Querying", "Query Time", minute * MetricsStore::MINUTE_MS, value);
+    }
+  }
+
+  // Hours in the middle, minutes at either end
+  const QuantileSketch sketch = metrics.quantiles("Querying", "Query Time",
+                                                  MetricsStore::HOUR_MS / 2, end_ms);
+  EXPECT_EQ(sketch.count(), 120u * 100u);
+  EXPECT_NEAR(sketch.quantile(0.5).value(), 50, 50 * QuantileSketch::RELATIVE_ERROR);
+  EXPECT_NEAR(sketch.quantile(0.99).value(), 99, 99 * QuantileSketch::RELATIVE_ERROR);
+  EXPECT_EQ(sketch.max(), 100);
+
+  EXPECT_EQ(metrics.quantiles("Querying", "Query Time", 0, MetricsStore::MINUTE_MS).count(), 100u);
+  EXPECT_EQ(metrics.quantiles("Querying", "Query Time", std::numeric_limits<int64_t>::min(),
+                              std::numeric_limits<int64_t>::max())
+                .count(),
+            150u * 100u);
+  EXPECT_EQ(metrics.quantiles("Querying", "Query Time", end_ms, 2 * end_ms).count(), 0u);
+  EXPECT_EQ(metrics.quantiles("Querying", "missing", 0, end_ms).count(), 0u);
+}
@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MPSCRingBuffer.h"
+
+TEST(MPSCRingBufferTest, FirstInFirstOut) {
+  MPSCRingBuffer<std::string> buffer(3);
+  EXPECT_EQ(buffer.capacity(), 4u);
+
+  std::string value;
+  EXPECT_FALSE(buffer.tryPop(value));
+  for (int lap = 0; lap < 3; ++lap) {
+    for (int i = 0; i < 4; ++i) {
+      std::string pushed = std::to_string(i);
+      EXPECT_TRUE(buffer.tryPush(std::move(pushed)));
+    }
+    std::string extra = "extra";
+    EXPECT_FALSE(buffer.tryPush(std::move(extra)));
+    EXPECT_EQ(extra, "extra");    // Left alone when full
+    EXPECT_EQ(buffer.claimed(), static_cast<std::size_t>(lap + 1) * 4);
+
+    for (int i = 0; i < 4; ++i) {
+      ASSERT_TRUE(buffer.tryPop(value));
+      EXPECT_EQ(value, std::to_string(i));
+    }
+    EXPECT_FALSE(buffer.tryPop(value));
+  }
+}
+
+TEST(MPSCRingBufferTest, ManyProducers) {
+  static constexpr uint64_t PRODUCERS = 4;
+  static constexpr uint64_t VALUES    = 20000;
+  MPSCRingBuffer<uint64_t>  buffer(64);
+
+  std::vector<std::thread> producers;
+  for (uint64_t p = 0; p < PRODUCERS; ++p) {
+    producers.emplace_back([&buffer, p] {
+      for (uint64_t i = 0; i < VALUES; ++i) {
+        uint64_t value = (p << 32) | i;
+        while (!buffer.tryPush(std::move(value))) { std::this_thread::yield(); }
+      }
+    });
+  }
+
+  // Every value comes out once, and each producer's in the order it pushed them
+  std::vector<uint64_t> next(PRODUCERS, 0);
+  for (uint64_t popped = 0; popped < PRODUCERS * VALUES;) {
+    uint64_t value = 0;
+    if (!buffer.tryPop(value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    const uint64_t producer = value >> 32;
+    ASSERT_LT(producer, PRODUCERS);
+    EXPECT_EQ(value & 0xFFFFFFFF, next[producer]++);
+    ++popped;
+  }
+  for (std::thread& producer : producers) { producer.join(); }
+  uint64_t value = 0;
+  EXPECT_FALSE(buffer.tryPop(value));
+}
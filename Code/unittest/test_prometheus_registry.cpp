@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LogLinearHistogram.h"
+#include "PrometheusRegistry.h"
+#include "ShardedCounter.h"
+
+TEST(PrometheusRegistryTest, Samples) {
+  PrometheusWriter out;
+  out.family("requests_total", "Requests\nhandled, in \\ total", PrometheusWriter::COUNTER);
+  out.sample("requests_total", {}, UINT64_MAX);
+  out.sample("requests_total", {{"route", "/v0/\"a\"\\b\n"}, {"code", "200"}}, uint64_t{3});
+  out.family("load", "Load", PrometheusWriter::GAUGE);
+  out.sample("load", {}, 0.25);
+  out.sample("load", {{"host", "a"}}, -std::numeric_limits<double>::infinity());
+  EXPECT_EQ(out.take(),
+            "# HELP requests_total Requests\\nhandled, in \\\\ total\n"
+            "# TYPE requests_total counter\n"
+            "requests_total 18446744073709551615\n"
+            "requests_total{route=\"/v0/\\\"a\\\"\\\\b\\n\",code=\"200\"} 3\n"
+            "# HELP load Load\n"
+            "# TYPE load gauge\n"
+            "load 0.25\n"
+            "load{host=\"a\"} -Inf\n");
+}
+
+TEST(PrometheusRegistryTest, Summary) {
+  LogLinearHistogram histogram;
+  for (uint64_t value = 1; value <= 10; ++value) { histogram.record(value); }
+  HistogramSummary summary;
+  summary.merge(histogram);
+
+  PrometheusWriter out;
+  out.family("latency_seconds", "Latency", PrometheusWriter::SUMMARY);
+  out.summary("latency_seconds", {{"route", "a"}}, summary, 0.5);
+  out.summary("latency_seconds", {{"route", "b"}}, HistogramSummary{}, 0.5);
+  EXPECT_EQ(out.take(),
+            "# HELP latency_seconds Latency\n"
+            "# TYPE latency_seconds summary\n"
+            "latency_seconds{route=\"a\",quantile=\"0.5\"} 2.5\n"
+            "latency_seconds{route=\"a\",quantile=\"0.9\"} 4.5\n"
+            "latency_seconds{route=\"a\",quantile=\"0.99\"} 5\n"
+            "latency_seconds{route=\"a\",quantile=\"1\"} 5\n"
+            "latency_seconds_sum{route=\"a\"} 27.5\n"
+            "latency_seconds_count{route=\"a\"} 10\n"
+            "latency_seconds{route=\"b\",quantile=\"0.5\"} NaN\n"
+            "latency_seconds{route=\"b\",quantile=\"0.9\"} NaN\n"
+            "latency_seconds{route=\"b\",quantile=\"0.99\"} NaN\n"
+            "latency_seconds{route=\"b\",quantile=\"1\"} NaN\n"
+            "latency_seconds_sum{route=\"b\"} 0\n"
+            "latency_seconds_count{route=\"b\"} 0\n");
+}
+
+TEST(PrometheusRegistryTest, Scrape) {
+  PrometheusRegistry registry;
+  EXPECT_EQ(registry.scrape(), "");
+
+  uint64_t count = 0;
+  registry.addCounter("count_total", "A count", [&] { return count; });
+  registry.add([](PrometheusWriter& out) {
+    out.family("custom", "Custom", PrometheusWriter::GAUGE);
+    out.sample("custom", {{"a", "b"}}, 1.5);
+  });
+  registry.addGauge("level", "A level", [] { return 2.0; });
+
+  // In the order they were registered, reading the values as of the scrape
+  count = 7;
+  EXPECT_EQ(registry.scrape(),
+            "# HELP count_total A count\n# TYPE count_total counter\ncount_total 7\n"
+            "# HELP custom Custom\n# TYPE custom gauge\ncustom{a=\"b\"} 1.5\n"
+            "# HELP level A level\n# TYPE level gauge\nlevel 2\n");
+}
+
+TEST(PrometheusRegistryTest, ShardedCounter) {
+  ShardedCounter counter;
+  EXPECT_EQ(counter.value(), 0u);
+
+  constexpr int num_threads = 8;
+  constexpr int adds        = 10000;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < adds; ++j) { counter.add(); }
+      counter.add(5);
+    });
+  }
+  for (std::thread& thread : threads) { thread.join(); }
+  EXPECT_EQ(counter.value(), static_cast<uint64_t>(num_threads) * (adds + 5));
+}
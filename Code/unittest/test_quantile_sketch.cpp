@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "QuantileSketch.h"
+
+// The estimate must be within the sketch's relative error of the exact quantile
+static void expectClose(const QuantileSketch& sketch, std::vector<double> values, double q) {
+  std::ranges::sort(values);
+  const double exact =
+      values[static_cast<std::size_t>(q * static_cast<double>(values.size() - 1))];
+  const std::optional<double> estimate = sketch.quantile(q);
+  ASSERT_TRUE(estimate.has_value());
+  EXPECT_LE(std::abs(*estimate - exact), std::abs(exact) * QuantileSketch::RELATIVE_ERROR)
+      << "q = " << q;
+}
+
+TEST(QuantileSketchTest, Empty) {
+  const QuantileSketch sketch;
+  EXPECT_EQ(sketch.count(), 0u);
+  EXPECT_FALSE(sketch.quantile(0.5).has_value());
+}
+
+TEST(QuantileSketchTest, Accuracy) {
+  // Latencies have a long tail, which is where a fixed width histogram falls apart
+  std::mt19937                  rng(42);
+  std::lognormal_distribution<> latency(3, 1.5);
+  std::vector<double>           values;
+  QuantileSketch                sketch;
+  for (int i = 0; i < 100000; ++i) {
+    values.push_back(latency(rng));
+    sketch.add(values.back());
+  }
+  EXPECT_EQ(sketch.count(), values.size());
+  for (const double q : {0.01, 0.25, 0.5, 0.9, 0.95, 0.99, 0.999}) {
+    expectClose(sketch, values, q);
+  }
+  EXPECT_EQ(sketch.quantile(0), *std::ranges::min_element(values));
+  EXPECT_EQ(sketch.quantile(1), *std::ranges::max_element(values));
+  // Far fewer buckets than values
+  EXPECT_LT(sketch.buckets(), 5000u);
+  EXPECT_FALSE(sketch.quantile(1.5).has_value());
+}
+
+TEST(QuantileSketchTest, NegativeAndZero) {
+  QuantileSketch            sketch;
+  const std::vector<double> values = {-1000, -3.5, -0.25, 0, 0, 0, 0.25, 3.5, 1000};
+  for (const double value : values) { sketch.add(value); }
+  sketch.add(std::nan(""));
+  EXPECT_EQ(sketch.count(), values.size());
+  EXPECT_EQ(sketch.quantile(0.5), 0);
+  for (const double q : {0.125, 0.25, 0.75, 0.875}) { expectClose(sketch, values, q); }
+}
+
+TEST(QuantileSketchTest, Merge) {
+  std::mt19937                     rng(7);
+  std::uniform_real_distribution<> uniform(1, 500);
+  std::vector<double>              values;
+  QuantileSketch                   all;
+  std::vector<QuantileSketch>      parts(10);
+  for (int i = 0; i < 10000; ++i) {
+    values.push_back(uniform(rng));
+    all.add(values.back());
+    parts[i % parts.size()].add(values.back());
+  }
+
+  QuantileSketch merged;
+  for (const QuantileSketch& part : parts) { merged.merge(part); }
+  EXPECT_EQ(merged.count(), all.count());
+  EXPECT_EQ(merged.buckets(), all.buckets());
+  EXPECT_EQ(merged.min(), all.min());
+  EXPECT_EQ(merged.max(), all.max());
+  for (const double q : {0.1, 0.5, 0.99}) {
+    EXPECT_EQ(merged.quantile(q), all.quantile(q));
+    expectClose(merged, values, q);
+  }
+}
@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "QueryIDAllocator.h"
+
+class QueryIDAllocatorTest : public testing::Test {
+ protected:
+  void SetUp() override { std::filesystem::remove_all(m_dir); }
+  void TearDown() override { std::filesystem::remove_all(m_dir); }
+
+  std::filesystem::path m_dir  = std::filesystem::temp_directory_path() / "test_query_id";
+  std::filesystem::path m_path = m_dir / "query_ids";
+};
+
+TEST(QueryIDAllocatorMemoryTest, CountsFromZero) {
+  QueryIDAllocator ids;
+  for (uint64_t expected = 0; expected < 100; ++expected) { EXPECT_EQ(ids.next(), expected); }
+}
+
+TEST_F(QueryIDAllocatorTest, CrossesBlocks) {
+  QueryIDAllocator ids;
+  ASSERT_TRUE(ids.open(m_path, 4));
+  for (uint64_t expected = 0; expected < 10; ++expected) { EXPECT_EQ(ids.next(), expected); }
+}
+
+TEST_F(QueryIDAllocatorTest, ReopenSkipsReservedBlock) {
+  {
+    QueryIDAllocator ids;
+    ASSERT_TRUE(ids.open(m_path, 10));
+    for (int i = 0; i < 15; ++i) { ASSERT_TRUE(ids.next().has_value()); }
+  }
+  // The second block (10-19) was reserved, so none of it may be handed out again
+  QueryIDAllocator ids;
+  ASSERT_TRUE(ids.open(m_path, 10));
+  EXPECT_EQ(ids.next(), 20u);
+}
+
+TEST_F(QueryIDAllocatorTest, RejectsCorruptFile) {
+  std::filesystem::create_directories(m_dir);
+  std::ofstream(m_path) << "not a number\n";
+  QueryIDAllocator ids;
+  EXPECT_FALSE(ids.open(m_path));
+}
+
+TEST_F(QueryIDAllocatorTest, UniqueAcrossThreads) {
+  constexpr int THREADS    = 8;
+  constexpr int PER_THREAD = 5000;
+
+  QueryIDAllocator ids;
+  ASSERT_TRUE(ids.open(m_path, 64));
+
+  std::mutex               mutex;
+  std::set<uint64_t>       seen;
+  std::vector<std::thread> threads;
+  threads.reserve(THREADS);
+  for (int t = 0; t < THREADS; ++t) {
+    threads.emplace_back([&] {
+      std::vector<uint64_t> mine;
+      mine.reserve(PER_THREAD);
+      for (int i = 0; i < PER_THREAD; ++i) {
+        const std::optional<uint64_t> id = ids.next();
+        if (id.has_value()) { mine.push_back(*id); }
+      }
+      const std::lock_guard<std::mutex> lock(mutex);
+      seen.insert(mine.begin(), mine.end());
+    });
+  }
+  for (std::thread& thread : threads) { thread.join(); }
+
+  EXPECT_EQ(seen.size(), static_cast<std::size_t>(THREADS * PER_THREAD));
+  EXPECT_EQ(*seen.rbegin(), static_cast<uint64_t>(THREADS * PER_THREAD - 1));
+}
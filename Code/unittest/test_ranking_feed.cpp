@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "RankingFeed.h"
+#include "TestUtil.hpp"
+
+static constexpr uint16_t PORT_NUM = 8083;
+
+static SearchRecord makeSearch(std::string raw_query, unsigned int clicked) {
+  return {.query_id        = 1,
+          .raw_query       = std::move(raw_query),
+          .results         = {"link1", "link2", "link3"},
+          .clicked         = clicked,
+          .query_timestamp = ""};
+}
+
+TEST(RankingInteractionTest, FromSearch) {
+  const RankingInteraction interaction =
+      RankingInteraction::fromSearch(makeSearch("  Rensselaer   Polytechnic Institute ", 2));
+  EXPECT_EQ(interaction.processed_query, "rensselaer polytechnic institute");
+  EXPECT_EQ(interaction.links_ignored, std::vector<std::string>({"link1", "link2"}));
+  EXPECT_EQ(interaction.link_clicked, "link3");
+
+  const RankingInteraction first = RankingInteraction::fromSearch(makeSearch("RPI", 0));
+  EXPECT_TRUE(first.links_ignored.empty());
+  EXPECT_EQ(first.link_clicked, "link1");
+}
+
+TEST(RankingFeedTest, CoalescesPerQuery) {
+  FakeHost    host(PORT_NUM);
+  RankingFeed feed("localhost", PORT_NUM, "/ranking/interactions",
+                   {.window_ms = 50,
+                    .client = {.timeout_ms = 500, .initial_backoff_ms = 10, .max_backoff_ms = 20}});
+  feed.start();
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(feed.record(RankingInteraction::fromSearch(makeSearch("RPI", 1))));
+  }
+  EXPECT_TRUE(feed.record(RankingInteraction::fromSearch(makeSearch("rpi", 0))));
+  EXPECT_FALSE(feed.record(RankingInteraction::fromSearch(makeSearch("", 0))));
+  feed.stop();
+
+  const std::vector<HTTPRequest> requests = host.requests();
+  ASSERT_EQ(requests.size(), 1u);
+  EXPECT_EQ(requests[0].resource, "/ranking/interactions");
+  const nlohmann::json interactions = nlohmann::json::parse(requests[0].body).at("interactions");
+  const nlohmann::json expected     = {
+      {{"processed_query", "rpi"},
+       {"links_ignored", {"link1"}},
+       {"link_clicked", "link2"},
+       {"count", 3}},
+      {{"processed_query", "rpi"},
+       {"links_ignored", nlohmann::json::array()},
+       {"link_clicked", "link1"},
+       {"count", 1}}
+  };
+  EXPECT_EQ(interactions, expected);
+}
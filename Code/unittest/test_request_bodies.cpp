@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "RequestBodies.h"
+#include "SearchHistoryStore.h"
+
+TEST(RequestBodiesTest, SearchResults) {
+  const std::optional<SearchRecord> record = parseSearchResults(R"({
+    "query_ID": 18446744073709551615,
+    "ignored": {"nested": [1, {"results": "not these"}], "clicked": 7},
+    "raw_query": "rpi \"lspt\"",
+    "results": ["a.com", "b.com", "c.com"],
+    "clicked": 2,
+    "query_timestamp": "2024-01-01T00:00:00Z",
+    "also_ignored": null
+  })");
+  ASSERT_TRUE(record.has_value());
+  EXPECT_EQ(record->query_id, UINT64_MAX);
+  EXPECT_EQ(record->raw_query, "rpi \"lspt\"");
+  EXPECT_EQ(record->results, std::vector<std::string>({"a.com", "b.com", "c.com"}));
+  EXPECT_EQ(record->clicked, 2u);
+  EXPECT_EQ(record->query_timestamp, "2024-01-01T00:00:00Z");
+
+  // The optional fields can be left out
+  const std::optional<SearchRecord> minimal =
+      parseSearchResults(R"({"query_ID": 1, "results": ["a.com"], "clicked": 0})");
+  ASSERT_TRUE(minimal.has_value());
+  EXPECT_EQ(minimal->raw_query, "");
+}
+
+TEST(RequestBodiesTest, BadSearchResults) {
+  for (const char* body : {
+           "",
+           "[]",
+           R"({"query_ID": 1, "results": ["a.com"], "clicked": 0)",
+           R"({"query_ID": 1, "results": ["a.com"], "clicked": 0} {})",
+           R"({"results": ["a.com"], "clicked": 0})",
+           R"({"query_ID": 1, "clicked": 0})",
+           R"({"query_ID": 1, "results": ["a.com"]})",
+           R"({"query_ID": -1, "results": ["a.com"], "clicked": 0})",
+           R"({"query_ID": 1.5, "results": ["a.com"], "clicked": 0})",
+           R"({"query_ID": "1", "results": ["a.com"], "clicked": 0})",
+           R"({"query_ID": 1, "results": ["a.com", 2], "clicked": 0})",
+           R"({"query_ID": 1, "results": [["a.com"]], "clicked": 0})",
+           R"({"query_ID": 1, "results": "a.com", "clicked": 0})",
+           R"({"query_ID": 1, "results": ["a.com"], "clicked": 1})",
+           R"({"query_ID": 1, "results": ["a.com"], "clicked": 4294967296})",
+           R"({"query_ID": 1, "results": ["a.com"], "clicked": 0, "raw_query": null})",
+       }) {
+    EXPECT_FALSE(parseSearchResults(body).has_value()) << body;
+  }
+}
+
+TEST(RequestBodiesTest, MetricsReport) {
+  const char* body = R"({
+    "ignored": [{"label": "not this one", "value": 1}],
+    "metrics": [
+      {"label": "latency_ms", "value": 12.5, "timestamp": 1700000000000},
+      {"value": 3, "label": "docs", "extra": {"a": [1, 2]}},
+      {"label": "broken_links", "value": ["a.com", {"url": "b.com", "codes": [404, 410]}]},
+      {"label": "status", "value": "degraded", "timestamp": -5},
+      {"label": "empty", "value": {}}
+    ]
+  })";
+  const std::optional<std::vector<ReportedMetric>> metrics = parseMetricsReport(body, 42);
+  ASSERT_TRUE(metrics.has_value());
+  ASSERT_EQ(metrics->size(), 5u);
+  EXPECT_EQ((*metrics)[0].label, "latency_ms");
+  EXPECT_EQ((*metrics)[0].timestamp_ms, 1700000000000);
+  EXPECT_EQ((*metrics)[0].value, 12.5);
+  EXPECT_EQ((*metrics)[1].label, "docs");
+  EXPECT_EQ((*metrics)[1].timestamp_ms, 42);
+  EXPECT_EQ((*metrics)[1].value, 3);
+  EXPECT_EQ((*metrics)[2].value,
+            nlohmann::json::parse(R"(["a.com", {"url": "b.com", "codes": [404, 410]}])"));
+  EXPECT_EQ((*metrics)[3].value, "degraded");
+  EXPECT_EQ((*metrics)[3].timestamp_ms, -5);
+  EXPECT_EQ((*metrics)[4].value, nlohmann::json::object());
+
+  const std::optional<std::vector<ReportedMetric>> none =
+      parseMetricsReport(R"({"metrics": []})", 0);
+  ASSERT_TRUE(none.has_value());
+  EXPECT_TRUE(none->empty());
+}
+
+TEST(RequestBodiesTest, BadMetricsReport) {
+  for (const char* body : {
+           "",
+           "{}",
+           R"({"metrics": {}})",
+           R"({"metrics": [1]})",
+           R"({"metrics": [{"value": 1}]})",
+           R"({"metrics": [{"label": "a"}]})",
+           R"({"metrics": [{"label": 1, "value": 1}]})",
+           R"({"metrics": [{"label": "a", "value": 1, "timestamp": "now"}]})",
+           R"({"metrics": [{"label": "a", "value": 1, "timestamp": 1.5}]})",
+           R"({"metrics": [{"label": "a", "value": 1, "timestamp": 9223372036854775808}]})",
+           R"({"metrics": [{"label": "a", "value": [1, 2}]})",
+       }) {
+    EXPECT_FALSE(parseMetricsReport(body, 0).has_value()) << body;
+  }
+}
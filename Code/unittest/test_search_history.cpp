@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "SQLite.h"
+#include "SearchHistoryStore.h"
+
+class SearchHistoryTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    std::filesystem::remove_all(m_dir);
+    ASSERT_TRUE(m_store.open((m_dir / "history.db").string()));
+  }
+
+  void TearDown() override {
+    m_store.close();
+    std::filesystem::remove_all(m_dir);
+  }
+
+  static SearchRecord makeRecord(uint64_t query_id, unsigned int clicked = 1) {
+    return {.query_id        = query_id,
+            .raw_query       = "How do I do a thing",
+            .results         = {"link1", "link2", "link3"},
+            .clicked         = clicked,
+            .query_timestamp = "Tue, 29 Oct 2024 16:56:32 GMT"};
+  }
+
+  std::filesystem::path m_dir = std::filesystem::temp_directory_path() / "test_search_history";
+  SearchHistoryStore    m_store;
+};
+
+TEST_F(SearchHistoryTest, StoreAndFind) {
+  EXPECT_TRUE(m_store.enqueue(makeRecord(1234)));
+  m_store.flush();
+
+  std::optional<SearchRecord> record = m_store.find(1234);
+  ASSERT_TRUE(record.has_value());
+  EXPECT_EQ(record->query_id, 1234u);
+  EXPECT_EQ(record->raw_query, "How do I do a thing");
+  EXPECT_EQ(record->results, std::vector<std::string>({"link1", "link2", "link3"}));
+  EXPECT_EQ(record->clicked, 1u);
+  EXPECT_EQ(record->query_timestamp, "Tue, 29 Oct 2024 16:56:32 GMT");
+
+  EXPECT_FALSE(m_store.find(4321).has_value());
+}
+
+TEST_F(SearchHistoryTest, ConflictingIDIgnored) {
+  EXPECT_TRUE(m_store.enqueue(makeRecord(7, 0)));
+  EXPECT_TRUE(m_store.enqueue(makeRecord(7, 2)));
+  m_store.flush();
+
+  std::optional<SearchRecord> record = m_store.find(7);
+  ASSERT_TRUE(record.has_value());
+  EXPECT_EQ(record->clicked, 0u);
+}
+
+TEST_F(SearchHistoryTest, ManyRecordsBatched) {
+  constexpr uint64_t NUM_RECORDS = 5000;
+  for (uint64_t id = 0; id < NUM_RECORDS; ++id) { EXPECT_TRUE(m_store.enqueue(makeRecord(id))); }
+  m_store.flush();
+  for (const uint64_t id : {0ul, NUM_RECORDS / 2, NUM_RECORDS - 1}) {
+    EXPECT_TRUE(m_store.find(id).has_value());
+  }
+}
+
+TEST_F(SearchHistoryTest, SurvivesReopen) {
+  EXPECT_TRUE(m_store.enqueue(makeRecord(99)));
+  m_store.close();    // Should write out the queue without a flush
+
+  ASSERT_TRUE(m_store.open((m_dir / "history.db").string()));
+  EXPECT_TRUE(m_store.find(99).has_value());
+}
+
+TEST_F(SearchHistoryTest, CountsQueries) {
+  SearchRecord other = makeRecord(3);
+  other.raw_query    = "Something else";
+  EXPECT_TRUE(m_store.enqueue(makeRecord(1)));
+  EXPECT_TRUE(m_store.enqueue(makeRecord(2)));
+  EXPECT_TRUE(m_store.enqueue(std::move(other)));
+  m_store.flush();
+
+  std::map<std::string, uint64_t> counts;
+  EXPECT_TRUE(m_store.forEachQuery(
+      [&](std::string_view query, uint64_t count) { counts[std::string(query)] = count; }));
+  EXPECT_EQ(counts, (std::map<std::string, uint64_t>{{"How do I do a thing", 2},
+                                                     {"Something else", 1}}));
+}
+
+TEST_F(SearchHistoryTest, FindMany) {
+  SearchRecord no_results = makeRecord(5);
+  no_results.results.clear();
+  EXPECT_TRUE(m_store.enqueue(makeRecord(3, 0)));
+  EXPECT_TRUE(m_store.enqueue(std::move(no_results)));
+  EXPECT_TRUE(m_store.enqueue(makeRecord(8, 2)));
+  // Reopened so nothing is cached, and everything has to come from one lookup
+  m_store.close();
+  ASSERT_TRUE(m_store.open((m_dir / "history.db").string()));
+
+  std::vector<SearchRecord> records = m_store.find(std::vector<uint64_t>{8, 4, 3, 5, 8});
+  ASSERT_EQ(records.size(), 3u);
+  EXPECT_EQ(records[0].query_id, 8u);
+  EXPECT_EQ(records[0].clicked, 2u);
+  EXPECT_EQ(records[0].results, std::vector<std::string>({"link1", "link2", "link3"}));
+  EXPECT_EQ(records[1].query_id, 3u);
+  EXPECT_EQ(records[2].query_id, 5u);
+  EXPECT_TRUE(records[2].results.empty());
+
+  // Now cached, along with a new record the lookup has to be mixed with
+  EXPECT_TRUE(m_store.enqueue(makeRecord(4)));
+  m_store.flush();
+  records = m_store.find(std::vector<uint64_t>{3, 4, 5, 8});
+  ASSERT_EQ(records.size(), 4u);
+  EXPECT_EQ(records[1].query_id, 4u);
+  EXPECT_EQ(records[3].raw_query, "How do I do a thing");
+
+  EXPECT_TRUE(m_store.find(std::vector<uint64_t>{}).empty());
+}
+
+TEST_F(SearchHistoryTest, FoundBeforeWritten) {
+  // A batch that is never cut short, so the record is still queued when it is looked up
+  m_store.close();
+  ASSERT_TRUE(m_store.open(
+      (m_dir / "history.db").string(),
+      {.batch_size = 1000, .batch_window_ms = 60000, .max_queued = 1000, .cache_size = 16}));
+  EXPECT_TRUE(m_store.enqueue(makeRecord(12)));
+  const std::optional<SearchRecord> record = m_store.find(12);
+  ASSERT_TRUE(record.has_value());
+  EXPECT_EQ(record->results.size(), 3u);
+}
+
+TEST_F(SearchHistoryTest, FindAfter) {
+  for (const uint64_t id : {9, 2, 5, 7, 3}) { EXPECT_TRUE(m_store.enqueue(makeRecord(id))); }
+  m_store.flush();
+
+  // Paged through, two at a time
+  std::vector<uint64_t> ids;
+  uint64_t              after_id = 2;
+  while (true) {
+    const std::optional<std::vector<SearchRecord>> page = m_store.findAfter(after_id, 2);
+    ASSERT_TRUE(page.has_value());
+    if (page->empty()) { break; }
+    EXPECT_LE(page->size(), 2u);
+    for (const SearchRecord& record : *page) {
+      EXPECT_EQ(record.results.size(), 3u);
+      ids.push_back(record.query_id);
+    }
+    after_id = page->back().query_id;
+  }
+  EXPECT_EQ(ids, std::vector<uint64_t>({3, 5, 7, 9}));
+  EXPECT_TRUE(m_store.findAfter(std::numeric_limits<uint64_t>::max(), 2)->empty());
+}
+
+TEST_F(SearchHistoryTest, BadRecordOnlyDropsItself) {
+  // Makes one record fail to insert, as a full disk or corruption might
+  const SQLiteDatabase db = openDatabase((m_dir / "history.db").string());
+  ASSERT_TRUE(executeSQL(db.get(),
+                         "CREATE TRIGGER reject_bad BEFORE INSERT ON queries "
+                         "WHEN NEW.raw_query = 'bad' BEGIN SELECT RAISE(ABORT, 'bad'); END"));
+
+  SearchRecord bad = makeRecord(2);
+  bad.raw_query    = "bad";
+  EXPECT_TRUE(m_store.enqueue(makeRecord(1)));
+  EXPECT_TRUE(m_store.enqueue(std::move(bad)));
+  EXPECT_TRUE(m_store.enqueue(makeRecord(3)));
+  m_store.flush();
+
+  // The rest of the batch is in the database, not just the cache
+  const std::optional<std::vector<SearchRecord>> stored = m_store.findAfter(0, 10);
+  ASSERT_TRUE(stored.has_value());
+  ASSERT_EQ(stored->size(), 2u);
+  EXPECT_EQ(stored->at(0).query_id, 1u);
+  EXPECT_EQ(stored->at(1).query_id, 3u);
+  EXPECT_FALSE(m_store.find(2).has_value());
+
+  const SearchHistoryStore::WriterStats stats = m_store.writerStats();
+  EXPECT_EQ(stats.failed_batches, 1u);
+  EXPECT_EQ(stats.dropped_records, 1u);
+}
+
+TEST(SearchHistoryClosedTest, RejectsWhenClosed) {
+  SearchHistoryStore store;
+  EXPECT_FALSE(store.enqueue({}));
+  EXPECT_FALSE(store.find(0).has_value());
+  EXPECT_FALSE(store.findAfter(0, 1).has_value());
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ServerStats.h"
+
+TEST(ServerStatsTest, MergesThreads) {
+  ServerStats stats;
+  const RequestTiming timing{.first_byte_ns = 2000,
+                             .parse_ns      = 100,
+                             .handler_ns    = 1000,
+                             .send_ns       = 500,
+                             .status        = 200,
+                             .bytes_in      = 10,
+                             .bytes_out     = 20};
+  std::vector<std::thread> threads;
+  for (std::size_t route = 0; route < 4; ++route) {
+    threads.emplace_back([&stats, &timing, route] {
+      for (int i = 0; i < 1000; ++i) { stats.record(route, timing); }
+      stats.record(route, {.status = 404});
+    });
+  }
+  for (std::thread& thread : threads) { thread.join(); }
+
+  const ServerStats::Summary summary = stats.summary();
+  EXPECT_EQ(summary.requests, 4004u);
+  EXPECT_EQ(summary.bytes_in, 40000u);
+  EXPECT_EQ(summary.bytes_out, 80000u);
+  EXPECT_EQ(summary.status_codes.at(200), 4000u);
+  EXPECT_EQ(summary.status_codes.at(404), 4u);
+  for (std::size_t route = 0; route < 4; ++route) {
+    EXPECT_EQ(summary.routes[route].requests, 1001u);
+    EXPECT_EQ(summary.routes[route].latency[ServerStats::HANDLER].count(), 1001u);
+  }
+  EXPECT_EQ(summary.routes[4].requests, 0u);
+
+  // Routes past the last one share it
+  stats.record(ServerStats::MAX_ROUTES + 3, timing);
+  EXPECT_EQ(stats.summary().routes[ServerStats::MAX_ROUTES - 1].requests, 1u);
+}
+
+TEST(ServerStatsTest, OpenConnections) {
+  ServerStats stats;
+  {
+    OpenConnection first(&stats);
+    OpenConnection second(&stats);
+    OpenConnection moved(std::move(second));
+    std::thread([&] { OpenConnection closed_elsewhere = std::move(first); }).join();
+    const ServerStats::Summary summary = stats.summary();
+    EXPECT_EQ(summary.connections_opened, 2u);
+    EXPECT_EQ(summary.connections_closed, 1u);
+  }
+  EXPECT_EQ(stats.summary().connections_closed, 2u);
+  OpenConnection nothing(nullptr);
+}
@@ -1,5 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <array>
+#include <string>
+#include <thread>
+
 #include "TCPSocket.h"
 #include "TestUtil.hpp"
 
@@ -127,3 +131,30 @@ TEST(TCPTest, TestSockStream) {
 
   EXPECT_EQ(ss.str(), line1 + line2);
 }
+
+TEST(TCPTest, SendVectored) {
+  std::pair<TCPSocket, TCPSocket> sockets = get_server_and_client(PORT_NUM);
+  EXPECT_TRUE(sockets.first.setTimeout<SO_RCVTIMEO>(1000));
+  EXPECT_TRUE(sockets.second.setTimeout<SO_SNDTIMEO>(1000));
+  EXPECT_TRUE(sockets.second.setNonBlocking(true));
+
+  // Large enough that the kernel only takes part of it at a time
+  std::string       head = "head:";
+  const std::string body(4 * 1024 * 1024, 'x');
+  std::string       tail = ":tail";
+  std::array<iovec, 3> parts = {
+      {{head.data(), head.size()},
+       {const_cast<char*>(body.data()), body.size()},    // NOLINT(*-const-cast)
+       {tail.data(), tail.size()}}
+  };
+
+  std::thread receiver([&] {
+    ByteBuffer buffer;
+    while (buffer.size() < head.size() + body.size() + tail.size()) {
+      if (sockets.first.recv(buffer) <= 0) { break; }
+    }
+    EXPECT_EQ(buffer.view(), head + body + tail);
+  });
+  EXPECT_TRUE(sockets.second.sendv(parts));
+  receiver.join();
+}
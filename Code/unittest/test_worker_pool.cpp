@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include "WorkerPool.h"
+
+TEST(WorkerPoolTest, RunsAllJobs) {
+  std::atomic<int> sum = 0;
+  {
+    WorkerPool<int> pool(4, 100, [&sum](int&& job) { sum += job; });
+    for (int i = 1; i <= 100; ++i) { EXPECT_TRUE(pool.submit(int(i))); }
+  }    // Destructor should finish the queued jobs before joining
+
+  EXPECT_EQ(sum, 5050);
+}
+
+TEST(WorkerPoolTest, RejectsWhenFull) {
+  std::promise<void>       release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<int>         started  = 0;
+
+  WorkerPool<int> pool(1, 2, [&](int&& /* job */) {
+    started++;
+    released.wait();
+  });
+
+  // First job occupies the only worker, wait for it to be picked up
+  EXPECT_TRUE(pool.submit(0));
+  while (started == 0) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+
+  // Two more fill the queue, anything after that is rejected
+  EXPECT_TRUE(pool.submit(1));
+  EXPECT_TRUE(pool.submit(2));
+  int rejected = 3;
+  EXPECT_FALSE(pool.submit(std::move(rejected)));
+  EXPECT_EQ(pool.queued(), 2u);
+
+  release.set_value();
+  pool.stop();
+  EXPECT_EQ(started, 3);
+}
+
+TEST(WorkerPoolTest, RejectsAfterStop) {
+  WorkerPool<int> pool(2, 10, [](int&& /* job */) {});
+  pool.stop();
+  EXPECT_FALSE(pool.submit(1));
+}